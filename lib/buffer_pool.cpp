@@ -0,0 +1,122 @@
+#include "buffer_pool.h"
+#include <algorithm>
+#include <cstring>
+
+namespace InterProcessCommunication
+{
+BufferPool::BufferPool(size_t block_size, std::pmr::memory_resource* memory_resource, size_t blocks_per_slab)
+: m_block_size(block_size)
+, m_blocks_per_slab(blocks_per_slab == 0 ? 1 : blocks_per_slab)
+, m_memory_resource(memory_resource)
+, m_slabs(memory_resource)
+, m_free_blocks(memory_resource)
+{
+}
+
+BufferPool::~BufferPool()
+{
+    for(char* slab : m_slabs)
+    {
+        m_memory_resource->deallocate(slab, m_blocks_per_slab * m_block_size);
+    }
+}
+
+char* BufferPool::Acquire()
+{
+    if(m_free_blocks.empty())
+    {
+        AllocateSlab();
+    }
+
+    char* block = m_free_blocks.back();
+    m_free_blocks.pop_back();
+    ++m_borrowed_block_count;
+
+    return block;
+}
+
+void BufferPool::Release(char* block)
+{
+    if(block == nullptr)
+    {
+        return;
+    }
+
+    m_free_blocks.emplace_back(block);
+    --m_borrowed_block_count;
+}
+
+void BufferPool::Reserve(size_t block_count)
+{
+    while(m_free_blocks.size() < block_count)
+    {
+        AllocateSlab();
+        memset(m_slabs.back(), 0, m_blocks_per_slab * m_block_size);
+    }
+}
+
+size_t BufferPool::Trim(size_t free_block_count)
+{
+    const size_t slab_size = m_blocks_per_slab * m_block_size;
+    size_t released_bytes = 0;
+
+    // with the free list in address order, the blocks of one slab sit next to each other
+    std::sort(m_free_blocks.begin(), m_free_blocks.end());
+
+    for(size_t slab_index = 0; slab_index < m_slabs.size() && m_free_blocks.size() >= free_block_count + m_blocks_per_slab;)
+    {
+        char* slab = m_slabs[slab_index];
+        const auto first_block = std::lower_bound(m_free_blocks.begin(), m_free_blocks.end(), slab);
+        const auto last_block = std::lower_bound(first_block, m_free_blocks.end(), slab + slab_size);
+
+        if(static_cast<size_t>(last_block - first_block) != m_blocks_per_slab)
+        {
+            ++slab_index;
+            continue;
+        }
+
+        m_free_blocks.erase(first_block, last_block);
+        m_memory_resource->deallocate(slab, slab_size);
+        m_slabs[slab_index] = m_slabs.back();
+        m_slabs.pop_back();
+        released_bytes += slab_size;
+    }
+
+    return released_bytes;
+}
+
+size_t BufferPool::GetBlockSize() const
+{
+    return m_block_size;
+}
+
+size_t BufferPool::GetBorrowedBlockCount() const
+{
+    return m_borrowed_block_count;
+}
+
+size_t BufferPool::GetReservedBytes() const
+{
+    return m_slabs.size() * m_blocks_per_slab * m_block_size + m_free_blocks.capacity() * sizeof(char*);
+}
+
+size_t BufferPool::GetBorrowedBytes() const
+{
+    return m_borrowed_block_count * m_block_size;
+}
+
+void BufferPool::AllocateSlab()
+{
+    // blocks are carved out of one contiguous slab so that a burst of borrows costs a single heap allocation
+    char* slab = static_cast<char*>(m_memory_resource->allocate(m_blocks_per_slab * m_block_size));
+    m_slabs.emplace_back(slab);
+
+    m_free_blocks.reserve(m_slabs.size() * m_blocks_per_slab);
+
+    for(size_t index = 0; index < m_blocks_per_slab; ++index)
+    {
+        m_free_blocks.emplace_back(slab + index * m_block_size);
+    }
+}
+
+} // namespace InterProcessCommunication
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+namespace InterProcessCommunication
+{
+class BufferPool
+{
+public:
+
+    BufferPool(size_t block_size, std::pmr::memory_resource* memory_resource = std::pmr::get_default_resource(), size_t blocks_per_slab = DEFAULT_BLOCKS_PER_SLAB);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /*
+        Borrow one block of GetBlockSize() bytes. The pool grows by one slab when no free block is left.
+    */
+    char* Acquire();
+
+    /*
+        Return a block that was previously borrowed with Acquire().
+    */
+    void Release(char* block);
+
+    /*
+        Grow the pool until at least "block_count" blocks are free, and write to the new slabs so that their pages are faulted in by the calling thread.
+    */
+    void Reserve(size_t block_count);
+
+    /*
+        Give slabs whose blocks are all free back to the memory resource, as long as at least "free_block_count" free blocks remain. Returns the bytes released.
+    */
+    size_t Trim(size_t free_block_count);
+
+    size_t GetBlockSize() const;
+    size_t GetBorrowedBlockCount() const;
+
+    /*
+        Total number of bytes the pool holds, whether borrowed or free.
+    */
+    size_t GetReservedBytes() const;
+
+    /*
+        Number of bytes currently borrowed, which is the amount of buffer memory in flight.
+    */
+    size_t GetBorrowedBytes() const;
+
+private:
+
+    static constexpr size_t DEFAULT_BLOCKS_PER_SLAB = 16;
+
+    const size_t m_block_size;
+    const size_t m_blocks_per_slab;
+    std::pmr::memory_resource* m_memory_resource;
+    std::pmr::vector<char*> m_slabs;
+    std::pmr::vector<char*> m_free_blocks;
+    size_t m_borrowed_block_count = 0;
+
+    void AllocateSlab();
+};
+} // namespace InterProcessCommunication
@@ -0,0 +1,178 @@
+#include "huge_page_arena.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace InterProcessCommunication
+{
+HugePageArena::HugePageArena(std::pmr::memory_resource* upstream)
+: m_upstream(upstream)
+{
+}
+
+HugePageArena::~HugePageArena()
+{
+    if(m_region != nullptr)
+    {
+        munmap(m_region, m_capacity);
+    }
+}
+
+bool HugePageArena::Map(size_t size)
+{
+    if(m_region != nullptr || size == 0)
+    {
+        return false;
+    }
+
+    const size_t capacity = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+    // explicit huge pages only exist if the administrator reserved some, so this usually fails quietly
+    void* region = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if(region != MAP_FAILED)
+    {
+        m_region = static_cast<char*>(region);
+        m_capacity = capacity;
+        m_page_mode = PageMode::HUGETLB;
+        return true;
+    }
+
+    // map one huge page more than needed and trim both ends, so that the region starts on a huge page boundary and can be backed by huge pages throughout
+    region = mmap(nullptr, capacity + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(region == MAP_FAILED)
+    {
+        perror("HugePageArena::Map() -> Failed to map the arena");
+        return false;
+    }
+
+    char* const mapping = static_cast<char*>(region);
+    char* const aligned_region = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(mapping) + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+    const size_t head_size = aligned_region - mapping;
+    const size_t tail_size = HUGE_PAGE_SIZE - head_size;
+
+    if(head_size != 0)
+    {
+        munmap(mapping, head_size);
+    }
+
+    if(tail_size != 0)
+    {
+        munmap(aligned_region + capacity, tail_size);
+    }
+
+    m_region = aligned_region;
+    m_capacity = capacity;
+    m_page_mode = madvise(m_region, m_capacity, MADV_HUGEPAGE) == 0 ? PageMode::TRANSPARENT : PageMode::REGULAR;
+
+    return true;
+}
+
+void HugePageArena::Prefault()
+{
+    const size_t page_size = m_page_mode == PageMode::HUGETLB ? HUGE_PAGE_SIZE : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    // a write rather than a read, because a read of an untouched anonymous page only maps the shared zero page; the byte is written back unchanged, as blocks may already be in use
+    for(size_t offset = 0; offset < m_capacity; offset += page_size)
+    {
+        volatile char* const byte = m_region + offset;
+        *byte = *byte;
+    }
+}
+
+HugePageArena::PageMode HugePageArena::GetPageMode() const
+{
+    return m_page_mode;
+}
+
+size_t HugePageArena::GetCapacity() const
+{
+    return m_capacity;
+}
+
+size_t HugePageArena::GetUsedBytes() const
+{
+    return m_used_bytes;
+}
+
+size_t HugePageArena::GetFallbackBytes() const
+{
+    return m_fallback_bytes;
+}
+
+void* HugePageArena::do_allocate(size_t bytes, size_t alignment)
+{
+    if(m_region != nullptr && bytes <= m_capacity)
+    {
+        const size_t block_size = GetBlockSize(bytes);
+        FreeBlock*& free_list = GetFreeList(block_size);
+
+        // any returned block of the class fits, as long as it happens to be aligned well enough
+        if(free_list != nullptr && reinterpret_cast<uintptr_t>(free_list) % alignment == 0)
+        {
+            FreeBlock* const block = free_list;
+            free_list = block->next;
+            m_used_bytes += block_size;
+            return block;
+        }
+
+        const size_t offset = (m_offset + alignment - 1) / alignment * alignment;
+
+        if(offset + block_size <= m_capacity)
+        {
+            m_offset = offset + block_size;
+            m_used_bytes += block_size;
+            return m_region + offset;
+        }
+    }
+
+    m_fallback_bytes += bytes;
+    return m_upstream->allocate(bytes, alignment);
+}
+
+void HugePageArena::do_deallocate(void* pointer, size_t bytes, size_t alignment)
+{
+    char* const address = static_cast<char*>(pointer);
+
+    if(m_region == nullptr || address < m_region || address >= m_region + m_capacity)
+    {
+        m_fallback_bytes -= bytes;
+        m_upstream->deallocate(pointer, bytes, alignment);
+        return;
+    }
+
+    const size_t block_size = GetBlockSize(bytes);
+    m_used_bytes -= block_size;
+
+    // the most recent block simply moves the offset back, any other one waits for the next request of its class
+    if(address + block_size == m_region + m_offset)
+    {
+        m_offset = address - m_region;
+        return;
+    }
+
+    FreeBlock*& free_list = GetFreeList(block_size);
+    free_list = new (address) FreeBlock{free_list};
+}
+
+size_t HugePageArena::GetBlockSize(size_t bytes)
+{
+    return std::max(std::bit_ceil(bytes), MINIMUM_BLOCK_SIZE);
+}
+
+HugePageArena::FreeBlock*& HugePageArena::GetFreeList(size_t block_size)
+{
+    return m_free_lists[std::countr_zero(block_size / MINIMUM_BLOCK_SIZE)];
+}
+
+bool HugePageArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+} // namespace InterProcessCommunication
@@ -0,0 +1,85 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+
+namespace InterProcessCommunication
+{
+/*
+    A memory resource over one large mapping that is backed by huge pages where the system allows it, so that buffers spread over thousands of
+    connections take a handful of TLB entries instead of one per 4 KiB page. It is meant as the upstream of a pool resource, which asks for few, large blocks:
+    blocks are rounded up to a power of two and carved off the mapping in order, returned blocks wait on a list per size class for the next request of that class,
+    and requests the mapping cannot serve go upstream.
+*/
+class HugePageArena : public std::pmr::memory_resource
+{
+public:
+
+    enum class PageMode
+    {
+        NONE,        // not mapped, everything goes upstream
+        HUGETLB,     // explicit huge pages from the reserved pool, MAP_HUGETLB
+        TRANSPARENT, // regular mapping that the kernel backs with huge pages where it can, MADV_HUGEPAGE
+        REGULAR      // transparent huge pages are not available either
+    };
+
+    explicit HugePageArena(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+    ~HugePageArena() override;
+
+    HugePageArena(const HugePageArena&) = delete;
+    HugePageArena& operator=(const HugePageArena&) = delete;
+
+    /*
+        Map "size" bytes, rounded up to whole huge pages. An arena can only be mapped once.
+    */
+    bool Map(size_t size);
+
+    /*
+        Write to every page from the calling thread, so that no page fault is left for the hot path, and so that the pages land on this thread's NUMA node.
+    */
+    void Prefault();
+
+    PageMode GetPageMode() const;
+    size_t GetCapacity() const;
+
+    /*
+        Bytes of the mapping that are handed out and not returned, counted in whole size classes.
+    */
+    size_t GetUsedBytes() const;
+
+    /*
+        Bytes currently served by the upstream resource, because the mapping was full or not there.
+    */
+    size_t GetFallbackBytes() const;
+
+private:
+
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    static constexpr size_t MINIMUM_BLOCK_SIZE = 64;
+    static constexpr size_t SIZE_CLASS_COUNT = 64 - 6; // one class per power of two from MINIMUM_BLOCK_SIZE up
+
+    /*
+        A returned block, which holds the link to the next returned block of its size class in its own first bytes.
+    */
+    struct FreeBlock
+    {
+        FreeBlock* next = nullptr;
+    };
+
+    std::pmr::memory_resource* const m_upstream;
+    char* m_region = nullptr;
+    size_t m_capacity = 0;
+    size_t m_offset = 0;
+    size_t m_used_bytes = 0;
+    size_t m_fallback_bytes = 0;
+    PageMode m_page_mode = PageMode::NONE;
+    std::array<FreeBlock*, SIZE_CLASS_COUNT> m_free_lists {};
+
+    static size_t GetBlockSize(size_t bytes);
+    FreeBlock*& GetFreeList(size_t block_size);
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+} // namespace InterProcessCommunication
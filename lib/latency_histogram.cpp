@@ -0,0 +1,63 @@
+#include "latency_histogram.h"
+#include <algorithm>
+#include <bit>
+
+namespace InterProcessCommunication
+{
+void LatencyHistogram::Record(std::chrono::nanoseconds latency)
+{
+    // negative latencies come from clock adjustments and are counted as zero
+    const uint64_t nanoseconds = latency.count() > 0 ? static_cast<uint64_t>(latency.count()) : 0;
+
+    // bucket n holds latencies below 2^n nanoseconds
+    ++m_buckets[std::bit_width(nanoseconds) % BUCKET_COUNT];
+    ++m_count;
+
+    if(latency > m_maximum)
+    {
+        m_maximum = latency;
+    }
+}
+
+void LatencyHistogram::Reset()
+{
+    m_buckets.fill(0);
+    m_count = 0;
+    m_maximum = std::chrono::nanoseconds::zero();
+}
+
+uint64_t LatencyHistogram::GetCount() const
+{
+    return m_count;
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetMaximum() const
+{
+    return m_maximum;
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetPercentile(double percentile) const
+{
+    if(m_count == 0)
+    {
+        return std::chrono::nanoseconds::zero();
+    }
+
+    const double rank = percentile / 100.0 * m_count;
+    uint64_t accumulated_count = 0;
+
+    for(size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket)
+    {
+        accumulated_count += m_buckets[bucket];
+
+        if(accumulated_count >= rank && accumulated_count > 0)
+        {
+            const uint64_t upper_bound = bucket == 0 ? 0 : (uint64_t{1} << bucket) - 1;
+            return std::min(std::chrono::nanoseconds(upper_bound), m_maximum);
+        }
+    }
+
+    return m_maximum;
+}
+
+} // namespace InterProcessCommunication
@@ -0,0 +1,34 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace InterProcessCommunication
+{
+/*
+    Counts latencies in power of two nanosecond buckets. Recording is a handful of instructions, so it can sit on the hot path.
+*/
+class LatencyHistogram
+{
+public:
+
+    void Record(std::chrono::nanoseconds latency);
+    void Reset();
+
+    uint64_t GetCount() const;
+    std::chrono::nanoseconds GetMaximum() const;
+
+    /*
+        Get an upper bound for the given percentile, for example 99.9. The bound is the top of the bucket the percentile falls in.
+    */
+    std::chrono::nanoseconds GetPercentile(double percentile) const;
+
+private:
+
+    static constexpr size_t BUCKET_COUNT = 64;
+
+    std::array<uint64_t, BUCKET_COUNT> m_buckets {};
+    uint64_t m_count = 0;
+    std::chrono::nanoseconds m_maximum {};
+};
+} // namespace InterProcessCommunication
@@ -1,481 +1,3951 @@
 #include "non_blocking_socket_server.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <thread>
 
 namespace InterProcessCommunication
 {
-NonBlockingSocketServer::NonBlockingSocketServer(const std::string& unix_socket_path, size_t client_limit, std::chrono::milliseconds blocking_timeout, bool is_verbose) 
-: m_client_limit(client_limit)
-, m_blocking_timeout(blocking_timeout)
-, m_is_verbose(is_verbose)
+namespace
 {
-    m_endpoint.mode = EndpointMode::UNIX_DOMAIN;
-    m_endpoint.unix_socket_path = unix_socket_path;
+constexpr size_t MAXIMUM_PASSED_FILE_DESCRIPTORS = 253; // SCM_MAX_FD in the kernel
 
-    m_client_file_descriptors.reserve(m_client_limit);
-}
+// the client whose RxCallback the calling worker runs, which tells PostSend() a reply to that client from a send to another one
+thread_local const NonBlockingSocketServer* t_dispatching_server = nullptr;
+thread_local int t_dispatching_client_file_descriptor = -1;
 
-NonBlockingSocketServer::NonBlockingSocketServer(const TcpEndpoint& tcp_endpoint, size_t client_limit, std::chrono::milliseconds blocking_timeout, bool is_verbose)
-: m_client_limit(client_limit)
-, m_blocking_timeout(blocking_timeout)
-, m_is_verbose(is_verbose)
+template<typename T>
+void AppendValue(std::vector<char>& buffer, T value)
 {
-    m_endpoint.mode = EndpointMode::TCP;
-    m_endpoint.tcp_ip_address = tcp_endpoint.ip_address;
-    m_endpoint.tcp_port = tcp_endpoint.port;
-
-    m_client_file_descriptors.reserve(m_client_limit);
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
 }
 
-bool NonBlockingSocketServer::Start()
+template<typename T>
+bool ReadValue(std::span<const char> buffer, size_t& offset, T& value)
 {
-    // Remove the socket file if it already exists
-    if(m_endpoint.mode == EndpointMode::UNIX_DOMAIN)
+    if(buffer.size() - offset < sizeof(value))
     {
-        unlink(m_endpoint.unix_socket_path.c_str());
+        return false;
     }
 
-    if(not CreateSocket())
+    std::memcpy(&value, buffer.data() + offset, sizeof(value));
+    offset += sizeof(value);
+    return true;
+}
+
+/*
+    Arm a CLOCK_MONOTONIC timer file descriptor for an absolute deadline. steady_clock is CLOCK_MONOTONIC on Linux, so its time points can be used directly.
+*/
+bool ArmTimer(int timer_file_descriptor, std::chrono::steady_clock::time_point deadline)
+{
+    const auto deadline_since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch());
+
+    itimerspec timer_specification {};
+    timer_specification.it_value.tv_sec = deadline_since_epoch.count() / 1000000000;
+    timer_specification.it_value.tv_nsec = deadline_since_epoch.count() % 1000000000;
+
+    return timerfd_settime(timer_file_descriptor, TFD_TIMER_ABSTIME, &timer_specification, nullptr) == 0;
+}
+
+bool SetSocketTimeouts(int socket_file_descriptor, std::chrono::milliseconds timeout)
+{
+    const timeval socket_timeout{static_cast<time_t>(timeout.count() / 1000), static_cast<suseconds_t>(timeout.count() % 1000 * 1000)};
+
+    return setsockopt(socket_file_descriptor, SOL_SOCKET, SO_SNDTIMEO, &socket_timeout, sizeof(socket_timeout)) == 0
+        && setsockopt(socket_file_descriptor, SOL_SOCKET, SO_RCVTIMEO, &socket_timeout, sizeof(socket_timeout)) == 0;
+}
+
+/*
+    Send one message on a SOCK_SEQPACKET socket, with "file_descriptors" attached as SCM_RIGHTS.
+*/
+bool SendControlMessage(int socket_file_descriptor, const void* bytes, size_t size, std::span<const int> file_descriptors)
+{
+    alignas(cmsghdr) char control_buffer[CMSG_SPACE(sizeof(int) * MAXIMUM_PASSED_FILE_DESCRIPTORS)];
+    iovec io_vector{const_cast<void*>(bytes), size};
+    msghdr message {};
+    message.msg_iov = &io_vector;
+    message.msg_iovlen = 1;
+
+    if(not file_descriptors.empty())
     {
-        return false;
+        message.msg_control = control_buffer;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * file_descriptors.size());
+
+        cmsghdr* control_message = CMSG_FIRSTHDR(&message);
+        control_message->cmsg_level = SOL_SOCKET;
+        control_message->cmsg_type = SCM_RIGHTS;
+        control_message->cmsg_len = CMSG_LEN(sizeof(int) * file_descriptors.size());
+        std::memcpy(CMSG_DATA(control_message), file_descriptors.data(), sizeof(int) * file_descriptors.size());
     }
 
-    if(not BindToEndpoint())
+    ssize_t sent_bytes = -1;
+
+    while((sent_bytes = sendmsg(socket_file_descriptor, &message, MSG_NOSIGNAL)) == -1 && errno == EINTR)
     {
-        return false;
     }
 
-    if(not Listen())
+    return sent_bytes == static_cast<ssize_t>(size);
+}
+
+/*
+    Receive one message from a SOCK_SEQPACKET socket, appending the file descriptors that came with it. Returns the message size, or -1 if it did not fit.
+*/
+ssize_t ReceiveControlMessage(int socket_file_descriptor, void* bytes, size_t size, std::vector<int>& file_descriptors)
+{
+    alignas(cmsghdr) char control_buffer[CMSG_SPACE(sizeof(int) * MAXIMUM_PASSED_FILE_DESCRIPTORS)];
+    iovec io_vector{bytes, size};
+    msghdr message {};
+    message.msg_iov = &io_vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control_buffer;
+    message.msg_controllen = sizeof(control_buffer);
+
+    ssize_t received_bytes = -1;
+
+    while((received_bytes = recvmsg(socket_file_descriptor, &message, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR)
     {
-        return false;
     }
 
-    if(not MakeFileDescriptorNonBlocking(m_server_socket_file_descriptor))
+    if(received_bytes == -1)
     {
-        return false;
+        return -1;
     }
 
-    if(not ConfigureServerFileDescriptorForEpoll())
+    // collect the file descriptors even from a broken message, so that the caller can close them
+    for(cmsghdr* control_message = CMSG_FIRSTHDR(&message); control_message != nullptr; control_message = CMSG_NXTHDR(&message, control_message))
     {
-        return false;
+        if(control_message->cmsg_level == SOL_SOCKET && control_message->cmsg_type == SCM_RIGHTS)
+        {
+            const size_t file_descriptor_count = (control_message->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const size_t first_index = file_descriptors.size();
+            file_descriptors.resize(first_index + file_descriptor_count);
+            std::memcpy(file_descriptors.data() + first_index, CMSG_DATA(control_message), sizeof(int) * file_descriptor_count);
+        }
     }
 
-    m_server_state = ServerState::RUNNING;
-
-    Print("NonBlockingSocketServer::Start() -> Server has started!\n");
-    
-    return true;
+    return message.msg_flags & (MSG_TRUNC | MSG_CTRUNC) ? -1 : received_bytes;
+}
 }
 
-bool NonBlockingSocketServer::RequestStop()
+NonBlockingSocketServer::NonBlockingSocketServer(const std::string& unix_socket_path, size_t client_limit, std::chrono::milliseconds blocking_timeout, bool is_verbose, std::pmr::memory_resource* memory_resource, const SocketOptions& socket_options) 
+: NonBlockingSocketServer(std::vector<ListenerEndpoint>{UnixEndpoint{unix_socket_path}}, client_limit, blocking_timeout, is_verbose, memory_resource, socket_options)
 {
-    if(m_server_state!= ServerState::RUNNING)
-    {
-        return false;
-    }
-
-    m_server_state = ServerState::CLOSING;
-
-    return true;
 }
 
-NonBlockingSocketServer::ServerState NonBlockingSocketServer::GetServerState() const
+NonBlockingSocketServer::NonBlockingSocketServer(const TcpEndpoint& tcp_endpoint, size_t client_limit, std::chrono::milliseconds blocking_timeout, bool is_verbose, std::pmr::memory_resource* memory_resource, const SocketOptions& socket_options)
+: NonBlockingSocketServer(std::vector<ListenerEndpoint>{tcp_endpoint}, client_limit, blocking_timeout, is_verbose, memory_resource, socket_options)
 {
-    return m_server_state;
 }
 
-void NonBlockingSocketServer::EnqueueSend(int client_file_descriptor, const std::span<char>& bytes)
+NonBlockingSocketServer::NonBlockingSocketServer(const InheritedEndpoint& inherited_endpoint, size_t client_limit, std::chrono::milliseconds blocking_timeout, bool is_verbose, std::pmr::memory_resource* memory_resource, const SocketOptions& socket_options)
+: NonBlockingSocketServer(std::vector<ListenerEndpoint>{inherited_endpoint}, client_limit, blocking_timeout, is_verbose, memory_resource, socket_options)
 {
-    const std::vector<char> tx_bytes (bytes.begin(),bytes.end());
-    m_tx_messages.emplace_back(TxMessage{client_file_descriptor,tx_bytes});
 }
 
-void NonBlockingSocketServer::EnqueueBroadcast(const std::span<char>& bytes)
+NonBlockingSocketServer::NonBlockingSocketServer(const std::vector<ListenerEndpoint>& listener_endpoints, size_t client_limit, std::chrono::milliseconds blocking_timeout, bool is_verbose, std::pmr::memory_resource* memory_resource, const SocketOptions& socket_options)
+: m_client_limit(client_limit)
+, m_blocking_timeout(blocking_timeout)
+, m_socket_options(socket_options)
+, m_arena(&m_huge_page_arena)
+, m_memory_resource(memory_resource == nullptr ? &m_arena : memory_resource)
+, m_buffer_pool(READ_BUFFER_SIZE, m_memory_resource)
+, m_epoll_events(DEFAULT_EPOLL_EVENT_CAPACITY)
+, m_is_verbose(is_verbose)
 {
-    for(const int& client_file_descriptor : m_client_file_descriptors)
+    for(const ListenerEndpoint& listener_endpoint : listener_endpoints)
     {
-        EnqueueSend(client_file_descriptor,std::move(bytes));
+        Listener& listener = m_listeners.emplace_back(Listener{.endpoint = MakeEndpoint(listener_endpoint)});
+
+        // the kind of an inherited socket is only known once Start() has inspected it
+        if(const InheritedEndpoint* inherited_endpoint = std::get_if<InheritedEndpoint>(&listener_endpoint))
+        {
+            listener.file_descriptor = inherited_endpoint->file_descriptor;
+        }
     }
-}
 
-void NonBlockingSocketServer::SetRxCallback(RxCallback callback)
-{
-    m_rx_callback = std::move(callback);
+    m_client_file_descriptors.reserve(m_client_limit);
 }
 
-void NonBlockingSocketServer::SetConnectCallback(ConnectCallback callback)
+NonBlockingSocketServer::~NonBlockingSocketServer()
 {
-    m_connect_callback = std::move(callback);
-}
+    // stop the workers first, because their tasks refer back to this server
+    m_worker_pool.reset();
 
-void NonBlockingSocketServer::SetDisconnectCallback(DisconnectCallback callback)
-{
-    m_disconnect_callback = std::move(callback);
+    for(PostedMessage* posted_message = m_posted_messages.exchange(nullptr); posted_message != nullptr;)
+    {
+        PostedMessage* next = posted_message->next;
+        delete posted_message;
+        posted_message = next;
+    }
+
+    // a handed over client that was never registered is still owned by this server
+    for(AdoptedClient* adopted_client = m_adopted_clients.exchange(nullptr); adopted_client != nullptr;)
+    {
+        AdoptedClient* next = adopted_client->next;
+        close(adopted_client->client_file_descriptor);
+        delete adopted_client;
+        adopted_client = next;
+    }
+
+    for(char* rx_batch_buffer : m_rx_batch_buffers)
+    {
+        m_buffer_pool.Release(rx_batch_buffer);
+    }
+
+    // queued messages belong to the memory resource, which may be caller supplied, so hand them back explicitly
+    for(const int& client_file_descriptor : m_client_file_descriptors)
+    {
+        ClearTxMessages(m_connections[client_file_descriptor]);
+    }
 }
 
-const std::vector<int> &NonBlockingSocketServer::GetClientFileDescriptors() const
+std::vector<NonBlockingSocketServer::ListenerEndpoint> NonBlockingSocketServer::GetSocketActivationEndpoints()
 {
-    return m_client_file_descriptors;
+    std::vector<ListenerEndpoint> listener_endpoints;
+    const char* listen_pid = getenv("LISTEN_PID");
+    const char* listen_fds = getenv("LISTEN_FDS");
+
+    if(listen_pid != nullptr && listen_fds != nullptr && std::strtol(listen_pid, nullptr, 10) == getpid())
+    {
+        const long file_descriptor_count = std::strtol(listen_fds, nullptr, 10);
+
+        for(int file_descriptor = SOCKET_ACTIVATION_FIRST_FILE_DESCRIPTOR; file_descriptor < SOCKET_ACTIVATION_FIRST_FILE_DESCRIPTOR + file_descriptor_count; ++file_descriptor)
+        {
+            // passed sockets are inherited without close-on-exec, which would leak them into every process this one starts
+            fcntl(file_descriptor, F_SETFD, FD_CLOEXEC);
+            listener_endpoints.emplace_back(InheritedEndpoint{file_descriptor});
+        }
+
+        // the variables are only consumed when they were meant for this process, otherwise they are left for the process they name
+        unsetenv("LISTEN_PID");
+        unsetenv("LISTEN_FDS");
+        unsetenv("LISTEN_FDNAMES");
+    }
+
+    return listener_endpoints;
 }
 
-bool NonBlockingSocketServer::CreateSocket()
+bool NonBlockingSocketServer::Start()
 {
-    // Create a socket
+    if(m_listeners.empty())
+    {
+        Print("NonBlockingSocketServer::Start() -> No endpoints to listen on.\n");
+        return false;
+    }
 
-    int server_socket_fd = -1;
+    // every listener and every client shares this one epoll instance
+    m_server_epoll_file_descriptor = epoll_create1(0);
 
-    switch (m_endpoint.mode)
-    {
-    case EndpointMode::TCP:
+    if(m_server_epoll_file_descriptor == -1)
     {
-        server_socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-        break;
+        perror("NonBlockingSocketServer::Start() -> Failed to create epoll instance");
+        return false;
     }
-    case EndpointMode::UNIX_DOMAIN:
+
+    for(Listener& listener : m_listeners)
     {
-        server_socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-        break;
-    }
-    default:
-        break;
+        if(not StartListener(listener))
+        {
+            CloseListeners();
+            close(m_server_epoll_file_descriptor);
+            m_server_epoll_file_descriptor = -1;
+            return false;
+        }
     }
 
-    if (server_socket_fd == -1) 
+    // other threads wake the reactor through this file descriptor when they post messages or hand over clients
+    m_wakeup_file_descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if(m_wakeup_file_descriptor == -1 || not ConfigureServerFileDescriptorForEpoll(m_wakeup_file_descriptor))
     {
-        perror("NonBlockingSocketServer::CreateSocket() -> Socket creation failed");
+        perror("NonBlockingSocketServer::Start() -> Failed to create the wakeup file descriptor");
+        CloseListeners();
+        close(m_wakeup_file_descriptor);
+        close(m_server_epoll_file_descriptor);
+        m_wakeup_file_descriptor = -1;
+        m_server_epoll_file_descriptor = -1;
         return false;
     }
 
-    m_server_socket_file_descriptor = server_socket_fd;
-    return true;
-}
-
-bool NonBlockingSocketServer::BindToEndpoint()
-{
-    bool result = false;
-
-    switch (m_endpoint.mode)
+    // held payloads have to be flushed on time even when nothing else happens, so their deadline is a timer that epoll watches
+    if(m_tx_flush_delay.count() > 0)
     {
-        case EndpointMode::UNIX_DOMAIN:
+        m_tx_flush_timer_file_descriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+        if(m_tx_flush_timer_file_descriptor == -1 || not ConfigureServerFileDescriptorForEpoll(m_tx_flush_timer_file_descriptor))
         {
-            result = BindToUnixDomainSocket();
-            break;
+            perror("NonBlockingSocketServer::Start() -> Failed to create the tx flush timer");
+            CloseListeners();
+            close(m_tx_flush_timer_file_descriptor);
+            close(m_wakeup_file_descriptor);
+            close(m_server_epoll_file_descriptor);
+            m_tx_flush_timer_file_descriptor = -1;
+            m_wakeup_file_descriptor = -1;
+            m_server_epoll_file_descriptor = -1;
+            return false;
         }
-        case EndpointMode::TCP:
+    }
+
+    // paused clients and listeners have to resume on time even when nothing else happens, so their resume time is a timer as well
+    if(m_is_rx_rate_limited || m_accept_limit.rate > 0)
+    {
+        m_rate_limit_timer_file_descriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+        if(m_rate_limit_timer_file_descriptor == -1 || not ConfigureServerFileDescriptorForEpoll(m_rate_limit_timer_file_descriptor))
         {
-            result = BindToTcpSocket();
-            break;
+            perror("NonBlockingSocketServer::Start() -> Failed to create the rate limit timer");
+            CloseListeners();
+            close(m_rate_limit_timer_file_descriptor);
+            close(m_tx_flush_timer_file_descriptor);
+            close(m_wakeup_file_descriptor);
+            close(m_server_epoll_file_descriptor);
+            m_rate_limit_timer_file_descriptor = -1;
+            m_tx_flush_timer_file_descriptor = -1;
+            m_wakeup_file_descriptor = -1;
+            m_server_epoll_file_descriptor = -1;
+            return false;
         }
-        default:
+
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+        for(Listener& listener : m_listeners)
         {
-            result = false;
-            break;
+            listener.accept_bucket = TokenBucket{m_accept_limit.burst, now};
         }
     }
 
-    return result;
+    m_is_cpu_affinity_pending = m_cpu_affinity >= 0;
+    m_is_perf_counters_pending = m_is_perf_counters_enabled;
+
+    // with a CPU affinity the first Run() faults the arena in from the pinned thread instead
+    if(not m_is_cpu_affinity_pending && m_huge_page_arena.GetCapacity() != 0)
+    {
+        m_huge_page_arena.Prefault();
+        m_buffer_pool.Reserve(PREFAULTED_READ_BUFFER_COUNT);
+    }
+
+    m_server_state = ServerState::RUNNING;
+
+    Print("NonBlockingSocketServer::Start() -> Server has started!\n");
+    
+    return true;
 }
 
-bool NonBlockingSocketServer::BindToUnixDomainSocket()
+bool NonBlockingSocketServer::RequestStop()
 {
-    // Bind the socket to the specified Unix domain endpoint
+    if(m_server_state!= ServerState::RUNNING)
+    {
+        return false;
+    }
 
-    Print("NonBlockingSocketServer::BindToUnixDomainSocket() -> Binding to {" + m_endpoint.unix_socket_path + "}\n");
+    m_server_state = ServerState::CLOSING;
 
-    sockaddr_un address{};
-    address.sun_family = AF_UNIX;
-    strncpy(address.sun_path, m_endpoint.unix_socket_path.c_str(), sizeof(address.sun_path) - 1);
+    return true;
+}
 
-    return Bind(reinterpret_cast<sockaddr*>(&address), sizeof(address));
+NonBlockingSocketServer::ServerState NonBlockingSocketServer::GetServerState() const
+{
+    return m_server_state;
 }
 
-bool NonBlockingSocketServer::BindToTcpSocket()
+bool NonBlockingSocketServer::HandOver(const std::string& control_socket_path, std::chrono::milliseconds timeout)
 {
-    // Bind the socket to the specified TCP endpoint
+    if(m_server_state != ServerState::RUNNING)
+    {
+        return false;
+    }
+
+    for(const int& client_file_descriptor : m_client_file_descriptors)
+    {
+        const Connection& connection = m_connections[client_file_descriptor];
 
-    Print("NonBlockingSocketServer::BindToTcpSocket() -> Binding to {" + m_endpoint.tcp_ip_address + ":" + std::to_string(m_endpoint.tcp_port) + "}\n");
+        // the bytes of a shared memory client sit in a mapping that the successor could not tell apart from a fresh one
+        if(connection.shared_memory != nullptr)
+        {
+            Print("NonBlockingSocketServer::HandOver() -> Shared memory clients cannot be handed over.\n");
+            return false;
+        }
 
-    sockaddr_in address{};
-    address.sin_family = AF_INET;
-    address.sin_port = htons(m_endpoint.tcp_port);
+        // only this process can complete its requests, and the successor would read the stream from the middle of a frame
+        if(not connection.rpc_in_flight_request_ids.empty() || not connection.rpc_rx_bytes.empty())
+        {
+            Print("NonBlockingSocketServer::HandOver() -> RPC client with file descriptor: {" + std::to_string(client_file_descriptor) + "} has requests in flight or a partial frame.\n");
+            return false;
+        }
+    }
 
-    in_addr_t ip_address = inet_addr(m_endpoint.tcp_ip_address.c_str());
+    // settle everything that is in flight, so that the queues are all the state there is left to hand over
+    DeliverRxBatch();
+    ProcessAdoptedClients();
+    ProcessPostedMessages();
 
-    if (ip_address == INADDR_NONE) 
+    const int control_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+    if(control_fd == -1 || not SetSocketTimeouts(control_fd, timeout))
     {
-        Print("NonBlockingSocketServer::BindToTcpSocket() -> Invalid IP address: {" + m_endpoint.tcp_ip_address + "}\n");
+        perror("NonBlockingSocketServer::HandOver() -> Failed to create the control socket");
+        close(control_fd);
         return false;
     }
 
-    address.sin_addr.s_addr = INADDR_ANY;//ip_address;
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, control_socket_path.c_str(), sizeof(address.sun_path) - 1);
 
-    return Bind(reinterpret_cast<sockaddr*>(&address), sizeof(address));
-}
+    // the successor may still be starting up, so keep trying until it listens
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    int connect_result = -1;
 
-bool NonBlockingSocketServer::Bind(const sockaddr* address, socklen_t size)
-{
-    if (bind(m_server_socket_file_descriptor, address, size) == -1) 
+    while((connect_result = connect(control_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address))) == -1
+        && (errno == ENOENT || errno == ECONNREFUSED || errno == EINTR) && std::chrono::steady_clock::now() < deadline)
     {
-        perror("NonBlockingSocketServer::Bind() -> Bind failed");
-        close(m_server_socket_file_descriptor);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // nothing is released before the successor confirms, so a failure leaves this server exactly as it was
+    char acknowledgement = 0;
+
+    if(connect_result == -1 || not SendHandOver(control_fd, SerializeHandOverState()) || recv(control_fd, &acknowledgement, sizeof(acknowledgement), 0) != sizeof(acknowledgement))
+    {
+        perror("NonBlockingSocketServer::HandOver() -> Failed to hand over to the successor");
+        close(control_fd);
         return false;
     }
 
+    close(control_fd);
+
+    // the successor holds its own references now, so closing ours neither resets nor finishes the connections
+    for(const int& client_file_descriptor : m_client_file_descriptors)
+    {
+        epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_DEL, client_file_descriptor, nullptr);
+        close(client_file_descriptor);
+        m_topic_subscriptions.RemoveClient(client_file_descriptor);
+        ClearTxMessages(m_connections[client_file_descriptor]);
+        m_connections[client_file_descriptor] = Connection{};
+    }
+
+    Print("NonBlockingSocketServer::HandOver() -> Handed over " + std::to_string(m_client_file_descriptors.size()) + " clients to the successor.\n");
+
+    m_client_file_descriptors.clear();
+    CloseServer();
+
     return true;
 }
 
-bool NonBlockingSocketServer::Listen()
+bool NonBlockingSocketServer::Resume(const std::string& control_socket_path, std::chrono::milliseconds timeout)
 {
-     // Start listening for incoming connections
-    if (listen(m_server_socket_file_descriptor, m_client_limit) == -1) 
+    if(m_server_state != ServerState::CLOSED)
     {
-        perror("NonBlockingSocketServer::Start() -> Listen failed");
-        close(m_server_socket_file_descriptor);
         return false;
     }
 
-    return true;
-}
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, control_socket_path.c_str(), sizeof(address.sun_path) - 1);
+    unlink(control_socket_path.c_str());
 
-bool NonBlockingSocketServer::AcceptClient()
-{
-    if(m_client_file_descriptors.size() == m_client_limit)
+    const int control_listener_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+    if(control_listener_fd == -1 || bind(control_listener_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 || listen(control_listener_fd, 1) == -1)
     {
-        Print("NonBlockingSocketServer::AcceptClient() -> Rejected client connection due to connection limit.\n");
+        perror("NonBlockingSocketServer::Resume() -> Failed to open the control socket");
+        close(control_listener_fd);
         return false;
     }
 
-    const int client_fd = accept(m_server_socket_file_descriptor, nullptr, nullptr);
+    pollfd poll_file_descriptor{control_listener_fd, POLLIN, 0};
+    const int control_fd = poll(&poll_file_descriptor, 1, timeout.count()) == 1 ? accept4(control_listener_fd, nullptr, nullptr, SOCK_CLOEXEC) : -1;
 
-    if(client_fd == -1)
+    close(control_listener_fd);
+    unlink(control_socket_path.c_str());
+
+    if(control_fd == -1)
     {
-        perror("NonBlockingSocketServer::AcceptClient() -> Failed to accept client");
+        Print("NonBlockingSocketServer::Resume() -> No predecessor handed over in time.\n");
         return false;
     }
 
-    if(not MakeFileDescriptorNonBlocking(client_fd))
+    std::vector<int> file_descriptors;
+    std::vector<char> state;
+
+    if(not SetSocketTimeouts(control_fd, timeout) || not ReceiveHandOver(control_fd, file_descriptors, state))
     {
+        Print("NonBlockingSocketServer::Resume() -> Failed to receive the handover.\n");
+
+        for(const int& file_descriptor : file_descriptors)
+        {
+            close(file_descriptor);
+        }
+
+        close(control_fd);
         return false;
     }
 
-    // configure the accepted client file descriptor with epoll events
+    // Start() registers listeners that already have a socket as they are, instead of binding new ones
+    for(size_t listener_index = 0; listener_index < m_listeners.size(); ++listener_index)
+    {
+        m_listeners[listener_index].file_descriptor = file_descriptors[listener_index];
+    }
 
-    epoll_event client_ev{};
-    client_ev.events = EPOLLIN | EPOLLET;
-    client_ev.data.fd = client_fd;
-    const bool epoll_ctl_result = epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_ADD, client_fd, &client_ev) == 0;
-    
-    if(not epoll_ctl_result)
+    const std::vector<int> client_file_descriptors(file_descriptors.begin() + m_listeners.size(), file_descriptors.end());
+
+    if(not Start())
     {
-        perror("NonBlockingSocketServer::AcceptClient() -> Failed to confugure client file descriptor for epoll events");
+        for(const int& client_file_descriptor : client_file_descriptors)
+        {
+            close(client_file_descriptor);
+        }
+
+        close(control_fd);
+        return false;
     }
 
-    // save the client file descriptor, because the client has been accepted
-    m_client_file_descriptors.emplace_back(client_fd);
+    // without the acknowledgement the predecessor keeps serving, so closing the copies here does not cost any client its connection
+    const char acknowledgement = 1;
 
-    Print("NonBlockingSocketServer::AcceptClient() -> Accepted client connection with file descriptor: {" + std::to_string(client_fd) + "}\n");
+    if(not RestoreHandOverState(client_file_descriptors, state) || send(control_fd, &acknowledgement, sizeof(acknowledgement), MSG_NOSIGNAL) != sizeof(acknowledgement))
+    {
+        Print("NonBlockingSocketServer::Resume() -> Failed to restore the handed over clients.\n");
+
+        // RestoreHandOverState() has closed every client it did not register, and the server closes the rest
+        CloseServer();
+        close(control_fd);
+        return false;
+    }
 
-    m_connect_callback(client_fd);
+    close(control_fd);
 
-    return epoll_ctl_result;
+    Print("NonBlockingSocketServer::Resume() -> Resumed " + std::to_string(client_file_descriptors.size()) + " clients from the predecessor.\n");
+
+    return true;
 }
 
-bool NonBlockingSocketServer::MakeFileDescriptorNonBlocking(int file_descriptor)
+void NonBlockingSocketServer::EnableWorkerDispatch(size_t worker_count)
 {
-    const bool result = fcntl(file_descriptor, F_SETFL, O_NONBLOCK) != -1;
-
-    if(not result)
+    if(m_server_state != ServerState::CLOSED)
     {
-        perror("UnixSocketServer::MakeFileDescriptorNonBlocking() -> Failed to make file descriptor non-blocking");
+        Print("NonBlockingSocketServer::EnableWorkerDispatch() -> Worker dispatch must be enabled before the server starts.\n");
+        return;
     }
 
-    return result;
+    m_worker_pool = std::make_unique<WorkerPool>(worker_count);
 }
 
-bool NonBlockingSocketServer::ConfigureServerFileDescriptorForEpoll()
+void NonBlockingSocketServer::PostSend(int client_file_descriptor, std::vector<char> bytes, TxPriority priority)
 {
-    m_server_epoll_file_descriptor = epoll_create1(0);
-    // define epoll event conditions for the server socket file descriptor
-    epoll_event server_epoll_events{}, events[MAXIMUM_EPOLL_EVENTS];
-    server_epoll_events.events = EPOLLIN;
-    server_epoll_events.data.fd = m_server_socket_file_descriptor;
-    // applu the epoll event conditions to the server socket file descriptor
-    const bool epoll_ctl_result = epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_ADD, m_server_socket_file_descriptor, &server_epoll_events) == 0;
+    PostedMessage* posted_message = new PostedMessage{nullptr, client_file_descriptor, priority, nullptr, std::move(bytes)};
 
-    if(not epoll_ctl_result)
+    // a reply from the client's own strand remembers the strand, which tells the reactor whether the client is still the same one; sends to other clients carry none
+    Strand* current_strand = Strand::GetCurrent();
+
+    if(current_strand != nullptr && t_dispatching_server == this && t_dispatching_client_file_descriptor == client_file_descriptor)
     {
-        perror("UnixSocketServer::ConfigureServerFileDescriptorForEpoll() -> Failed to configure epoll for file descriptor");
+        posted_message->strand = current_strand->shared_from_this();
     }
 
-    return epoll_ctl_result;
-}
+    PostedMessage* head = m_posted_messages.load(std::memory_order_relaxed);
 
-bool NonBlockingSocketServer::ConfigureClientFileDescriptorForEpoll(int client_file_descriptor)
-{
-    epoll_event client_epoll_events{};
-    client_epoll_events.events = EPOLLIN | EPOLLET;
-    client_epoll_events.data.fd = client_file_descriptor;
-    const bool epoll_ctl_result = epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_ADD, client_file_descriptor, &client_epoll_events) == 0;
-    
-    if(not epoll_ctl_result)
+    do
     {
-        perror("UnixSocketServer::Accept() -> Failed to confugure client file descriptor for epoll events");
+        posted_message->next = head;
     }
+    while(not m_posted_messages.compare_exchange_weak(head, posted_message, std::memory_order_release, std::memory_order_relaxed));
 
-    return epoll_ctl_result;
+    // only the first message of a batch needs to wake the reactor
+    if(head == nullptr)
+    {
+        WakeUp();
+    }
+}
+
+void NonBlockingSocketServer::SetCpuAffinity(int cpu)
+{
+    if(m_server_state != ServerState::CLOSED)
+    {
+        Print("NonBlockingSocketServer::SetCpuAffinity() -> The CPU affinity must be set before the server starts.\n");
+        return;
+    }
+
+    m_cpu_affinity = cpu;
+}
+
+bool NonBlockingSocketServer::SetHugePageArena(size_t arena_size)
+{
+    if(m_server_state != ServerState::CLOSED)
+    {
+        Print("NonBlockingSocketServer::SetHugePageArena() -> The huge page arena must be set before the server starts.\n");
+        return false;
+    }
+
+    if(m_memory_resource != &m_arena)
+    {
+        Print("NonBlockingSocketServer::SetHugePageArena() -> The server uses a caller supplied memory resource.\n");
+        return false;
+    }
+
+    if(not m_huge_page_arena.Map(arena_size))
+    {
+        return false;
+    }
+
+    Print("NonBlockingSocketServer::SetHugePageArena() -> Mapped {" + std::to_string(m_huge_page_arena.GetCapacity()) + "} bytes in page mode {" + std::to_string(static_cast<int>(m_huge_page_arena.GetPageMode())) + "}\n");
+
+    return true;
+}
+
+HugePageArena::PageMode NonBlockingSocketServer::GetHugePageMode() const
+{
+    return m_huge_page_arena.GetPageMode();
+}
+
+void NonBlockingSocketServer::EnablePerfCounters()
+{
+    if(m_server_state != ServerState::CLOSED)
+    {
+        Print("NonBlockingSocketServer::EnablePerfCounters() -> Perf counters must be enabled before the server starts.\n");
+        return;
+    }
+
+    m_is_perf_counters_enabled = true;
+}
+
+bool NonBlockingSocketServer::HasPerfCounters() const
+{
+    return m_perf_counters.IsOpen();
+}
+
+void NonBlockingSocketServer::AdoptClient(int client_file_descriptor, size_t listener_index)
+{
+    AdoptedClient* adopted_client = new AdoptedClient{nullptr, client_file_descriptor, listener_index};
+    AdoptedClient* head = m_adopted_clients.load(std::memory_order_relaxed);
+
+    do
+    {
+        adopted_client->next = head;
+    }
+    while(not m_adopted_clients.compare_exchange_weak(head, adopted_client, std::memory_order_release, std::memory_order_relaxed));
+
+    if(head == nullptr)
+    {
+        WakeUp();
+    }
+}
+
+void NonBlockingSocketServer::SetSteeringCallback(SteeringCallback callback)
+{
+    m_steering_callback = std::move(callback);
+}
+
+void NonBlockingSocketServer::SetReadBudget(size_t byte_budget, size_t read_budget)
+{
+    m_read_byte_budget = byte_budget;
+    m_read_call_budget = read_budget;
+}
+
+void NonBlockingSocketServer::SetRxRateLimit(const RateLimit& byte_limit, const RateLimit& read_limit)
+{
+    if(m_server_state != ServerState::CLOSED)
+    {
+        Print("NonBlockingSocketServer::SetRxRateLimit() -> Rate limits must be configured before the server starts.\n");
+        return;
+    }
+
+    // a bucket that cannot hold a single token would never let the client through
+    m_rx_byte_limit = RateLimit{byte_limit.rate, std::max(byte_limit.burst, 1.0)};
+    m_rx_read_limit = RateLimit{read_limit.rate, std::max(read_limit.burst, 1.0)};
+    m_is_rx_rate_limited = m_rx_byte_limit.rate > 0 || m_rx_read_limit.rate > 0;
+}
+
+void NonBlockingSocketServer::SetAcceptRateLimit(const RateLimit& accept_limit)
+{
+    if(m_server_state != ServerState::CLOSED)
+    {
+        Print("NonBlockingSocketServer::SetAcceptRateLimit() -> Rate limits must be configured before the server starts.\n");
+        return;
+    }
+
+    m_accept_limit = RateLimit{accept_limit.rate, std::max(accept_limit.burst, 1.0)};
+}
+
+void NonBlockingSocketServer::SetTxCoalescing(size_t threshold_bytes, std::chrono::microseconds flush_delay)
+{
+    if(m_server_state != ServerState::CLOSED)
+    {
+        Print("NonBlockingSocketServer::SetTxCoalescing() -> Coalescing must be configured before the server starts.\n");
+        return;
+    }
+
+    // the block capacity is stored in 32 bits
+    m_tx_coalescing_threshold = std::min<size_t>(threshold_bytes, UINT32_MAX);
+    m_tx_flush_delay = m_tx_coalescing_threshold == 0 ? std::chrono::microseconds(0) : flush_delay;
+}
+
+int NonBlockingSocketServer::GetIncomingCpu(int client_file_descriptor) const
+{
+    int incoming_cpu = -1;
+    socklen_t incoming_cpu_size = sizeof(incoming_cpu);
+
+    if(getsockopt(client_file_descriptor, SOL_SOCKET, SO_INCOMING_CPU, &incoming_cpu, &incoming_cpu_size) == -1)
+    {
+        return -1;
+    }
+
+    return incoming_cpu;
+}
+
+void NonBlockingSocketServer::EnqueueSend(int client_file_descriptor, const std::span<char>& bytes, TxPriority priority)
+{
+    Connection* connection = FindConnection(client_file_descriptor);
+
+    // drop payloads for clients that are not connected, there is nobody to deliver them to
+    if(connection == nullptr)
+    {
+        return;
+    }
+
+    PushTxMessage(*connection, bytes, priority);
+    ScheduleTx(*connection);
+}
+
+void NonBlockingSocketServer::EnqueueSendv(int client_file_descriptor, std::span<TxFragment> fragments, TxPriority priority)
+{
+    Connection* connection = FindConnection(client_file_descriptor);
+
+    if(connection == nullptr)
+    {
+        return;
+    }
+
+    size_t fragment_index = 0;
+
+    while(fragment_index < fragments.size())
+    {
+        if(std::vector<char>* owned_bytes = std::get_if<std::vector<char>>(&fragments[fragment_index]))
+        {
+            if(not owned_bytes->empty())
+            {
+                PushOwnedTxMessage(*connection, std::move(*owned_bytes), priority);
+            }
+
+            ++fragment_index;
+            continue;
+        }
+
+        // a run of borrowed fragments has to be copied anyway, so copy it into one block and save the kernel an io vector per fragment
+        const size_t run_begin = fragment_index;
+        size_t run_size = 0;
+
+        for(; fragment_index < fragments.size() && std::holds_alternative<std::span<const char>>(fragments[fragment_index]); ++fragment_index)
+        {
+            run_size += std::get<std::span<const char>>(fragments[fragment_index]).size();
+        }
+
+        if(run_size == 0)
+        {
+            continue;
+        }
+
+        char* destination = AppendTxBytes(*connection, run_size, priority);
+
+        for(size_t index = run_begin; index < fragment_index; ++index)
+        {
+            const std::span<const char> bytes = std::get<std::span<const char>>(fragments[index]);
+            std::memcpy(destination, bytes.data(), bytes.size());
+            destination += bytes.size();
+        }
+    }
+
+    ScheduleTx(*connection);
+}
+
+void NonBlockingSocketServer::EnqueueBroadcast(const std::span<char>& bytes, TxPriority priority)
+{
+    FanOut(m_client_file_descriptors, bytes, priority);
+}
+
+void NonBlockingSocketServer::SetTxStarvationGuard(size_t message_count)
+{
+    m_tx_starvation_guard = message_count;
+}
+
+bool NonBlockingSocketServer::Subscribe(int client_file_descriptor, const Topic& topic)
+{
+    if(FindConnection(client_file_descriptor) == nullptr)
+    {
+        return false;
+    }
+
+    return m_topic_subscriptions.Subscribe(client_file_descriptor, topic);
+}
+
+bool NonBlockingSocketServer::Unsubscribe(int client_file_descriptor, const Topic& topic)
+{
+    return m_topic_subscriptions.Unsubscribe(client_file_descriptor, topic);
+}
+
+size_t NonBlockingSocketServer::Publish(const Topic& topic, std::span<const char> bytes, TxPriority priority)
+{
+    return FanOut(m_topic_subscriptions.GetSubscribers(topic), bytes, priority);
+}
+
+size_t NonBlockingSocketServer::GetSubscriberCount(const Topic& topic) const
+{
+    return m_topic_subscriptions.GetSubscribers(topic).size();
+}
+
+void NonBlockingSocketServer::SetRxCallback(RxCallback callback)
+{
+    m_rx_callback = [callback = std::move(callback)](ConnectionRef connection, const std::span<char>& bytes, std::chrono::nanoseconds rx_queue_delay)
+    {
+        (void)rx_queue_delay;
+        callback(connection, bytes);
+    };
+}
+
+void NonBlockingSocketServer::SetRxCallback(TimestampedRxCallback callback)
+{
+    m_rx_callback = std::move(callback);
+}
+
+void NonBlockingSocketServer::SetConnectCallback(ConnectCallback callback)
+{
+    m_connect_callback = [callback = std::move(callback)](ConnectionRef connection, size_t listener_index)
+    {
+        (void)listener_index;
+        callback(connection);
+    };
+}
+
+void NonBlockingSocketServer::SetConnectCallback(ListenerConnectCallback callback)
+{
+    m_connect_callback = std::move(callback);
+}
+
+void NonBlockingSocketServer::SetDisconnectCallback(DisconnectCallback callback)
+{
+    m_disconnect_callback = std::move(callback);
+}
+
+void NonBlockingSocketServer::SetDatagramCallback(DatagramCallback callback)
+{
+    m_datagram_callback = std::move(callback);
+}
+
+bool NonBlockingSocketServer::EnqueueDatagram(size_t listener_index, const DatagramPeer& peer, std::span<const char> bytes)
+{
+    if(listener_index >= m_listeners.size() || m_listeners[listener_index].datagram_state == nullptr || bytes.size() > MAXIMUM_DATAGRAM_SIZE)
+    {
+        return false;
+    }
+
+    DatagramState& datagram_state = *m_listeners[listener_index].datagram_state;
+    datagram_state.tx_datagrams.emplace_back(OutboundDatagram{peer, datagram_state.tx_bytes.size(), bytes.size()});
+    datagram_state.tx_bytes.insert(datagram_state.tx_bytes.end(), bytes.begin(), bytes.end());
+
+    return true;
+}
+
+void NonBlockingSocketServer::SetRxBatchCallback(RxBatchCallback callback)
+{
+    m_rx_batch_callback = std::move(callback);
+}
+
+void NonBlockingSocketServer::SetRpcHandler(RpcHandler handler, size_t in_flight_limit)
+{
+    if(m_server_state != ServerState::CLOSED)
+    {
+        Print("NonBlockingSocketServer::SetRpcHandler() -> The RPC handler must be set before the server starts.\n");
+        return;
+    }
+
+    m_rpc_handler = std::move(handler);
+    m_rpc_in_flight_limit = std::max<size_t>(in_flight_limit, 1);
+}
+
+bool NonBlockingSocketServer::CompleteRpcRequest(const RpcRequest& request, std::span<const char> response, TxPriority priority)
+{
+    Connection* connection = FindConnection(request.client_file_descriptor);
+
+    if(connection == nullptr || connection->rpc_connection_id != request.connection_id || response.size() > MAXIMUM_RPC_PAYLOAD_SIZE)
+    {
+        return false;
+    }
+
+    std::vector<uint64_t>& in_flight_request_ids = connection->rpc_in_flight_request_ids;
+    const auto request_it = std::find(in_flight_request_ids.begin(), in_flight_request_ids.end(), request.request_id);
+
+    if(request_it == in_flight_request_ids.end())
+    {
+        return false;
+    }
+
+    // the in-flight list has no order to keep, so the last request fills the gap
+    *request_it = in_flight_request_ids.back();
+    in_flight_request_ids.pop_back();
+
+    // header and response are written into one tx block, which joins the coalescing block of earlier responses when tx coalescing is on
+    const RpcFrameHeader header {static_cast<uint32_t>(response.size()), 0, request.request_id};
+    char* destination = AppendTxBytes(*connection, sizeof(header) + response.size(), priority);
+    std::memcpy(destination, &header, sizeof(header));
+    std::memcpy(destination + sizeof(header), response.data(), response.size());
+    ScheduleTx(*connection);
+
+    // edge-triggered epoll does not report bytes that were already there when the client was paused, so the ready list has to remember them
+    if(connection->is_rpc_paused)
+    {
+        connection->is_rpc_paused = false;
+
+        if(not connection->is_rx_ready)
+        {
+            connection->is_rx_ready = true;
+            m_rx_ready_file_descriptors.emplace_back(request.client_file_descriptor);
+            SignalQueuedWork();
+        }
+    }
+
+    return true;
+}
+
+size_t NonBlockingSocketServer::GetRpcInFlightCount(int client_file_descriptor) const
+{
+    if(client_file_descriptor < 0 || static_cast<size_t>(client_file_descriptor) >= m_connections.size() || m_connections[client_file_descriptor].file_descriptor != client_file_descriptor)
+    {
+        return 0;
+    }
+
+    return m_connections[client_file_descriptor].rpc_in_flight_request_ids.size();
+}
+
+void NonBlockingSocketServer::SetBatchEndCallback(BatchEndCallback callback)
+{
+    m_batch_end_callback = std::move(callback);
+}
+
+void NonBlockingSocketServer::SetEpollEventCapacity(size_t event_capacity)
+{
+    m_epoll_events.resize(std::max<size_t>(event_capacity, 1));
+}
+
+const std::vector<int> &NonBlockingSocketServer::GetClientFileDescriptors() const
+{
+    return m_client_file_descriptors;
+}
+
+bool NonBlockingSocketServer::StartCapture(const std::string& capture_file_path)
+{
+    auto traffic_recorder = std::make_unique<TrafficRecorder>();
+
+    if(not traffic_recorder->Open(capture_file_path))
+    {
+        return false;
+    }
+
+    m_traffic_recorder = std::move(traffic_recorder);
+
+    // clients that are already connected get an accept record, so that the replay knows about them
+    for(const int& client_file_descriptor : m_client_file_descriptors)
+    {
+        m_traffic_recorder->Record(TrafficEventType::ACCEPT, client_file_descriptor);
+    }
+
+    return true;
+}
+
+void NonBlockingSocketServer::StopCapture()
+{
+    m_traffic_recorder.reset();
+}
+
+size_t NonBlockingSocketServer::GetListenerIndex(int client_file_descriptor) const
+{
+    if(client_file_descriptor < 0 || static_cast<size_t>(client_file_descriptor) >= m_connections.size() || m_connections[client_file_descriptor].file_descriptor != client_file_descriptor)
+    {
+        return m_listeners.size();
+    }
+
+    return m_connections[client_file_descriptor].listener_index;
+}
+
+size_t NonBlockingSocketServer::GetListenerCount() const
+{
+    return m_listeners.size();
+}
+
+bool NonBlockingSocketServer::SetUserContext(int client_file_descriptor, void* user_context)
+{
+    Connection* connection = FindConnection(client_file_descriptor);
+
+    if(connection == nullptr)
+    {
+        return false;
+    }
+
+    connection->user_context = user_context;
+
+    return true;
+}
+
+void* NonBlockingSocketServer::GetUserContext(int client_file_descriptor) const
+{
+    if(client_file_descriptor < 0 || static_cast<size_t>(client_file_descriptor) >= m_connections.size() || m_connections[client_file_descriptor].file_descriptor != client_file_descriptor)
+    {
+        return nullptr;
+    }
+
+    return m_connections[client_file_descriptor].user_context;
+}
+
+void NonBlockingSocketServer::SetIdleReclamation(std::chrono::milliseconds idle_period)
+{
+    m_idle_reclamation_period = idle_period;
+    m_next_reclamation_time = std::chrono::steady_clock::now() + idle_period;
+}
+
+void NonBlockingSocketServer::SetMemoryBudget(size_t budget_bytes)
+{
+    m_memory_budget = budget_bytes;
+}
+
+size_t NonBlockingSocketServer::GetTxHighWaterBytes(int client_file_descriptor) const
+{
+    if(client_file_descriptor < 0 || static_cast<size_t>(client_file_descriptor) >= m_connections.size() || m_connections[client_file_descriptor].file_descriptor != client_file_descriptor)
+    {
+        return 0;
+    }
+
+    return m_connections[client_file_descriptor].tx_high_water_bytes;
+}
+
+NonBlockingSocketServer::ConnectionRef::ConnectionRef(NonBlockingSocketServer& server, int client_file_descriptor, void* user_context)
+: m_server(&server)
+, m_file_descriptor(client_file_descriptor)
+, m_user_context(user_context)
+{
+}
+
+NonBlockingSocketServer::ConnectionRef::operator int() const
+{
+    return m_file_descriptor;
+}
+
+int NonBlockingSocketServer::ConnectionRef::GetFileDescriptor() const
+{
+    return m_file_descriptor;
+}
+
+void* NonBlockingSocketServer::ConnectionRef::GetUserContext() const
+{
+    return m_user_context;
+}
+
+void NonBlockingSocketServer::ConnectionRef::SetUserContext(void* user_context)
+{
+    if(m_server->SetUserContext(m_file_descriptor, user_context))
+    {
+        m_user_context = user_context;
+    }
+}
+
+NonBlockingSocketServer::MemoryUsage NonBlockingSocketServer::GetMemoryUsage() const
+{
+    MemoryUsage usage;
+    usage.connection_count = m_client_file_descriptors.size();
+    usage.connection_table_bytes = m_connections.capacity() * sizeof(Connection);
+    usage.client_list_bytes = (m_client_file_descriptors.capacity() + m_pending_tx_file_descriptors.capacity() + m_held_tx_file_descriptors.capacity() + m_rx_ready_file_descriptors.capacity() + m_rx_ready_snapshot.capacity()) * sizeof(int);
+    usage.buffer_pool_reserved_bytes = m_buffer_pool.GetReservedBytes();
+    usage.buffer_pool_borrowed_bytes = m_buffer_pool.GetBorrowedBytes();
+    usage.arena_capacity_bytes = m_huge_page_arena.GetCapacity();
+    usage.arena_used_bytes = m_huge_page_arena.GetUsedBytes();
+
+    for(const Listener& listener : m_listeners)
+    {
+        if(const DatagramState* datagram_state = listener.datagram_state.get())
+        {
+            usage.datagram_bytes += datagram_state->rx_messages.capacity() * sizeof(mmsghdr) + datagram_state->rx_io_vectors.capacity() * sizeof(iovec);
+            usage.datagram_bytes += datagram_state->rx_peers.capacity() * sizeof(DatagramPeer) + datagram_state->rx_buffers.capacity() + datagram_state->rx_control_buffers.capacity();
+            usage.datagram_bytes += datagram_state->tx_bytes.capacity() + datagram_state->tx_datagrams.capacity() * sizeof(OutboundDatagram);
+        }
+    }
+
+    for(const int& client_file_descriptor : m_client_file_descriptors)
+    {
+        const Connection& connection = m_connections[client_file_descriptor];
+        usage.rpc_bytes += connection.rpc_rx_bytes.capacity() + connection.rpc_in_flight_request_ids.capacity() * sizeof(uint64_t);
+
+        for(const TxQueue& tx_queue : connection.tx_queues)
+        {
+            for(const TxMessage* tx_message = tx_queue.head; tx_message != nullptr; tx_message = tx_message->next)
+            {
+                usage.tx_queue_bytes += tx_message->GetAllocationSize();
+
+                if(tx_message->is_owned_payload)
+                {
+                    usage.tx_queue_bytes += tx_message->GetOwnedPayload()->capacity();
+                }
+
+                // split a shared payload between the messages referring to it, so that it is counted once in total
+                if(tx_message->shared_payload != nullptr)
+                {
+                    usage.tx_queue_bytes += tx_message->shared_payload->GetAllocationSize() / tx_message->shared_payload->reference_count;
+                }
+            }
+        }
+    }
+
+    return usage;
+}
+
+const LatencyHistogram& NonBlockingSocketServer::GetRxQueueDelayHistogram() const
+{
+    return m_rx_queue_delay_histogram;
+}
+
+size_t NonBlockingSocketServer::MemoryUsage::GetTotalBytes() const
+{
+    return connection_table_bytes + client_list_bytes + tx_queue_bytes + buffer_pool_reserved_bytes + datagram_bytes + rpc_bytes;
+}
+
+NonBlockingSocketServer::Endpoint NonBlockingSocketServer::MakeEndpoint(const ListenerEndpoint& listener_endpoint)
+{
+    Endpoint endpoint;
+
+    if(const TcpEndpoint* tcp_endpoint = std::get_if<TcpEndpoint>(&listener_endpoint))
+    {
+        endpoint.mode = EndpointMode::TCP;
+        endpoint.tcp_ip_address = tcp_endpoint->ip_address;
+        endpoint.tcp_port = tcp_endpoint->port;
+        // only IPv6 addresses contain colons
+        endpoint.is_tcp_ipv6 = tcp_endpoint->ip_address.find(':') != std::string::npos;
+    }
+    else if(const UdpEndpoint* udp_endpoint = std::get_if<UdpEndpoint>(&listener_endpoint))
+    {
+        endpoint.mode = EndpointMode::UDP;
+        endpoint.tcp_ip_address = udp_endpoint->ip_address;
+        endpoint.tcp_port = udp_endpoint->port;
+        endpoint.is_tcp_ipv6 = udp_endpoint->ip_address.find(':') != std::string::npos;
+    }
+    else if(const UnixEndpoint* unix_endpoint = std::get_if<UnixEndpoint>(&listener_endpoint))
+    {
+        endpoint.mode = EndpointMode::UNIX_DOMAIN;
+        endpoint.unix_socket_path = unix_endpoint->path;
+        endpoint.is_abstract_unix_socket = unix_endpoint->is_abstract;
+        endpoint.shared_memory_ring_size = unix_endpoint->shared_memory_ring_size;
+    }
+
+    return endpoint;
+}
+
+bool NonBlockingSocketServer::StartListener(Listener& listener)
+{
+    // a socket that was inherited or handed over by a predecessor is already bound, and usually listening as well
+    const bool is_bound = listener.file_descriptor != -1;
+    bool is_listening = false;
+
+    if(is_bound && not InspectBoundListener(listener, is_listening))
+    {
+        return false;
+    }
+
+    if(not is_bound)
+    {
+        // Remove the socket file if it already exists
+        if(listener.endpoint.mode == EndpointMode::UNIX_DOMAIN && not listener.endpoint.is_abstract_unix_socket)
+        {
+            unlink(listener.endpoint.unix_socket_path.c_str());
+        }
+
+        if(not CreateSocket(listener))
+        {
+            return false;
+        }
+
+        if(not ApplyListenerSocketOptions(listener))
+        {
+            return false;
+        }
+
+        if(not BindToEndpoint(listener))
+        {
+            return false;
+        }
+    }
+
+    // a datagram socket has nothing to accept, its receive batch is set up instead
+    if(listener.endpoint.mode == EndpointMode::UDP)
+    {
+        CreateDatagramState(listener);
+    }
+    else if(not is_listening && not Listen(listener))
+    {
+        return false;
+    }
+
+    if(not MakeFileDescriptorNonBlocking(listener.file_descriptor))
+    {
+        return false;
+    }
+
+    return ConfigureServerFileDescriptorForEpoll(listener.file_descriptor);
+}
+
+bool NonBlockingSocketServer::InspectBoundListener(Listener& listener, bool& is_listening)
+{
+    const int listener_fd = listener.file_descriptor;
+    int socket_domain = 0;
+    int socket_type = 0;
+    int accepts_connections = 0;
+    socklen_t option_size = sizeof(int);
+    sockaddr_storage address{};
+    socklen_t address_size = sizeof(address);
+
+    if(getsockopt(listener_fd, SOL_SOCKET, SO_DOMAIN, &socket_domain, &option_size) == -1
+        || getsockopt(listener_fd, SOL_SOCKET, SO_TYPE, &socket_type, &option_size) == -1
+        || getsockopt(listener_fd, SOL_SOCKET, SO_ACCEPTCONN, &accepts_connections, &option_size) == -1
+        || getsockname(listener_fd, reinterpret_cast<sockaddr*>(&address), &address_size) == -1)
+    {
+        perror("NonBlockingSocketServer::InspectBoundListener() -> Failed to inspect the inherited socket");
+        return false;
+    }
+
+    EndpointMode mode = EndpointMode::UNDEFINED;
+    const bool is_ip_socket = socket_domain == AF_INET || socket_domain == AF_INET6;
+
+    if(socket_domain == AF_UNIX && socket_type == SOCK_STREAM)
+    {
+        mode = EndpointMode::UNIX_DOMAIN;
+    }
+    else if(is_ip_socket && socket_type == SOCK_STREAM)
+    {
+        mode = EndpointMode::TCP;
+    }
+    else if(is_ip_socket && socket_type == SOCK_DGRAM)
+    {
+        mode = EndpointMode::UDP;
+    }
+
+    // a configured endpoint, as on a handover, has to get the same kind of socket back
+    if(mode == EndpointMode::UNDEFINED || (listener.endpoint.mode != EndpointMode::UNDEFINED && listener.endpoint.mode != mode))
+    {
+        Print("NonBlockingSocketServer::InspectBoundListener() -> File descriptor {" + std::to_string(listener_fd) + "} is not a socket the server can listen on.\n");
+        return false;
+    }
+
+    listener.endpoint.mode = mode;
+
+    // an unbound socket would get a random port or no name at all, which no client could know about
+    if(mode == EndpointMode::UNIX_DOMAIN)
+    {
+        const sockaddr_un& unix_address = reinterpret_cast<const sockaddr_un&>(address);
+        const size_t name_size = address_size - offsetof(sockaddr_un, sun_path);
+
+        if(address_size <= offsetof(sockaddr_un, sun_path))
+        {
+            Print("NonBlockingSocketServer::InspectBoundListener() -> File descriptor {" + std::to_string(listener_fd) + "} is not bound.\n");
+            return false;
+        }
+
+        listener.endpoint.is_abstract_unix_socket = unix_address.sun_path[0] == '\0';
+        listener.endpoint.unix_socket_path = listener.endpoint.is_abstract_unix_socket ? std::string(unix_address.sun_path + 1, name_size - 1) : std::string(unix_address.sun_path);
+    }
+    else
+    {
+        char ip_address[INET6_ADDRSTRLEN] {};
+        listener.endpoint.is_tcp_ipv6 = socket_domain == AF_INET6;
+
+        if(listener.endpoint.is_tcp_ipv6)
+        {
+            const sockaddr_in6& ipv6_address = reinterpret_cast<const sockaddr_in6&>(address);
+            inet_ntop(AF_INET6, &ipv6_address.sin6_addr, ip_address, sizeof(ip_address));
+            listener.endpoint.tcp_port = ntohs(ipv6_address.sin6_port);
+        }
+        else
+        {
+            const sockaddr_in& ipv4_address = reinterpret_cast<const sockaddr_in&>(address);
+            inet_ntop(AF_INET, &ipv4_address.sin_addr, ip_address, sizeof(ip_address));
+            listener.endpoint.tcp_port = ntohs(ipv4_address.sin_port);
+        }
+
+        listener.endpoint.tcp_ip_address = ip_address;
+
+        if(listener.endpoint.tcp_port == 0)
+        {
+            Print("NonBlockingSocketServer::InspectBoundListener() -> File descriptor {" + std::to_string(listener_fd) + "} is not bound.\n");
+            return false;
+        }
+    }
+
+    is_listening = accepts_connections != 0;
+
+    return true;
+}
+
+bool NonBlockingSocketServer::CreateSocket(Listener& listener)
+{
+    // Create a socket
+
+    int server_socket_fd = -1;
+
+    switch (listener.endpoint.mode)
+    {
+    case EndpointMode::TCP:
+    {
+        server_socket_fd = socket(listener.endpoint.is_tcp_ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+        break;
+    }
+    case EndpointMode::UNIX_DOMAIN:
+    {
+        server_socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        break;
+    }
+    case EndpointMode::UDP:
+    {
+        server_socket_fd = socket(listener.endpoint.is_tcp_ipv6 ? AF_INET6 : AF_INET, SOCK_DGRAM, 0);
+        break;
+    }
+    default:
+        break;
+    }
+
+    if (server_socket_fd == -1) 
+    {
+        perror("NonBlockingSocketServer::CreateSocket() -> Socket creation failed");
+        return false;
+    }
+
+    listener.file_descriptor = server_socket_fd;
+    return true;
+}
+
+bool NonBlockingSocketServer::BindToEndpoint(Listener& listener)
+{
+    bool result = false;
+
+    switch (listener.endpoint.mode)
+    {
+        case EndpointMode::UNIX_DOMAIN:
+        {
+            result = BindToUnixDomainSocket(listener);
+            break;
+        }
+        case EndpointMode::TCP:
+        case EndpointMode::UDP:
+        {
+            result = BindToIpSocket(listener);
+            break;
+        }
+        default:
+        {
+            result = false;
+            break;
+        }
+    }
+
+    return result;
+}
+
+bool NonBlockingSocketServer::BindToUnixDomainSocket(Listener& listener)
+{
+    // Bind the socket to the specified Unix domain endpoint
+
+    const Endpoint& endpoint = listener.endpoint;
+
+    Print("NonBlockingSocketServer::BindToUnixDomainSocket() -> Binding to {" + endpoint.unix_socket_path + "}\n");
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    if(not endpoint.is_abstract_unix_socket)
+    {
+        strncpy(address.sun_path, endpoint.unix_socket_path.c_str(), sizeof(address.sun_path) - 1);
+        return Bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    }
+
+    // abstract names start with a null byte and are not null terminated, so the address length decides where the name ends
+    const size_t name_size = std::min(endpoint.unix_socket_path.size(), sizeof(address.sun_path) - 1);
+    memcpy(address.sun_path + 1, endpoint.unix_socket_path.data(), name_size);
+
+    return Bind(listener, reinterpret_cast<sockaddr*>(&address), offsetof(sockaddr_un, sun_path) + 1 + name_size);
+}
+
+bool NonBlockingSocketServer::BindToIpSocket(Listener& listener)
+{
+    // Bind the socket to the specified TCP or UDP endpoint
+
+    const Endpoint& endpoint = listener.endpoint;
+
+    Print("NonBlockingSocketServer::BindToIpSocket() -> Binding to {" + endpoint.tcp_ip_address + ":" + std::to_string(endpoint.tcp_port) + "}\n");
+
+    if(endpoint.is_tcp_ipv6)
+    {
+        sockaddr_in6 address{};
+        address.sin6_family = AF_INET6;
+        address.sin6_port = htons(endpoint.tcp_port);
+
+        if (inet_pton(AF_INET6, endpoint.tcp_ip_address.c_str(), &address.sin6_addr) != 1) 
+        {
+            Print("NonBlockingSocketServer::BindToIpSocket() -> Invalid IP address: {" + endpoint.tcp_ip_address + "}\n");
+            return false;
+        }
+
+        // keep IPv6 listeners IPv6 only, so that an IPv4 listener on the same port can sit next to them
+        if(not SetSocketOption(listener.file_descriptor, IPPROTO_IPV6, IPV6_V6ONLY, 1, "IPV6_V6ONLY"))
+        {
+            return false;
+        }
+
+        return Bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(endpoint.tcp_port);
+
+    if (inet_pton(AF_INET, endpoint.tcp_ip_address.c_str(), &address.sin_addr) != 1) 
+    {
+        Print("NonBlockingSocketServer::BindToIpSocket() -> Invalid IP address: {" + endpoint.tcp_ip_address + "}\n");
+        return false;
+    }
+
+    return Bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+}
+
+bool NonBlockingSocketServer::Bind(const Listener& listener, const sockaddr* address, socklen_t size)
+{
+    if (bind(listener.file_descriptor, address, size) == -1) 
+    {
+        perror("NonBlockingSocketServer::Bind() -> Bind failed");
+        return false;
+    }
+
+    return true;
+}
+
+bool NonBlockingSocketServer::Listen(const Listener& listener)
+{
+     // Start listening for incoming connections
+    if (listen(listener.file_descriptor, m_client_limit) == -1) 
+    {
+        perror("NonBlockingSocketServer::Start() -> Listen failed");
+        return false;
+    }
+
+    return true;
+}
+
+void NonBlockingSocketServer::CloseListeners()
+{
+    for(Listener& listener : m_listeners)
+    {
+        if(listener.file_descriptor != -1)
+        {
+            close(listener.file_descriptor);
+            listener.file_descriptor = -1;
+        }
+    }
+}
+
+bool NonBlockingSocketServer::ApplyListenerSocketOptions(const Listener& listener)
+{
+    const int listener_fd = listener.file_descriptor;
+    bool result = true;
+
+    if(m_socket_options.reuse_address)
+    {
+        result &= SetSocketOption(listener_fd, SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR");
+    }
+
+    if(m_socket_options.reuse_port)
+    {
+        result &= SetSocketOption(listener_fd, SOL_SOCKET, SO_REUSEPORT, 1, "SO_REUSEPORT");
+    }
+
+    // the receive buffer size must be on the listener before connections are accepted, so that the TCP window scale is negotiated with it
+    if(m_socket_options.receive_buffer_size > 0)
+    {
+        result &= SetSocketOption(listener_fd, SOL_SOCKET, SO_RCVBUF, m_socket_options.receive_buffer_size, "SO_RCVBUF");
+    }
+
+    // a UDP listener is also the socket that replies are sent from
+    if(listener.endpoint.mode == EndpointMode::UDP)
+    {
+        if(m_socket_options.send_buffer_size > 0)
+        {
+            result &= SetSocketOption(listener_fd, SOL_SOCKET, SO_SNDBUF, m_socket_options.send_buffer_size, "SO_SNDBUF");
+        }
+
+        if(m_socket_options.udp_gro)
+        {
+            result &= SetSocketOption(listener_fd, SOL_UDP, UDP_GRO, 1, "UDP_GRO");
+        }
+
+        return result;
+    }
+
+    if(listener.endpoint.mode != EndpointMode::TCP)
+    {
+        return result;
+    }
+
+    if(m_socket_options.tcp_defer_accept_seconds > 0)
+    {
+        result &= SetSocketOption(listener_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, m_socket_options.tcp_defer_accept_seconds, "TCP_DEFER_ACCEPT");
+    }
+
+    if(m_socket_options.tcp_fast_open_queue_length > 0)
+    {
+        result &= SetSocketOption(listener_fd, IPPROTO_TCP, TCP_FASTOPEN, m_socket_options.tcp_fast_open_queue_length, "TCP_FASTOPEN");
+    }
+
+    return result;
+}
+
+bool NonBlockingSocketServer::ApplyClientSocketOptions(int client_file_descriptor, const Endpoint& endpoint)
+{
+    bool result = true;
+
+    if(m_socket_options.send_buffer_size > 0)
+    {
+        result &= SetSocketOption(client_file_descriptor, SOL_SOCKET, SO_SNDBUF, m_socket_options.send_buffer_size, "SO_SNDBUF");
+    }
+
+    if(m_socket_options.receive_buffer_size > 0)
+    {
+        result &= SetSocketOption(client_file_descriptor, SOL_SOCKET, SO_RCVBUF, m_socket_options.receive_buffer_size, "SO_RCVBUF");
+    }
+
+    if(m_socket_options.rx_timestamping)
+    {
+        result &= SetSocketOption(client_file_descriptor, SOL_SOCKET, SO_TIMESTAMPING, SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE, "SO_TIMESTAMPING");
+    }
+
+    if(endpoint.mode != EndpointMode::TCP)
+    {
+        return result;
+    }
+
+    if(m_socket_options.tcp_no_delay)
+    {
+        result &= SetSocketOption(client_file_descriptor, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    }
+
+    if(m_socket_options.tcp_quick_ack)
+    {
+        result &= SetSocketOption(client_file_descriptor, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+    }
+
+    if(m_socket_options.keep_alive)
+    {
+        result &= SetSocketOption(client_file_descriptor, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+
+        if(m_socket_options.keep_alive_idle_seconds > 0)
+        {
+            result &= SetSocketOption(client_file_descriptor, IPPROTO_TCP, TCP_KEEPIDLE, m_socket_options.keep_alive_idle_seconds, "TCP_KEEPIDLE");
+        }
+
+        if(m_socket_options.keep_alive_interval_seconds > 0)
+        {
+            result &= SetSocketOption(client_file_descriptor, IPPROTO_TCP, TCP_KEEPINTVL, m_socket_options.keep_alive_interval_seconds, "TCP_KEEPINTVL");
+        }
+
+        if(m_socket_options.keep_alive_probe_count > 0)
+        {
+            result &= SetSocketOption(client_file_descriptor, IPPROTO_TCP, TCP_KEEPCNT, m_socket_options.keep_alive_probe_count, "TCP_KEEPCNT");
+        }
+    }
+
+    return result;
+}
+
+bool NonBlockingSocketServer::SetSocketOption(int file_descriptor, int level, int option_name, int value, const std::string& option_label)
+{
+    const bool result = setsockopt(file_descriptor, level, option_name, &value, sizeof(value)) == 0;
+
+    if(not result)
+    {
+        perror(("NonBlockingSocketServer::SetSocketOption() -> Failed to set " + option_label).c_str());
+    }
+
+    return result;
+}
+
+bool NonBlockingSocketServer::AcceptClient(size_t listener_index)
+{
+    Listener& listener = m_listeners[listener_index];
+
+    if(m_client_file_descriptors.size() == m_client_limit)
+    {
+        Print("NonBlockingSocketServer::AcceptClient() -> Rejected client connection due to connection limit.\n");
+        return false;
+    }
+
+    if(m_accept_limit.rate > 0)
+    {
+        listener.accept_bucket.Refill(m_accept_limit, m_run_time);
+
+        if(listener.accept_bucket.tokens < 1)
+        {
+            PauseAccept(listener);
+            return false;
+        }
+    }
+
+    ++m_run_stats.syscall_counts.accept_count;
+    const int client_fd = accept(listener.file_descriptor, nullptr, nullptr);
+
+    if(client_fd == -1)
+    {
+        perror("NonBlockingSocketServer::AcceptClient() -> Failed to accept client");
+        return false;
+    }
+
+    if(m_accept_limit.rate > 0)
+    {
+        listener.accept_bucket.tokens -= 1;
+    }
+
+    // the client is accepted and closed rather than left in the backlog, where it would keep the level-triggered listener ready
+    if(m_memory_budget != 0 && GetBudgetedBytes() > m_memory_budget)
+    {
+        close(client_fd);
+        ++m_run_stats.shed_client_count;
+        Print("NonBlockingSocketServer::AcceptClient() -> Shed client connection due to memory budget.\n");
+        return false;
+    }
+
+    // the CPU that handled the handshake is the one the NIC steers this flow to, so a reactor pinned there avoids cross-CPU wakeups
+    if(m_steering_callback && listener.endpoint.mode == EndpointMode::TCP && m_steering_callback(client_fd, GetIncomingCpu(client_fd)))
+    {
+        Print("NonBlockingSocketServer::AcceptClient() -> Handed over client with file descriptor: {" + std::to_string(client_fd) + "}\n");
+        return true;
+    }
+
+    return RegisterClient(client_fd, listener_index);
+}
+
+bool NonBlockingSocketServer::RegisterClient(int client_fd, size_t listener_index)
+{
+    const Listener& listener = m_listeners[listener_index];
+
+    if(not MakeFileDescriptorNonBlocking(client_fd))
+    {
+        close(client_fd);
+        return false;
+    }
+
+    // a failed tuning option is reported but does not cost the client its connection
+    ApplyClientSocketOptions(client_fd, listener.endpoint);
+
+    // configure the accepted client file descriptor with epoll events; a client epoll cannot watch would never be served, so it is not registered at all
+    if(not ConfigureClientFileDescriptorForEpoll(client_fd))
+    {
+        close(client_fd);
+        return false;
+    }
+
+    // the connection table is indexed by file descriptor so that lookups do not need to hash or search
+    if(static_cast<size_t>(client_fd) >= m_connections.size())
+    {
+        m_connections.resize(client_fd + 1);
+    }
+
+    Connection& connection = m_connections[client_fd];
+    connection = Connection{};
+    connection.file_descriptor = client_fd;
+    connection.client_list_index = m_client_file_descriptors.size();
+    connection.listener_index = listener_index;
+    connection.last_active_time = m_run_time;
+    connection.rx_byte_bucket = TokenBucket{m_rx_byte_limit.burst, m_run_time};
+    connection.rx_read_bucket = TokenBucket{m_rx_read_limit.burst, m_run_time};
+
+    if(listener.endpoint.shared_memory_ring_size != 0 && not OpenSharedMemory(connection, listener.endpoint.shared_memory_ring_size))
+    {
+        ++m_run_stats.syscall_counts.epoll_ctl_count;
+        epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_DEL, client_fd, nullptr);
+        close(client_fd);
+        connection = Connection{};
+        return false;
+    }
+
+    // save the client file descriptor, because the client has been accepted
+    m_client_file_descriptors.emplace_back(client_fd);
+    ++m_run_stats.accepted_client_count;
+
+    if(m_traffic_recorder != nullptr)
+    {
+        m_traffic_recorder->Record(TrafficEventType::ACCEPT, client_fd);
+    }
+
+    Print("NonBlockingSocketServer::AcceptClient() -> Accepted client connection with file descriptor: {" + std::to_string(client_fd) + "}\n");
+
+    m_connect_callback(ConnectionRef(*this, client_fd, nullptr), listener_index);
+
+    return true;
+}
+
+bool NonBlockingSocketServer::OpenSharedMemory(Connection& connection, size_t ring_size)
+{
+    auto shared_memory = std::make_unique<SharedMemoryChannel>();
+    const int memory_fd = shared_memory->Create(ring_size);
+
+    if(memory_fd == -1)
+    {
+        return false;
+    }
+
+    // the greeting is the first thing on a fresh socket, so it always fits into the socket buffer
+    SharedMemoryChannel::Greeting greeting{};
+    greeting.ring_capacity = shared_memory->GetRingCapacity();
+    alignas(cmsghdr) char control_buffer[CMSG_SPACE(sizeof(int))];
+    iovec io_vector{&greeting, sizeof(greeting)};
+    msghdr message {};
+    message.msg_iov = &io_vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control_buffer;
+    message.msg_controllen = sizeof(control_buffer);
+
+    cmsghdr* control_message = CMSG_FIRSTHDR(&message);
+    control_message->cmsg_level = SOL_SOCKET;
+    control_message->cmsg_type = SCM_RIGHTS;
+    control_message->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(control_message), &memory_fd, sizeof(memory_fd));
+
+    ++m_run_stats.syscall_counts.send_count;
+    const ssize_t sent_bytes = sendmsg(connection.file_descriptor, &message, MSG_NOSIGNAL);
+    close(memory_fd);
+
+    if(sent_bytes != sizeof(greeting))
+    {
+        perror("NonBlockingSocketServer::OpenSharedMemory() -> Failed to send the shared memory greeting");
+        return false;
+    }
+
+    connection.shared_memory = std::move(shared_memory);
+
+    return true;
+}
+
+void NonBlockingSocketServer::HandleSharedMemoryEvent(int client_file_descriptor)
+{
+    // the socket only carries doorbells and the hangup, and one wakeup covers any number of doorbells
+    char doorbells[64];
+    ssize_t read_bytes = 0;
+
+    do
+    {
+        ++m_run_stats.syscall_counts.read_count;
+        read_bytes = recv(client_file_descriptor, doorbells, sizeof(doorbells), MSG_DONTWAIT);
+    }
+    while(read_bytes > 0 || (read_bytes == -1 && errno == EINTR));
+
+    if(read_bytes == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        DisconnectClient(client_file_descriptor);
+        return;
+    }
+
+    Connection* connection = FindConnection(client_file_descriptor);
+
+    // bytes the client wrote before it closed are still delivered, and the read path disconnects it once the ring is empty
+    if(read_bytes == 0)
+    {
+        connection->is_shared_memory_hung_up = true;
+
+        if(not connection->is_rx_ready)
+        {
+            HandleNonBlockingRead(client_file_descriptor);
+        }
+
+        return;
+    }
+
+    // a doorbell may also mean that the client made room in a ring that was full
+    if(connection->is_tx_blocked && not connection->shared_memory->GetServerToClientRing().IsFull())
+    {
+        connection->is_tx_blocked = false;
+        SendToClient(*connection);
+        connection = FindConnection(client_file_descriptor);
+    }
+
+    if(connection != nullptr && not connection->is_rx_ready)
+    {
+        HandleNonBlockingRead(client_file_descriptor);
+    }
+}
+
+ssize_t NonBlockingSocketServer::ReadSharedMemory(Connection& connection, char* buffer, size_t size)
+{
+    SharedMemoryRing& ring = connection.shared_memory->GetClientToServerRing();
+    ssize_t read_size = ring.Read(buffer, size);
+
+    // a client that hung up writes nothing more, so its empty ring reads like a socket at its end
+    if(read_size == 0 && connection.is_shared_memory_hung_up)
+    {
+        return 0;
+    }
+
+    // an empty ring reads like a drained socket, once the client is sure to ring for its next bytes
+    if(read_size == 0 && not ring.ArmConsumerWakeup())
+    {
+        read_size = ring.Read(buffer, size);
+    }
+
+    // the client wrote a position that does not fit the ring, which the read path treats as a broken connection
+    if(read_size == -1)
+    {
+        Print("NonBlockingSocketServer::ReadSharedMemory() -> Client with file descriptor: {" + std::to_string(connection.file_descriptor) + "} corrupted its ring\n");
+        errno = EPROTO;
+        return -1;
+    }
+
+    if(read_size == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    if(ring.TakeProducerWakeup())
+    {
+        RingSharedMemoryDoorbell(connection.file_descriptor);
+    }
+
+    return read_size;
+}
+
+ssize_t NonBlockingSocketServer::WriteSharedMemory(Connection& connection, const iovec* io_vectors, size_t io_vector_count)
+{
+    SharedMemoryRing& ring = connection.shared_memory->GetServerToClientRing();
+    size_t written_size = 0;
+
+    for(size_t io_vector_index = 0; io_vector_index < io_vector_count; ++io_vector_index)
+    {
+        const size_t io_vector_size = io_vectors[io_vector_index].iov_len;
+        const ssize_t fragment_size = ring.Write(std::span<const char>(static_cast<const char*>(io_vectors[io_vector_index].iov_base), io_vector_size));
+
+        if(fragment_size == -1)
+        {
+            Print("NonBlockingSocketServer::WriteSharedMemory() -> Client with file descriptor: {" + std::to_string(connection.file_descriptor) + "} corrupted its ring\n");
+            errno = EPROTO;
+            return -1;
+        }
+
+        written_size += fragment_size;
+
+        if(static_cast<size_t>(fragment_size) != io_vector_size)
+        {
+            break;
+        }
+    }
+
+    if(written_size != 0)
+    {
+        if(ring.TakeConsumerWakeup())
+        {
+            RingSharedMemoryDoorbell(connection.file_descriptor);
+        }
+
+        return written_size;
+    }
+
+    // a full ring reads like a full socket buffer, once the client is sure to ring when it makes room
+    if(ring.ArmProducerWakeup())
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return WriteSharedMemory(connection, io_vectors, io_vector_count);
+}
+
+void NonBlockingSocketServer::RingSharedMemoryDoorbell(int client_file_descriptor)
+{
+    // a full socket buffer already holds doorbells the client has yet to see, so a lost one does not matter
+    const char doorbell = 0;
+    ++m_run_stats.syscall_counts.send_count;
+    (void)send(client_file_descriptor, &doorbell, sizeof(doorbell), MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+void NonBlockingSocketServer::CreateDatagramState(Listener& listener)
+{
+    // a coalesced receive can hold up to 64 KiB, so GRO needs slots of that size to avoid truncation
+    const size_t slot_size = m_socket_options.udp_gro ? MAXIMUM_DATAGRAM_SIZE : std::max(m_socket_options.udp_max_datagram_size, 1);
+    const size_t control_size = CMSG_SPACE(sizeof(int));
+
+    auto datagram_state = std::make_unique<DatagramState>();
+    datagram_state->rx_messages.resize(DATAGRAM_BATCH_SIZE);
+    datagram_state->rx_io_vectors.resize(DATAGRAM_BATCH_SIZE);
+    datagram_state->rx_peers.resize(DATAGRAM_BATCH_SIZE);
+    datagram_state->rx_buffers.resize(DATAGRAM_BATCH_SIZE * slot_size);
+    datagram_state->rx_control_buffers.resize(DATAGRAM_BATCH_SIZE * control_size);
+
+    for(size_t index = 0; index < DATAGRAM_BATCH_SIZE; ++index)
+    {
+        datagram_state->rx_io_vectors[index] = iovec{datagram_state->rx_buffers.data() + index * slot_size, slot_size};
+    }
+
+    listener.datagram_state = std::move(datagram_state);
+}
+
+void NonBlockingSocketServer::ReceiveDatagrams(size_t listener_index)
+{
+    Listener& listener = m_listeners[listener_index];
+    DatagramState& datagram_state = *listener.datagram_state;
+    const size_t control_size = datagram_state.rx_control_buffers.size() / DATAGRAM_BATCH_SIZE;
+
+    while(true)
+    {
+        // recvmmsg() overwrites the lengths, so every slot has to be reset before each call
+        for(size_t index = 0; index < DATAGRAM_BATCH_SIZE; ++index)
+        {
+            msghdr& header = datagram_state.rx_messages[index].msg_hdr;
+            header = msghdr{};
+            header.msg_name = &datagram_state.rx_peers[index].address;
+            header.msg_namelen = sizeof(sockaddr_storage);
+            header.msg_iov = &datagram_state.rx_io_vectors[index];
+            header.msg_iovlen = 1;
+            header.msg_control = datagram_state.rx_control_buffers.data() + index * control_size;
+            header.msg_controllen = control_size;
+        }
+
+        ++m_run_stats.syscall_counts.read_count;
+        const int message_count = recvmmsg(listener.file_descriptor, datagram_state.rx_messages.data(), DATAGRAM_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+
+        if(message_count == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                perror("NonBlockingSocketServer::ReceiveDatagrams() -> Failed to receive datagrams");
+            }
+
+            return;
+        }
+
+        for(int index = 0; index < message_count; ++index)
+        {
+            mmsghdr& message = datagram_state.rx_messages[index];
+            DatagramPeer& peer = datagram_state.rx_peers[index];
+            peer.address_size = message.msg_hdr.msg_namelen;
+
+            if(message.msg_hdr.msg_flags & MSG_TRUNC)
+            {
+                Print("NonBlockingSocketServer::ReceiveDatagrams() -> Dropped a datagram larger than the receive slot from {" + peer.ToString() + "}\n");
+                continue;
+            }
+
+            // without GRO, or when the kernel did not coalesce anything, the slot holds exactly one datagram
+            size_t segment_size = message.msg_len;
+
+            for(cmsghdr* control_message = CMSG_FIRSTHDR(&message.msg_hdr); control_message != nullptr; control_message = CMSG_NXTHDR(&message.msg_hdr, control_message))
+            {
+                if(control_message->cmsg_level == SOL_UDP && control_message->cmsg_type == UDP_GRO)
+                {
+                    int gro_segment_size = 0;
+                    memcpy(&gro_segment_size, CMSG_DATA(control_message), sizeof(gro_segment_size));
+                    segment_size = gro_segment_size > 0 ? gro_segment_size : segment_size;
+                }
+            }
+
+            char* bytes = static_cast<char*>(message.msg_hdr.msg_iov->iov_base);
+            size_t offset = 0;
+
+            // a coalesced slot is a run of equally sized datagrams, of which only the last may be shorter; an empty datagram is still delivered
+            do
+            {
+                const std::span<char> datagram(bytes + offset, std::min<size_t>(segment_size, message.msg_len - offset));
+                m_run_stats.received_bytes += datagram.size();
+                ++m_run_stats.read_count;
+                m_datagram_callback(listener_index, peer, datagram);
+                offset += datagram.size();
+            }
+            while(offset < message.msg_len);
+        }
+
+        // a short batch means the socket is drained
+        if(static_cast<size_t>(message_count) < DATAGRAM_BATCH_SIZE)
+        {
+            return;
+        }
+    }
+}
+
+void NonBlockingSocketServer::SendDatagrams(Listener& listener)
+{
+    DatagramState& datagram_state = *listener.datagram_state;
+    std::vector<OutboundDatagram>& tx_datagrams = datagram_state.tx_datagrams;
+
+    mmsghdr messages[DATAGRAM_BATCH_SIZE];
+    iovec io_vectors[DATAGRAM_BATCH_SIZE];
+    size_t first_datagrams[DATAGRAM_BATCH_SIZE + 1]; // the queue index that each message starts at, followed by where the batch ends
+    alignas(cmsghdr) char control_buffers[DATAGRAM_BATCH_SIZE][CMSG_SPACE(sizeof(uint16_t))];
+
+    size_t sent_datagram_count = 0;
+
+    while(sent_datagram_count < tx_datagrams.size())
+    {
+        size_t message_count = 0;
+        size_t datagram_index = sent_datagram_count;
+
+        while(message_count < DATAGRAM_BATCH_SIZE && datagram_index < tx_datagrams.size())
+        {
+            const OutboundDatagram& first_datagram = tx_datagrams[datagram_index];
+            size_t run_end = datagram_index + 1;
+            size_t run_bytes = first_datagram.size;
+
+            // with segmentation offload, datagrams to the same peer with the size of the first, bar a shorter last one, become one send
+            if(m_socket_options.udp_gso && first_datagram.size > 0)
+            {
+                while(run_end < tx_datagrams.size() && run_end - datagram_index < MAXIMUM_GSO_SEGMENTS && tx_datagrams[run_end].peer == first_datagram.peer
+                    && tx_datagrams[run_end].size > 0 && tx_datagrams[run_end].size <= first_datagram.size && run_bytes + tx_datagrams[run_end].size <= MAXIMUM_DATAGRAM_SIZE)
+                {
+                    run_bytes += tx_datagrams[run_end].size;
+
+                    if(tx_datagrams[run_end++].size < first_datagram.size)
+                    {
+                        break;
+                    }
+                }
+            }
+
+            messages[message_count] = mmsghdr{};
+            msghdr& header = messages[message_count].msg_hdr;
+            io_vectors[message_count] = iovec{datagram_state.tx_bytes.data() + first_datagram.offset, run_bytes};
+            header.msg_name = const_cast<sockaddr_storage*>(&first_datagram.peer.address);
+            header.msg_namelen = first_datagram.peer.address_size;
+            header.msg_iov = &io_vectors[message_count];
+            header.msg_iovlen = 1;
+
+            if(run_end - datagram_index > 1)
+            {
+                header.msg_control = control_buffers[message_count];
+                header.msg_controllen = sizeof(control_buffers[message_count]);
+
+                cmsghdr* control_message = CMSG_FIRSTHDR(&header);
+                control_message->cmsg_level = SOL_UDP;
+                control_message->cmsg_type = UDP_SEGMENT;
+                control_message->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                const uint16_t segment_size = first_datagram.size;
+                memcpy(CMSG_DATA(control_message), &segment_size, sizeof(segment_size));
+            }
+
+            first_datagrams[message_count++] = datagram_index;
+            datagram_index = run_end;
+        }
+
+        first_datagrams[message_count] = datagram_index;
+
+        ++m_run_stats.syscall_counts.send_count;
+        const int sent_message_count = sendmmsg(listener.file_descriptor, messages, message_count, MSG_NOSIGNAL);
+
+        if(sent_message_count == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            // keep the rest for the next Run() while the socket buffer is full
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+
+            // the first message of the batch is the one that failed, drop it so that it cannot hold up the queue
+            perror("NonBlockingSocketServer::SendDatagrams() -> Failed to send a datagram");
+            sent_datagram_count = first_datagrams[1];
+            continue;
+        }
+
+        for(int index = 0; index < sent_message_count; ++index)
+        {
+            m_run_stats.sent_bytes += io_vectors[index].iov_len;
+        }
+
+        m_run_stats.sent_message_count += first_datagrams[sent_message_count] - sent_datagram_count;
+        sent_datagram_count = first_datagrams[sent_message_count];
+    }
+
+    if(sent_datagram_count == tx_datagrams.size())
+    {
+        tx_datagrams.clear();
+        datagram_state.tx_bytes.clear();
+        return;
+    }
+
+    // move what is left to the front, so that the queue does not keep growing while the socket is backed up
+    const size_t sent_byte_count = tx_datagrams[sent_datagram_count].offset;
+    datagram_state.tx_bytes.erase(datagram_state.tx_bytes.begin(), datagram_state.tx_bytes.begin() + sent_byte_count);
+    tx_datagrams.erase(tx_datagrams.begin(), tx_datagrams.begin() + sent_datagram_count);
+
+    for(OutboundDatagram& tx_datagram : tx_datagrams)
+    {
+        tx_datagram.offset -= sent_byte_count;
+    }
+}
+
+bool NonBlockingSocketServer::DatagramPeer::operator==(const DatagramPeer& other) const
+{
+    return address_size == other.address_size && memcmp(&address, &other.address, address_size) == 0;
+}
+
+std::string NonBlockingSocketServer::DatagramPeer::ToString() const
+{
+    char text[INET6_ADDRSTRLEN] {};
+
+    if(address.ss_family == AF_INET)
+    {
+        const sockaddr_in& ipv4_address = reinterpret_cast<const sockaddr_in&>(address);
+        inet_ntop(AF_INET, &ipv4_address.sin_addr, text, sizeof(text));
+        return std::string(text) + ":" + std::to_string(ntohs(ipv4_address.sin_port));
+    }
+
+    if(address.ss_family == AF_INET6)
+    {
+        const sockaddr_in6& ipv6_address = reinterpret_cast<const sockaddr_in6&>(address);
+        inet_ntop(AF_INET6, &ipv6_address.sin6_addr, text, sizeof(text));
+        return "[" + std::string(text) + "]:" + std::to_string(ntohs(ipv6_address.sin6_port));
+    }
+
+    return {};
+}
+
+bool NonBlockingSocketServer::MakeFileDescriptorNonBlocking(int file_descriptor)
+{
+    const bool result = fcntl(file_descriptor, F_SETFL, O_NONBLOCK) != -1;
+
+    if(not result)
+    {
+        perror("UnixSocketServer::MakeFileDescriptorNonBlocking() -> Failed to make file descriptor non-blocking");
+    }
+
+    return result;
+}
+
+bool NonBlockingSocketServer::ConfigureServerFileDescriptorForEpoll(int listener_file_descriptor)
+{
+    // define epoll event conditions for the listener socket file descriptor
+    epoll_event server_epoll_events{};
+    server_epoll_events.events = EPOLLIN;
+    server_epoll_events.data.fd = listener_file_descriptor;
+    // apply the epoll event conditions to the listener socket file descriptor
+    const bool epoll_ctl_result = epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_ADD, listener_file_descriptor, &server_epoll_events) == 0;
+
+    if(not epoll_ctl_result)
+    {
+        perror("NonBlockingSocketServer::ConfigureServerFileDescriptorForEpoll() -> Failed to configure epoll for file descriptor");
+    }
+
+    return epoll_ctl_result;
+}
+
+bool NonBlockingSocketServer::ConfigureClientFileDescriptorForEpoll(int client_file_descriptor)
+{
+    epoll_event client_epoll_events{};
+    // EPOLLOUT is edge-triggered as well, so it only fires when a client that filled its socket buffer becomes writable again
+    client_epoll_events.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    client_epoll_events.data.fd = client_file_descriptor;
+    ++m_run_stats.syscall_counts.epoll_ctl_count;
+    const bool epoll_ctl_result = epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_ADD, client_file_descriptor, &client_epoll_events) == 0;
+    
+    if(not epoll_ctl_result)
+    {
+        perror("NonBlockingSocketServer::ConfigureClientFileDescriptorForEpoll() -> Failed to confugure client file descriptor for epoll events");
+    }
+
+    return epoll_ctl_result;
 }
 
 void NonBlockingSocketServer::Run()
 {
-    ProcessEpollEvent();
-    ProcessTxMessages();
+    RunOnce(m_blocking_timeout);
+}
+
+NonBlockingSocketServer::RunStats NonBlockingSocketServer::RunOnce(std::chrono::milliseconds timeout)
+{
+    m_run_stats = RunStats{};
+    m_is_in_run = true;
+
+    if(m_is_cpu_affinity_pending)
+    {
+        ApplyCpuAffinity();
+    }
+
+    // perf events count the thread that opened them, which has to be the one that runs the loop
+    if(m_is_perf_counters_pending)
+    {
+        m_is_perf_counters_pending = false;
+        m_perf_counters.Open();
+    }
+
+    PerfSample perf_start;
+    const bool is_perf_sampled = m_perf_counters.Read(perf_start);
+
+    if(m_idle_reclamation_period.count() > 0 || m_is_rx_rate_limited || m_accept_limit.rate > 0)
+    {
+        m_run_time = std::chrono::steady_clock::now();
+    }
+
+    ProcessEpollEvent(timeout);
+    DeliverRxBatch();
+    ProcessAdoptedClients();
+    ProcessPostedMessages();
+
+    if(m_run_stats.read_count != 0 && m_batch_end_callback)
+    {
+        m_batch_end_callback();
+    }
+
+    ProcessHeldTxMessages();
+    ProcessTxMessages();
+
+    if(m_memory_budget != 0 && GetBudgetedBytes() > m_memory_budget)
+    {
+        EnforceMemoryBudget();
+    }
+
+    if(m_idle_reclamation_period.count() > 0 && m_run_time >= m_next_reclamation_time)
+    {
+        ReclaimIdleMemory();
+    }
+
+    PerfSample perf_end;
+
+    if(is_perf_sampled && m_perf_counters.Read(perf_end))
+    {
+        m_run_stats.perf_counts = perf_end - perf_start;
+    }
+
+    m_is_in_run = false;
+
+    // clients left on the ready list have bytes that edge-triggered epoll will not report again
+    if(not m_rx_ready_file_descriptors.empty() || not m_pending_tx_file_descriptors.empty())
+    {
+        SignalQueuedWork();
+    }
+
+    return m_run_stats;
+}
+
+NonBlockingSocketServer::RunStats NonBlockingSocketServer::RunFor(std::chrono::milliseconds duration)
+{
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + duration;
+    RunStats run_stats;
+
+    while(m_server_state != ServerState::CLOSED)
+    {
+        // round up, so that the last pass does not end the run early by waiting zero milliseconds
+        const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+
+        if(remaining.count() <= 0)
+        {
+            break;
+        }
+
+        run_stats += RunOnce(std::min(remaining, m_blocking_timeout));
+    }
+
+    return run_stats;
+}
+
+NonBlockingSocketServer::RunStats NonBlockingSocketServer::RunUntilIdle()
+{
+    RunStats run_stats;
+
+    while(m_server_state != ServerState::CLOSED)
+    {
+        const RunStats pass_stats = RunOnce(std::chrono::milliseconds(0));
+        run_stats += pass_stats;
+
+        if(pass_stats.IsIdle())
+        {
+            break;
+        }
+    }
+
+    return run_stats;
+}
+
+int NonBlockingSocketServer::GetPollFileDescriptor() const
+{
+    // an epoll instance is itself pollable, and readable while any of its file descriptors has an event; queued work is signalled through the wakeup file descriptor from now on
+    m_is_nested = true;
+    return m_server_epoll_file_descriptor;
+}
+
+bool NonBlockingSocketServer::RunStats::IsIdle() const
+{
+    return event_count == 0 && accepted_client_count == 0 && disconnected_client_count == 0 && read_count == 0 && posted_message_count == 0 && sent_message_count == 0 && sent_bytes == 0;
+}
+
+NonBlockingSocketServer::RunStats& NonBlockingSocketServer::RunStats::operator+=(const RunStats& other)
+{
+    event_count += other.event_count;
+    accepted_client_count += other.accepted_client_count;
+    disconnected_client_count += other.disconnected_client_count;
+    received_bytes += other.received_bytes;
+    read_count += other.read_count;
+    posted_message_count += other.posted_message_count;
+    sent_bytes += other.sent_bytes;
+    sent_message_count += other.sent_message_count;
+    shed_client_count += other.shed_client_count;
+    syscall_counts += other.syscall_counts;
+    perf_counts += other.perf_counts;
+
+    return *this;
+}
+
+size_t NonBlockingSocketServer::SyscallCounts::GetTotal() const
+{
+    return epoll_wait_count + read_count + send_count + accept_count + epoll_ctl_count;
+}
+
+NonBlockingSocketServer::SyscallCounts& NonBlockingSocketServer::SyscallCounts::operator+=(const SyscallCounts& other)
+{
+    epoll_wait_count += other.epoll_wait_count;
+    read_count += other.read_count;
+    send_count += other.send_count;
+    accept_count += other.accept_count;
+    epoll_ctl_count += other.epoll_ctl_count;
+
+    return *this;
+}
+
+void NonBlockingSocketServer::ProcessEpollEvent(std::chrono::milliseconds timeout)
+{
+    if(m_server_state == ServerState::CLOSING)
+    {
+        CloseServer();
+        return;
+    }
+
+    // clients that ran out of read budget earlier are served after this round of events, and only they, so a client cannot get two budgets in one Run()
+    m_rx_ready_snapshot.swap(m_rx_ready_file_descriptors);
+
+    epoll_event* events = m_epoll_events.data();
+
+    // edge-triggered epoll will not report bytes that a ready client left behind, so do not block while any are waiting
+    ++m_run_stats.syscall_counts.epoll_wait_count;
+    const int event_count = epoll_wait(m_server_epoll_file_descriptor, events, m_epoll_events.size(), m_rx_ready_snapshot.empty() ? timeout.count() : 0);
+
+    if(event_count == -1)
+    {
+        perror("NonBlockingSocketServer::ProcessEpollEvent() -> Triggered events were erroneous.");
+        ProcessRxReadyConnections();
+        return;
+    }
+
+    m_run_stats.event_count += event_count;
+    
+    for (int i = 0; i < event_count; ++i) 
+    {
+        size_t listener_index = 0;
+
+        // posted messages are picked up after the events, so the wakeup only has to be acknowledged
+        if (events[i].data.fd == m_wakeup_file_descriptor)
+        {
+            uint64_t wakeup_count = 0;
+            ++m_run_stats.syscall_counts.read_count;
+            (void)read(m_wakeup_file_descriptor, &wakeup_count, sizeof(wakeup_count));
+            m_is_queued_work_signalled = false;
+        }
+        // held payloads are flushed after the events, so the timer only has to be acknowledged
+        else if (events[i].data.fd == m_tx_flush_timer_file_descriptor)
+        {
+            uint64_t expiration_count = 0;
+            ++m_run_stats.syscall_counts.read_count;
+            (void)read(m_tx_flush_timer_file_descriptor, &expiration_count, sizeof(expiration_count));
+            m_is_tx_flush_timer_armed = false;
+        }
+        // the clock was read before the wait, which may have taken a while
+        else if (events[i].data.fd == m_rate_limit_timer_file_descriptor)
+        {
+            uint64_t expiration_count = 0;
+            ++m_run_stats.syscall_counts.read_count;
+            (void)read(m_rate_limit_timer_file_descriptor, &expiration_count, sizeof(expiration_count));
+            m_rate_limit_timer_deadline = {};
+            m_run_time = std::chrono::steady_clock::now();
+            ResumeRateLimited();
+        }
+        // if the event file descriptor is one of the listeners, then a client has connected, or datagrams have arrived
+        else if (const Listener* listener = FindListener(events[i].data.fd, listener_index)) 
+        {
+            if(listener->endpoint.mode == EndpointMode::UDP)
+            {
+                ReceiveDatagrams(listener_index);
+            }
+            else
+            {
+                AcceptClient(listener_index);
+            }
+        } 
+        // if the event is for a client file descriptor, then handle it here
+        else 
+        {
+            const int client_fd = events[i].data.fd;
+            const Connection* shared_memory_connection = FindConnection(client_fd);
+
+            if(shared_memory_connection != nullptr && shared_memory_connection->shared_memory != nullptr)
+            {
+                if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                {
+                    HandleSharedMemoryEvent(client_fd);
+                }
+
+                continue;
+            }
+
+            if(events[i].events & EPOLLOUT)
+            {
+                Connection* connection = FindConnection(client_fd);
+
+                if(connection != nullptr && connection->is_tx_blocked)
+                {
+                    connection->is_tx_blocked = false;
+                    SendToClient(*connection);
+                }
+            }
+
+            // a client on the ready list is read in its turn below
+            const Connection* connection = FindConnection(client_fd);
+
+            if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR) && (connection == nullptr || not connection->is_rx_ready))
+            {
+                HandleNonBlockingRead(client_fd);
+            }
+        }
+    }
+
+    ProcessRxReadyConnections();
+}
+
+void NonBlockingSocketServer::ProcessRxReadyConnections()
+{
+    for(const int& client_file_descriptor : m_rx_ready_snapshot)
+    {
+        Connection* connection = FindConnection(client_file_descriptor);
+
+        // the client may have disconnected, and its file descriptor may even belong to a new client by now
+        if(connection == nullptr || not connection->is_rx_ready)
+        {
+            continue;
+        }
+
+        connection->is_rx_ready = false;
+        HandleNonBlockingRead(client_file_descriptor);
+    }
+
+    m_rx_ready_snapshot.clear();
+}
+
+void NonBlockingSocketServer::DeliverRxBatch()
+{
+    if(m_rx_batch.empty())
+    {
+        return;
+    }
+
+    m_rx_batch_callback(m_rx_batch);
+    m_rx_batch.clear();
+
+    for(char* rx_batch_buffer : m_rx_batch_buffers)
+    {
+        m_buffer_pool.Release(rx_batch_buffer);
+    }
+
+    m_rx_batch_buffers.clear();
+}
+
+void NonBlockingSocketServer::CloseServer()
+{
+    // DisconnectClient() removes entries from the client list, so always disconnect the last one
+    while(not m_client_file_descriptors.empty())
+    {
+        DisconnectClient(m_client_file_descriptors.back());
+    }
+
+    CloseListeners();
+    close(m_server_epoll_file_descriptor);
+    m_server_epoll_file_descriptor = -1;
+
+    if(m_wakeup_file_descriptor != -1)
+    {
+        close(m_wakeup_file_descriptor);
+        m_wakeup_file_descriptor = -1;
+    }
+
+    if(m_tx_flush_timer_file_descriptor != -1)
+    {
+        close(m_tx_flush_timer_file_descriptor);
+        m_tx_flush_timer_file_descriptor = -1;
+        m_is_tx_flush_timer_armed = false;
+    }
+
+    if(m_rate_limit_timer_file_descriptor != -1)
+    {
+        close(m_rate_limit_timer_file_descriptor);
+        m_rate_limit_timer_file_descriptor = -1;
+        m_rate_limit_timer_deadline = {};
+    }
+
+    m_rx_paused_file_descriptors.clear();
+    m_pending_tx_file_descriptors.clear();
+    m_held_tx_file_descriptors.clear();
+    m_rx_ready_file_descriptors.clear();
+    m_rx_ready_snapshot.clear();
+
+    m_server_state = ServerState::CLOSED;
+}
+
+std::vector<char> NonBlockingSocketServer::SerializeHandOverState()
+{
+    std::vector<char> state;
+
+    // every queued message keeps its own boundaries, so that priority classes still only switch between whole messages after the handover
+    for(const int& client_file_descriptor : m_client_file_descriptors)
+    {
+        const Connection& connection = m_connections[client_file_descriptor];
+        AppendValue(state, connection.listener_index);
+        AppendValue(state, connection.tx_sending_priority);
+        AppendValue(state, static_cast<uint64_t>(connection.tx_bytes_sent));
+
+        for(const TxQueue& tx_queue : connection.tx_queues)
+        {
+            uint32_t message_count = 0;
+
+            for(const TxMessage* tx_message = tx_queue.head; tx_message != nullptr; tx_message = tx_message->next)
+            {
+                ++message_count;
+            }
+
+            AppendValue(state, message_count);
+
+            for(TxMessage* tx_message = tx_queue.head; tx_message != nullptr; tx_message = tx_message->next)
+            {
+                AppendValue(state, static_cast<uint64_t>(tx_message->size));
+                state.insert(state.end(), tx_message->Data(), tx_message->Data() + tx_message->size);
+            }
+        }
+    }
+
+    return state;
+}
+
+bool NonBlockingSocketServer::SendHandOver(int control_file_descriptor, const std::vector<char>& state)
+{
+    std::vector<int> file_descriptors;
+    file_descriptors.reserve(m_listeners.size() + m_client_file_descriptors.size());
+
+    for(const Listener& listener : m_listeners)
+    {
+        file_descriptors.emplace_back(listener.file_descriptor);
+    }
+
+    file_descriptors.insert(file_descriptors.end(), m_client_file_descriptors.begin(), m_client_file_descriptors.end());
+
+    const HandOverHeader header{HANDOVER_MAGIC, static_cast<uint32_t>(m_listeners.size()), static_cast<uint32_t>(m_client_file_descriptors.size()), state.size()};
+
+    if(not SendControlMessage(control_file_descriptor, &header, sizeof(header), {}))
+    {
+        return false;
+    }
+
+    for(size_t offset = 0; offset < file_descriptors.size(); offset += MAXIMUM_PASSED_FILE_DESCRIPTORS)
+    {
+        const std::span<const int> batch = std::span<const int>(file_descriptors).subspan(offset, std::min(MAXIMUM_PASSED_FILE_DESCRIPTORS, file_descriptors.size() - offset));
+        const uint32_t batch_size = batch.size();
+
+        if(not SendControlMessage(control_file_descriptor, &batch_size, sizeof(batch_size), batch))
+        {
+            return false;
+        }
+    }
+
+    // a sequenced packet has to fit into the socket buffer as a whole, so the state goes in chunks
+    for(size_t offset = 0; offset < state.size(); offset += HANDOVER_CHUNK_SIZE)
+    {
+        if(not SendControlMessage(control_file_descriptor, state.data() + offset, std::min(HANDOVER_CHUNK_SIZE, state.size() - offset), {}))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool NonBlockingSocketServer::ReceiveHandOver(int control_file_descriptor, std::vector<int>& file_descriptors, std::vector<char>& state)
+{
+    HandOverHeader header{};
+
+    if(ReceiveControlMessage(control_file_descriptor, &header, sizeof(header), file_descriptors) != sizeof(header) || header.magic != HANDOVER_MAGIC
+        || header.listener_count != m_listeners.size() || header.client_count > m_client_limit)
+    {
+        return false;
+    }
+
+    const size_t file_descriptor_count = header.listener_count + header.client_count;
+
+    while(file_descriptors.size() < file_descriptor_count)
+    {
+        uint32_t batch_size = 0;
+        const size_t previous_count = file_descriptors.size();
+
+        if(ReceiveControlMessage(control_file_descriptor, &batch_size, sizeof(batch_size), file_descriptors) != sizeof(batch_size) || batch_size == 0
+            || file_descriptors.size() != previous_count + batch_size)
+        {
+            return false;
+        }
+    }
+
+    state.resize(header.state_size);
+
+    for(size_t offset = 0; offset < state.size();)
+    {
+        const ssize_t received_bytes = ReceiveControlMessage(control_file_descriptor, state.data() + offset, std::min(HANDOVER_CHUNK_SIZE, state.size() - offset), file_descriptors);
+
+        if(received_bytes <= 0)
+        {
+            return false;
+        }
+
+        offset += received_bytes;
+    }
+
+    return file_descriptors.size() == file_descriptor_count;
+}
+
+bool NonBlockingSocketServer::RestoreHandOverState(const std::vector<int>& client_file_descriptors, const std::vector<char>& state)
+{
+    size_t offset = 0;
+    size_t client_index = 0;
+
+    // clients that are registered are closed along with the server, the ones not reached yet are closed here
+    const auto close_remaining_clients = [&]()
+    {
+        for(; client_index < client_file_descriptors.size(); ++client_index)
+        {
+            close(client_file_descriptors[client_index]);
+        }
+
+        return false;
+    };
+
+    for(; client_index < client_file_descriptors.size(); ++client_index)
+    {
+        const int client_file_descriptor = client_file_descriptors[client_index];
+        uint16_t listener_index = 0;
+        uint8_t tx_sending_priority = 0;
+        uint64_t tx_bytes_sent = 0;
+
+        if(not ReadValue(state, offset, listener_index) || listener_index >= m_listeners.size()
+            || not ReadValue(state, offset, tx_sending_priority) || not ReadValue(state, offset, tx_bytes_sent) || tx_sending_priority >= TX_PRIORITY_COUNT)
+        {
+            return close_remaining_clients();
+        }
+
+        // a client that cannot be registered is closed by RegisterClient(), and its queued payloads are skipped so that the next client's state lines up
+        Connection* connection = RegisterClient(client_file_descriptor, listener_index) ? &m_connections[client_file_descriptor] : nullptr;
+
+        if(connection == nullptr)
+        {
+            Print("NonBlockingSocketServer::RestoreHandOverState() -> Dropped handed over client with file descriptor: {" + std::to_string(client_file_descriptor) + "}\n");
+        }
+
+        for(size_t priority_index = 0; priority_index < TX_PRIORITY_COUNT; ++priority_index)
+        {
+            uint32_t message_count = 0;
+
+            if(not ReadValue(state, offset, message_count))
+            {
+                ++client_index;
+                return close_remaining_clients();
+            }
+
+            for(uint32_t message_index = 0; message_index < message_count; ++message_index)
+            {
+                uint64_t message_size = 0;
+
+                if(not ReadValue(state, offset, message_size) || state.size() - offset < message_size)
+                {
+                    ++client_index;
+                    return close_remaining_clients();
+                }
+
+                if(connection != nullptr)
+                {
+                    PushTxMessage(*connection, std::span<const char>(state.data() + offset, message_size), static_cast<TxPriority>(priority_index));
+                }
+
+                offset += message_size;
+            }
+        }
+
+        if(connection == nullptr)
+        {
+            continue;
+        }
+
+        // the predecessor may have sent part of a message already, and the rest of it has to go out first
+        const TxMessage* partial_message = connection->tx_queues[tx_sending_priority].head;
+
+        if(tx_bytes_sent != 0 && (partial_message == nullptr || tx_bytes_sent >= partial_message->size))
+        {
+            ++client_index;
+            return close_remaining_clients();
+        }
+
+        connection->tx_sending_priority = tx_sending_priority;
+        connection->tx_bytes_sent = tx_bytes_sent;
+
+        if(HasTxMessages(*connection))
+        {
+            ScheduleTx(*connection);
+        }
+    }
+
+    return offset == state.size();
+}
+
+void NonBlockingSocketServer::DisconnectClient(int client_file_descriptor)
+{
+    Connection* connection = FindConnection(client_file_descriptor);
+
+    if(connection == nullptr)
+    {
+        return;
+    }
+
+    // the batch refers to clients by file descriptor, which the kernel may hand to a new client as soon as this one is closed
+    DeliverRxBatch();
+
+    // remove the client's file descriptor from epoll to avoid dead file descriptor issues
+    ++m_run_stats.syscall_counts.epoll_ctl_count;
+    epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_DEL, client_file_descriptor, nullptr);
+    // close the client file descriptor
+    close(client_file_descriptor);
+
+    // swap the last client into the vacated slot so that removal does not need to search the client list
+    const uint32_t client_list_index = connection->client_list_index;
+    const int moved_client_fd = m_client_file_descriptors.back();
+    m_client_file_descriptors[client_list_index] = moved_client_fd;
+    m_connections[moved_client_fd].client_list_index = client_list_index;
+    m_client_file_descriptors.pop_back();
+    ++m_run_stats.disconnected_client_count;
+
+    if(m_traffic_recorder != nullptr)
+    {
+        m_traffic_recorder->Record(TrafficEventType::DISCONNECT, client_file_descriptor);
+    }
+
+    // release any unsent payloads and subscriptions along with the rest of the connection state
+    void* user_context = connection->user_context;
+    m_topic_subscriptions.RemoveClient(client_file_descriptor);
+    ClearTxMessages(*connection);
+    m_rpc_rx_bytes -= connection->rpc_rx_bytes.size();
+    *connection = Connection{};
+
+    // the context is handed back one last time, so that the application can free it
+    m_disconnect_callback(ConnectionRef(*this, client_file_descriptor, user_context));
+    Print("NonBlockingSocketServer::DisconnectClient() -> Disconnected client with file descriptor: {" + std::to_string(client_file_descriptor) + "}\n");
+}
+
+void NonBlockingSocketServer::HandleNonBlockingRead(int client_file_descriptor)
+{
+    Connection* connection = FindConnection(client_file_descriptor);
+
+    // the client may have been disconnected earlier in the same pass
+    if(connection == nullptr)
+    {
+        return;
+    }
+
+    if(m_is_rx_rate_limited)
+    {
+        // a paused client is read again once it has resumed, which also catches a hangup that arrived in the meantime
+        if(connection->is_rx_paused)
+        {
+            return;
+        }
+
+        connection->rx_byte_bucket.Refill(m_rx_byte_limit, m_run_time);
+        connection->rx_read_bucket.Refill(m_rx_read_limit, m_run_time);
+    }
+
+    if(m_rpc_handler)
+    {
+        // a client at its in-flight limit is put on the ready list again by CompleteRpcRequest(), which first gets the frames it already sent
+        if(connection->is_rpc_paused)
+        {
+            return;
+        }
+
+        if(not connection->rpc_rx_bytes.empty() && (not DispatchRpcFrames(client_file_descriptor, {}) || m_connections[client_file_descriptor].is_rpc_paused))
+        {
+            return;
+        }
+    }
+
+    // the read buffer is only borrowed while bytes are in flight, so idle clients do not hold one
+    char* read_buffer = m_buffer_pool.Acquire();
+    const size_t read_buffer_size = m_buffer_pool.GetBlockSize();
+    size_t read_byte_count = 0;
+    size_t read_call_count = 0;
+    m_connections[client_file_descriptor].last_active_time = m_run_time;
+
+    // loop until there is nothing left to read, or the client has used up its budget
+    while(true)
+    {
+        if((m_read_byte_budget != 0 && read_byte_count >= m_read_byte_budget) || (m_read_call_budget != 0 && read_call_count >= m_read_call_budget))
+        {
+            // edge-triggered epoll will not report the rest again, so the ready list has to remember it
+            m_connections[client_file_descriptor].is_rx_ready = true;
+            m_rx_ready_file_descriptors.emplace_back(client_file_descriptor);
+            break;
+        }
+
+        if(m_is_rx_rate_limited && not HasRxTokens(m_connections[client_file_descriptor]))
+        {
+            PauseRx(m_connections[client_file_descriptor]);
+            break;
+        }
+
+        timespec kernel_timestamp {};
+        Connection& connection = m_connections[client_file_descriptor];
+        m_run_stats.syscall_counts.read_count += connection.shared_memory == nullptr ? 1 : 0;
+        const ssize_t bytes = connection.shared_memory != nullptr ? ReadSharedMemory(connection, read_buffer, read_buffer_size)
+            : m_socket_options.rx_timestamping ? ReadWithTimestamp(client_file_descriptor, read_buffer, read_buffer_size, kernel_timestamp)
+            : read(client_file_descriptor, read_buffer, read_buffer_size);
+
+        if(bytes == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            // stop reading if the non-blocking socket reports there is nothing left to read, which ends every event and is not an error
+            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EBADF)
+            {
+                break;
+            }
+
+            // any other error means the connection is broken
+            DisconnectClient(client_file_descriptor);
+            break;
+        }
+
+        if(bytes == 0)
+        {
+            DisconnectClient(client_file_descriptor);
+            break;
+        }
+
+        // the kernel leaves quick ack mode on its own, so it has to be re-armed after every read
+        if(m_socket_options.tcp_quick_ack && m_listeners[m_connections[client_file_descriptor].listener_index].endpoint.mode == EndpointMode::TCP)
+        {
+            SetSocketOption(client_file_descriptor, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+        }
+
+        read_byte_count += bytes;
+        ++read_call_count;
+
+        // a read may overdraw the byte bucket, which the client then pays back by waiting longer
+        if(m_is_rx_rate_limited)
+        {
+            connection.rx_byte_bucket.tokens -= bytes;
+            connection.rx_read_bucket.tokens -= 1;
+        }
+
+        const std::span<char> rx_payload_view (read_buffer, bytes);
+
+        if(m_traffic_recorder != nullptr)
+        {
+            m_traffic_recorder->Record(TrafficEventType::RECEIVE, client_file_descriptor, rx_payload_view);
+        }
+
+        Print("NonBlockingSocketServer::ProcessEpollEvent() -> Received payload from client file descriptor: {" + std::to_string(client_file_descriptor) + "}, payload: {" + std::string(rx_payload_view.data(), rx_payload_view.size()) + "}\n");
+
+        std::chrono::nanoseconds rx_queue_delay {};
+
+        // software receive timestamps are taken from the realtime clock when the kernel queues the bytes
+        if(kernel_timestamp.tv_sec != 0 || kernel_timestamp.tv_nsec != 0)
+        {
+            timespec now {};
+            clock_gettime(CLOCK_REALTIME, &now);
+            rx_queue_delay = std::chrono::seconds(now.tv_sec - kernel_timestamp.tv_sec) + std::chrono::nanoseconds(now.tv_nsec - kernel_timestamp.tv_nsec);
+            m_rx_queue_delay_histogram.Record(rx_queue_delay);
+        }
+
+        m_run_stats.received_bytes += bytes;
+        ++m_run_stats.read_count;
+
+        if(m_rpc_handler)
+        {
+            if(not DispatchRpcFrames(client_file_descriptor, rx_payload_view) || m_connections[client_file_descriptor].is_rpc_paused)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        if(m_rx_batch_callback)
+        {
+            // the batch keeps this buffer until it is delivered, so read on into a fresh one
+            m_rx_batch.emplace_back(RxRecord{client_file_descriptor, rx_payload_view, rx_queue_delay, connection.user_context});
+            m_rx_batch_buffers.emplace_back(read_buffer);
+            read_buffer = m_buffer_pool.Acquire();
+            continue;
+        }
+
+        if(m_worker_pool != nullptr)
+        {
+            DispatchToWorker(m_connections[client_file_descriptor], rx_payload_view, rx_queue_delay);
+            continue;
+        }
+
+        m_rx_callback(ConnectionRef(*this, client_file_descriptor, connection.user_context), rx_payload_view, rx_queue_delay);
+    }
+
+    m_buffer_pool.Release(read_buffer);
+}
+
+bool NonBlockingSocketServer::DispatchRpcFrames(int client_file_descriptor, std::span<char> bytes)
+{
+    Connection* connection = &m_connections[client_file_descriptor];
+
+    if(connection->rpc_connection_id == 0)
+    {
+        connection->rpc_connection_id = ++m_rpc_connection_count;
+    }
+
+    const uint64_t connection_id = connection->rpc_connection_id;
+
+    // frames that arrived whole are handed out straight from the read buffer, only the start of a frame is copied aside until its rest arrives
+    const bool is_held_back = not connection->rpc_rx_bytes.empty();
+
+    if(is_held_back)
+    {
+        connection->rpc_rx_bytes.insert(connection->rpc_rx_bytes.end(), bytes.begin(), bytes.end());
+        m_rpc_rx_bytes += bytes.size();
+        bytes = connection->rpc_rx_bytes;
+    }
+
+    size_t offset = 0;
+
+    while(bytes.size() - offset >= sizeof(RpcFrameHeader) && connection->rpc_in_flight_request_ids.size() < m_rpc_in_flight_limit)
+    {
+        RpcFrameHeader header;
+        std::memcpy(&header, bytes.data() + offset, sizeof(header));
+
+        if(header.payload_size > MAXIMUM_RPC_PAYLOAD_SIZE)
+        {
+            Print("NonBlockingSocketServer::DispatchRpcFrames() -> Frame of {" + std::to_string(header.payload_size) + "} bytes is too large, disconnecting client with file descriptor: {" + std::to_string(client_file_descriptor) + "}\n");
+            DisconnectClient(client_file_descriptor);
+            return false;
+        }
+
+        if(bytes.size() - offset - sizeof(header) < header.payload_size)
+        {
+            break;
+        }
+
+        const std::span<char> payload = bytes.subspan(offset + sizeof(header), header.payload_size);
+        offset += sizeof(header) + header.payload_size;
+        connection->rpc_in_flight_request_ids.emplace_back(header.request_id);
+
+        m_rpc_handler(ConnectionRef(*this, client_file_descriptor, connection->user_context), RpcRequest{client_file_descriptor, connection_id, header.request_id}, payload);
+
+        // look the client up again instead of trusting the pointer across a user callback
+        connection = FindConnection(client_file_descriptor);
+
+        if(connection == nullptr || connection->rpc_connection_id != connection_id)
+        {
+            return false;
+        }
+    }
+
+    if(is_held_back)
+    {
+        connection->rpc_rx_bytes.erase(connection->rpc_rx_bytes.begin(), connection->rpc_rx_bytes.begin() + offset);
+        m_rpc_rx_bytes -= offset;
+    }
+    else
+    {
+        connection->rpc_rx_bytes.assign(bytes.begin() + offset, bytes.end());
+        m_rpc_rx_bytes += bytes.size() - offset;
+    }
+
+    connection->is_rpc_paused = connection->rpc_in_flight_request_ids.size() >= m_rpc_in_flight_limit;
+
+    return true;
+}
+
+ssize_t NonBlockingSocketServer::ReadWithTimestamp(int client_file_descriptor, char* buffer, size_t size, timespec& kernel_timestamp)
+{
+    iovec io_vector { buffer, size };
+    alignas(cmsghdr) char control_buffer[CMSG_SPACE(sizeof(scm_timestamping))];
+
+    msghdr message {};
+    message.msg_iov = &io_vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control_buffer;
+    message.msg_controllen = sizeof(control_buffer);
+
+    const ssize_t bytes = recvmsg(client_file_descriptor, &message, 0);
+
+    for(cmsghdr* control_message = CMSG_FIRSTHDR(&message); bytes > 0 && control_message != nullptr; control_message = CMSG_NXTHDR(&message, control_message))
+    {
+        if(control_message->cmsg_level == SOL_SOCKET && control_message->cmsg_type == SO_TIMESTAMPING)
+        {
+            // the first entry is the software timestamp, the others are for hardware timestamps
+            scm_timestamping timestamps {};
+            memcpy(&timestamps, CMSG_DATA(control_message), sizeof(timestamps));
+            kernel_timestamp = timestamps.ts[0];
+        }
+    }
+
+    return bytes;
+}
+
+void NonBlockingSocketServer::ProcessTxMessages()
+{
+    for(Listener& listener : m_listeners)
+    {
+        if(listener.datagram_state != nullptr && not listener.datagram_state->tx_datagrams.empty())
+        {
+            SendDatagrams(listener);
+        }
+    }
+
+    if(m_pending_tx_file_descriptors.empty())
+    {
+        return;
+    }
+
+    // only connections with queued payloads are visited, so idle clients cost nothing here
+    std::vector<int> pending_tx_file_descriptors;
+    pending_tx_file_descriptors.swap(m_pending_tx_file_descriptors);
+
+    for(const int& client_file_descriptor : pending_tx_file_descriptors)
+    {
+        Connection* connection = FindConnection(client_file_descriptor);
+
+        if(connection == nullptr || not connection->is_tx_scheduled)
+        {
+            continue;
+        }
+
+        connection->is_tx_scheduled = false;
+        SendToClient(*connection);
+    }
+
+    // reuse the storage of the swapped out list on the next pass
+    pending_tx_file_descriptors.clear();
+
+    if(m_pending_tx_file_descriptors.empty())
+    {
+        m_pending_tx_file_descriptors.swap(pending_tx_file_descriptors);
+    }
+}
+
+void NonBlockingSocketServer::ProcessHeldTxMessages()
+{
+    if(m_held_tx_file_descriptors.empty())
+    {
+        return;
+    }
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    size_t kept_count = 0;
+
+    for(const int& client_file_descriptor : m_held_tx_file_descriptors)
+    {
+        Connection* connection = FindConnection(client_file_descriptor);
+
+        // the client was flushed early because it reached the threshold, or it has disconnected
+        if(connection == nullptr || not connection->is_tx_held)
+        {
+            continue;
+        }
+
+        if(connection->tx_flush_deadline > now)
+        {
+            m_held_tx_file_descriptors[kept_count++] = client_file_descriptor;
+            continue;
+        }
+
+        // the queue is still short, so schedule it directly rather than through ScheduleTx(), which would hold it again
+        connection->is_tx_held = false;
+
+        if(not connection->is_tx_scheduled && not connection->is_tx_blocked)
+        {
+            connection->is_tx_scheduled = true;
+            m_pending_tx_file_descriptors.emplace_back(client_file_descriptor);
+        }
+    }
+
+    m_held_tx_file_descriptors.resize(kept_count);
+
+    if(not m_held_tx_file_descriptors.empty())
+    {
+        ArmTxFlushTimer(m_connections[m_held_tx_file_descriptors.front()].tx_flush_deadline);
+    }
+}
+
+void NonBlockingSocketServer::ArmTxFlushTimer(std::chrono::steady_clock::time_point deadline)
+{
+    if(m_is_tx_flush_timer_armed)
+    {
+        return;
+    }
+
+    if(not ArmTimer(m_tx_flush_timer_file_descriptor, deadline))
+    {
+        perror("NonBlockingSocketServer::ArmTxFlushTimer() -> Failed to arm the tx flush timer");
+        return;
+    }
+
+    m_is_tx_flush_timer_armed = true;
+}
+
+void NonBlockingSocketServer::ProcessPostedMessages()
+{
+    PostedMessage* posted_message = m_posted_messages.exchange(nullptr, std::memory_order_acquire);
+
+    // the stack holds the newest message first, so reverse it to send in posting order
+    PostedMessage* reversed = nullptr;
+
+    while(posted_message != nullptr)
+    {
+        PostedMessage* next = posted_message->next;
+        posted_message->next = reversed;
+        reversed = posted_message;
+        posted_message = next;
+    }
+
+    while(reversed != nullptr)
+    {
+        PostedMessage* next = reversed->next;
+        Connection* connection = FindConnection(reversed->client_file_descriptor);
+        ++m_run_stats.posted_message_count;
+
+        if(connection != nullptr && (reversed->strand == nullptr || reversed->strand == connection->strand))
+        {
+            EnqueueSend(reversed->client_file_descriptor, reversed->payload, reversed->priority);
+        }
+
+        delete reversed;
+        reversed = next;
+    }
+}
+
+void NonBlockingSocketServer::ProcessAdoptedClients()
+{
+    AdoptedClient* adopted_client = m_adopted_clients.exchange(nullptr, std::memory_order_acquire);
+
+    while(adopted_client != nullptr)
+    {
+        AdoptedClient* next = adopted_client->next;
+        const int client_fd = adopted_client->client_file_descriptor;
+
+        if(m_server_state != ServerState::RUNNING || adopted_client->listener_index >= m_listeners.size() || m_client_file_descriptors.size() == m_client_limit)
+        {
+            Print("NonBlockingSocketServer::ProcessAdoptedClients() -> Rejected handed over client with file descriptor: {" + std::to_string(client_fd) + "}\n");
+            close(client_fd);
+        }
+        else
+        {
+            RegisterClient(client_fd, adopted_client->listener_index);
+        }
+
+        delete adopted_client;
+        adopted_client = next;
+    }
+}
+
+void NonBlockingSocketServer::ApplyCpuAffinity()
+{
+    m_is_cpu_affinity_pending = false;
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(m_cpu_affinity, &cpu_set);
+
+    const int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+
+    if(result != 0)
+    {
+        errno = result;
+        perror("NonBlockingSocketServer::ApplyCpuAffinity() -> Failed to pin the reactor thread");
+        return;
+    }
+
+    // Linux places a page on the NUMA node of the CPU that first writes to it, so fault the arena and the read buffers in from the pinned thread
+    m_huge_page_arena.Prefault();
+    m_buffer_pool.Reserve(PREFAULTED_READ_BUFFER_COUNT);
+
+    Print("NonBlockingSocketServer::ApplyCpuAffinity() -> Pinned the reactor thread to CPU {" + std::to_string(m_cpu_affinity) + "}\n");
+}
+
+void NonBlockingSocketServer::SignalQueuedWork()
+{
+    // a standalone loop and the run itself pick queued work up on their own, so only a nested server pays for the write
+    if(m_is_nested && not m_is_in_run && not m_is_queued_work_signalled)
+    {
+        m_is_queued_work_signalled = true;
+        WakeUp();
+    }
+}
+
+void NonBlockingSocketServer::WakeUp()
+{
+    if(m_wakeup_file_descriptor != -1)
+    {
+        const uint64_t increment = 1;
+        (void)write(m_wakeup_file_descriptor, &increment, sizeof(increment));
+    }
+}
+
+void NonBlockingSocketServer::ReclaimIdleMemory()
+{
+    m_next_reclamation_time = m_run_time + m_idle_reclamation_period;
+    const std::chrono::steady_clock::time_point idle_since = m_run_time - m_idle_reclamation_period;
+
+    for(const int& client_file_descriptor : m_client_file_descriptors)
+    {
+        Connection& connection = m_connections[client_file_descriptor];
+
+        if(connection.last_active_time > idle_since || HasTxMessages(connection))
+        {
+            continue;
+        }
+
+        connection.tx_high_water_bytes = 0;
+
+        if(connection.rpc_rx_bytes.empty())
+        {
+            connection.rpc_rx_bytes.shrink_to_fit();
+        }
+
+        // only the connection still refers to the strand, so no task of it is queued; the next dispatch starts a fresh one
+        if(connection.strand != nullptr && connection.strand.use_count() == 1)
+        {
+            connection.strand.reset();
+        }
+    }
+
+    // the read buffers a burst borrowed are all back in the pool between runs
+    const size_t released_bytes = m_buffer_pool.Trim(PREFAULTED_READ_BUFFER_COUNT);
+
+    const auto shrink_if_empty = [](auto& list)
+    {
+        if(list.empty())
+        {
+            list.shrink_to_fit();
+        }
+    };
+
+    shrink_if_empty(m_pending_tx_file_descriptors);
+    shrink_if_empty(m_held_tx_file_descriptors);
+    shrink_if_empty(m_rx_ready_file_descriptors);
+    shrink_if_empty(m_rx_ready_snapshot);
+    shrink_if_empty(m_rx_batch);
+    shrink_if_empty(m_rx_batch_buffers);
+
+    if(released_bytes != 0)
+    {
+        Print("NonBlockingSocketServer::ReclaimIdleMemory() -> Released " + std::to_string(released_bytes) + " bytes of read buffers.\n");
+    }
+}
+
+void NonBlockingSocketServer::EnforceMemoryBudget()
+{
+    // free read buffers are the cheapest memory to give back, because no client loses anything
+    m_buffer_pool.Trim(PREFAULTED_READ_BUFFER_COUNT);
+
+    if(GetBudgetedBytes() <= m_memory_budget)
+    {
+        return;
+    }
+
+    // the largest backlogs go first, so that as few clients as possible are lost
+    std::vector<int> client_file_descriptors = m_client_file_descriptors;
+
+    const auto get_backlog_bytes = [this](int client_file_descriptor)
+    {
+        return m_connections[client_file_descriptor].tx_queued_bytes + m_connections[client_file_descriptor].rpc_rx_bytes.size();
+    };
+
+    std::sort(client_file_descriptors.begin(), client_file_descriptors.end(), [&get_backlog_bytes](int left, int right)
+    {
+        return get_backlog_bytes(left) > get_backlog_bytes(right);
+    });
+
+    for(const int& client_file_descriptor : client_file_descriptors)
+    {
+        if(GetBudgetedBytes() <= m_memory_budget || get_backlog_bytes(client_file_descriptor) == 0)
+        {
+            break;
+        }
+
+        Print("NonBlockingSocketServer::EnforceMemoryBudget() -> Shedding client with file descriptor: {" + std::to_string(client_file_descriptor) + "} and "
+            + std::to_string(get_backlog_bytes(client_file_descriptor)) + " queued bytes.\n");
+        DisconnectClient(client_file_descriptor);
+        ++m_run_stats.shed_client_count;
+    }
+}
+
+size_t NonBlockingSocketServer::GetBudgetedBytes() const
+{
+    return m_tx_queued_bytes + m_rpc_rx_bytes + m_buffer_pool.GetReservedBytes();
+}
+
+bool NonBlockingSocketServer::HasRxTokens(const Connection& connection) const
+{
+    return (m_rx_byte_limit.rate <= 0 || connection.rx_byte_bucket.tokens > 0) && (m_rx_read_limit.rate <= 0 || connection.rx_read_bucket.tokens >= 1);
+}
+
+void NonBlockingSocketServer::PauseRx(Connection& connection)
+{
+    connection.is_rx_paused = true;
+    connection.rx_resume_time = m_run_time;
+
+    if(m_rx_byte_limit.rate > 0)
+    {
+        connection.rx_resume_time = std::max(connection.rx_resume_time, connection.rx_byte_bucket.GetRefillTime(m_rx_byte_limit, 1));
+    }
+
+    if(m_rx_read_limit.rate > 0)
+    {
+        connection.rx_resume_time = std::max(connection.rx_resume_time, connection.rx_read_bucket.GetRefillTime(m_rx_read_limit, 1));
+    }
+
+    // without EPOLLIN, more bytes from the client do not even wake the reactor; the doorbells of a shared memory client also unblock its tx, so they stay
+    if(connection.shared_memory == nullptr)
+    {
+        epoll_event client_epoll_events{};
+        client_epoll_events.events = EPOLLOUT | EPOLLET;
+        client_epoll_events.data.fd = connection.file_descriptor;
+
+        ++m_run_stats.syscall_counts.epoll_ctl_count;
+
+        if(epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_MOD, connection.file_descriptor, &client_epoll_events) == -1)
+        {
+            perror("NonBlockingSocketServer::PauseRx() -> Failed to pause reading from client");
+        }
+    }
+
+    m_rx_paused_file_descriptors.emplace_back(connection.file_descriptor);
+    ArmRateLimitTimer(connection.rx_resume_time);
+
+    Print("NonBlockingSocketServer::PauseRx() -> Paused reading from client with file descriptor: {" + std::to_string(connection.file_descriptor) + "}\n");
+}
+
+void NonBlockingSocketServer::PauseAccept(Listener& listener)
+{
+    listener.is_accept_paused = true;
+    listener.accept_resume_time = listener.accept_bucket.GetRefillTime(m_accept_limit, 1);
+
+    // the listener is level-triggered, so it has to leave the ready set entirely or it would keep waking the reactor for the clients in its backlog
+    epoll_event listener_epoll_events{};
+    listener_epoll_events.data.fd = listener.file_descriptor;
+
+    ++m_run_stats.syscall_counts.epoll_ctl_count;
+
+    if(epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_MOD, listener.file_descriptor, &listener_epoll_events) == -1)
+    {
+        perror("NonBlockingSocketServer::PauseAccept() -> Failed to pause accepting clients");
+    }
+
+    ArmRateLimitTimer(listener.accept_resume_time);
+
+    Print("NonBlockingSocketServer::PauseAccept() -> Paused accepting clients on listener with file descriptor: {" + std::to_string(listener.file_descriptor) + "}\n");
+}
+
+void NonBlockingSocketServer::ResumeRateLimited()
+{
+    std::chrono::steady_clock::time_point next_resume_time = std::chrono::steady_clock::time_point::max();
+
+    for(Listener& listener : m_listeners)
+    {
+        if(not listener.is_accept_paused)
+        {
+            continue;
+        }
+
+        if(listener.accept_resume_time > m_run_time)
+        {
+            next_resume_time = std::min(next_resume_time, listener.accept_resume_time);
+            continue;
+        }
+
+        listener.is_accept_paused = false;
+
+        epoll_event listener_epoll_events{};
+        listener_epoll_events.events = EPOLLIN;
+        listener_epoll_events.data.fd = listener.file_descriptor;
+
+        ++m_run_stats.syscall_counts.epoll_ctl_count;
+
+        if(epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_MOD, listener.file_descriptor, &listener_epoll_events) == -1)
+        {
+            perror("NonBlockingSocketServer::ResumeRateLimited() -> Failed to resume accepting clients");
+        }
+    }
+
+    // reading a resumed client may pause it again, which appends to the paused list
+    std::vector<int> paused_file_descriptors;
+    paused_file_descriptors.swap(m_rx_paused_file_descriptors);
+
+    for(const int& client_file_descriptor : paused_file_descriptors)
+    {
+        Connection* connection = FindConnection(client_file_descriptor);
+
+        // the client may have disconnected, and its file descriptor may even belong to a new client by now
+        if(connection == nullptr || not connection->is_rx_paused)
+        {
+            continue;
+        }
+
+        if(connection->rx_resume_time > m_run_time)
+        {
+            m_rx_paused_file_descriptors.emplace_back(client_file_descriptor);
+            next_resume_time = std::min(next_resume_time, connection->rx_resume_time);
+            continue;
+        }
+
+        connection->is_rx_paused = false;
+
+        if(connection->shared_memory == nullptr)
+        {
+            epoll_event client_epoll_events{};
+            client_epoll_events.events = EPOLLIN | EPOLLOUT | EPOLLET;
+            client_epoll_events.data.fd = client_file_descriptor;
+
+            ++m_run_stats.syscall_counts.epoll_ctl_count;
+
+            if(epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_MOD, client_file_descriptor, &client_epoll_events) == -1)
+            {
+                perror("NonBlockingSocketServer::ResumeRateLimited() -> Failed to resume reading from client");
+            }
+        }
+
+        // bytes that arrived while the client was paused raised no event, so read them now; a client on the ready list gets its turn there
+        if(not connection->is_rx_ready)
+        {
+            HandleNonBlockingRead(client_file_descriptor);
+        }
+    }
+
+    if(next_resume_time != std::chrono::steady_clock::time_point::max())
+    {
+        ArmRateLimitTimer(next_resume_time);
+    }
 }
 
-void NonBlockingSocketServer::ProcessEpollEvent()
+void NonBlockingSocketServer::ArmRateLimitTimer(std::chrono::steady_clock::time_point deadline)
 {
-    if(m_server_state == ServerState::CLOSING)
+    // one timer serves every paused client and listener, so it only has to move when the new deadline is earlier
+    if(m_rate_limit_timer_deadline != std::chrono::steady_clock::time_point{} && m_rate_limit_timer_deadline <= deadline)
     {
-        CloseServer();
         return;
     }
 
-    epoll_event events[MAXIMUM_EPOLL_EVENTS];
+    if(not ArmTimer(m_rate_limit_timer_file_descriptor, deadline))
+    {
+        perror("NonBlockingSocketServer::ArmRateLimitTimer() -> Failed to arm the rate limit timer");
+        return;
+    }
 
-    const int event_count = epoll_wait(m_server_epoll_file_descriptor, events, MAXIMUM_EPOLL_EVENTS, m_blocking_timeout.count());
+    m_rate_limit_timer_deadline = deadline;
+}
 
-    if(event_count == -1)
+void NonBlockingSocketServer::TokenBucket::Refill(const RateLimit& limit, std::chrono::steady_clock::time_point now)
+{
+    if(now <= refill_time)
     {
-        perror("NonBlockingSocketServer::ProcessEpollEvent() -> Triggered events were erroneous.");
         return;
     }
-    
-    for (int i = 0; i < event_count; ++i) 
+
+    const std::chrono::duration<double> elapsed_time = now - refill_time;
+    tokens = std::min(limit.burst, tokens + limit.rate * elapsed_time.count());
+    refill_time = now;
+}
+
+std::chrono::steady_clock::time_point NonBlockingSocketServer::TokenBucket::GetRefillTime(const RateLimit& limit, double token_count) const
+{
+    if(tokens >= token_count)
     {
-        // if the event file descriptor is the server's, then a client has connected
-        if (events[i].data.fd == m_server_socket_file_descriptor) 
-        {
-            AcceptClient();
-        } 
-        // if the event is for a client file descriptor, then handle it here
-        else 
-        {
-            HandleNonBlockingRead(events[i].data.fd);
-        }
+        return refill_time;
     }
+
+    const std::chrono::duration<double> wait_time ((token_count - tokens) / limit.rate);
+
+    return refill_time + std::chrono::ceil<std::chrono::steady_clock::duration>(wait_time);
 }
 
-void NonBlockingSocketServer::CloseServer()
+void NonBlockingSocketServer::DispatchToWorker(Connection& connection, const std::span<char>& bytes, std::chrono::nanoseconds rx_queue_delay)
 {
-    for(const auto& client_fd : m_client_file_descriptors)
+    if(connection.strand == nullptr)
     {
-        DisconnectClient(client_fd);
+        connection.strand = std::make_shared<Strand>(*m_worker_pool);
     }
 
-    close(m_server_socket_file_descriptor);
+    // the read buffer is reused by the next read, so the worker gets its own copy of the bytes; the user context stays behind, as the DisconnectCallback may free it before the task runs
+    connection.strand->Post([this, connection_ref = ConnectionRef(*this, connection.file_descriptor, nullptr), payload = std::vector<char>(bytes.begin(), bytes.end()), rx_queue_delay]() mutable
+    {
+        const std::span<char> payload_view (payload.begin(), payload.end());
+        t_dispatching_server = this;
+        t_dispatching_client_file_descriptor = connection_ref.GetFileDescriptor();
+        m_rx_callback(connection_ref, payload_view, rx_queue_delay);
+        t_dispatching_server = nullptr;
+        t_dispatching_client_file_descriptor = -1;
+    });
+}
+
+void NonBlockingSocketServer::SendToClient(Connection& connection)
+{
+    const int client_file_descriptor = connection.file_descriptor;
+    connection.is_tx_held = false;
+    connection.last_active_time = m_run_time;
 
-    m_client_file_descriptors.clear();
+    while(HasTxMessages(connection))
+    {
+        // gather as many queued messages as fit into one call, so that a burst of small messages costs one system call
+        iovec io_vectors[MAXIMUM_TX_IO_VECTORS];
+        uint8_t io_vector_priorities[MAXIMUM_TX_IO_VECTORS];
+        size_t io_vector_count = 0;
+        TxMessage* cursors[TX_PRIORITY_COUNT];
+        uint32_t skipped_counts[TX_PRIORITY_COUNT];
+
+        // the starvation guard plays the batch through on a copy of the counts, which only change for messages that are actually written
+        for(size_t priority_index = 0; priority_index < TX_PRIORITY_COUNT; ++priority_index)
+        {
+            cursors[priority_index] = connection.tx_queues[priority_index].head;
+            skipped_counts[priority_index] = connection.tx_queues[priority_index].skipped_count;
+        }
 
-    m_server_state = ServerState::CLOSED;
+        // a partly sent message has to be finished first, classes only change at message boundaries
+        if(connection.tx_bytes_sent != 0)
+        {
+            TxMessage* tx_message = cursors[connection.tx_sending_priority];
+            io_vectors[io_vector_count] = iovec{tx_message->Data() + connection.tx_bytes_sent, tx_message->size - connection.tx_bytes_sent};
+            io_vector_priorities[io_vector_count++] = connection.tx_sending_priority;
+            cursors[connection.tx_sending_priority] = tx_message->next;
+        }
+
+        size_t priority_index = 0;
+
+        while(io_vector_count < MAXIMUM_TX_IO_VECTORS && (priority_index = PickTxPriority(cursors, skipped_counts)) < TX_PRIORITY_COUNT)
+        {
+            TxMessage* tx_message = cursors[priority_index];
+            io_vectors[io_vector_count] = iovec{tx_message->Data(), tx_message->size};
+            io_vector_priorities[io_vector_count++] = priority_index;
+            cursors[priority_index] = tx_message->next;
+        }
+
+        const bool has_ungathered_messages = std::any_of(std::begin(cursors), std::end(cursors), [](const TxMessage* cursor){ return cursor != nullptr; });
+
+        // sendmsg() rather than writev(), because only the former takes MSG_NOSIGNAL
+        msghdr message {};
+        message.msg_iov = io_vectors;
+        message.msg_iovlen = io_vector_count;
+
+        // when the queue did not fit into one call, tell TCP that more follows right away so that it does not push out a short segment in between
+        m_run_stats.syscall_counts.send_count += connection.shared_memory == nullptr ? 1 : 0;
+        const ssize_t sent_bytes = connection.shared_memory != nullptr ? WriteSharedMemory(connection, io_vectors, io_vector_count)
+            : sendmsg(client_file_descriptor, &message, has_ungathered_messages ? MSG_NOSIGNAL | MSG_MORE : MSG_NOSIGNAL);
+
+        if(sent_bytes == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            // the socket buffer is full, so keep the remainder queued until epoll reports the client is writable again
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                connection.is_tx_blocked = true;
+                return;
+            }
+
+            DisconnectClient(client_file_descriptor);
+            return;
+        }
+
+        size_t unaccounted_bytes = sent_bytes;
+        m_run_stats.sent_bytes += sent_bytes;
+
+        // a partial send can end anywhere, so walk the gathered messages to find out which went out completely
+        for(size_t io_vector_index = 0; io_vector_index < io_vector_count; ++io_vector_index)
+        {
+            const uint8_t priority = io_vector_priorities[io_vector_index];
+            TxMessage& tx_message = *connection.tx_queues[priority].head;
+            const size_t message_bytes = std::min(unaccounted_bytes, tx_message.size - connection.tx_bytes_sent);
+
+            if(m_traffic_recorder != nullptr && message_bytes != 0)
+            {
+                m_traffic_recorder->Record(TrafficEventType::SEND, client_file_descriptor, std::span<const char>(tx_message.Data() + connection.tx_bytes_sent, message_bytes));
+            }
+
+            connection.tx_bytes_sent += message_bytes;
+            unaccounted_bytes -= message_bytes;
+
+            if(connection.tx_bytes_sent != tx_message.size)
+            {
+                connection.tx_sending_priority = priority;
+                break;
+            }
+
+            // a message that went out counts against every lower class still waiting
+            connection.tx_queues[priority].skipped_count = 0;
+
+            for(size_t priority_index = priority + 1; priority_index < TX_PRIORITY_COUNT; ++priority_index)
+            {
+                if(connection.tx_queues[priority_index].head != nullptr)
+                {
+                    ++connection.tx_queues[priority_index].skipped_count;
+                }
+            }
+
+            PopTxMessage(connection, priority);
+            ++m_run_stats.sent_message_count;
+        }
+    }
 }
 
-void NonBlockingSocketServer::DisconnectClient(int client_file_descriptor)
+void NonBlockingSocketServer::ScheduleTx(Connection& connection)
 {
-    // remove the client's file descriptor from epoll to avoid dead file descriptor issues
-    epoll_ctl(m_server_epoll_file_descriptor, EPOLL_CTL_DEL, client_file_descriptor, nullptr);
-    // close the client file descriptor
-    close(client_file_descriptor);
-    
-    for(auto it = m_client_file_descriptors.begin(); it != m_client_file_descriptors.end(); ++it)
+    // a blocked connection is flushed again once epoll reports that it is writable
+    if(connection.is_tx_scheduled || connection.is_tx_blocked)
+    {
+        return;
+    }
+
+    // hold a short queue back in the hope that more payloads join it, but never past the deadline of its first payload
+    if(m_tx_flush_delay.count() > 0 && connection.tx_queued_bytes < m_tx_coalescing_threshold)
     {
-        if(*it == client_file_descriptor)
+        if(not connection.is_tx_held)
         {
-            m_client_file_descriptors.erase(it);
-            break;
+            connection.is_tx_held = true;
+            connection.tx_flush_deadline = std::chrono::steady_clock::now() + m_tx_flush_delay;
+            m_held_tx_file_descriptors.emplace_back(connection.file_descriptor);
+            ArmTxFlushTimer(connection.tx_flush_deadline);
         }
+
+        return;
     }
 
-    m_disconnect_callback(client_file_descriptor);
-    Print("NonBlockingSocketServer::DisconnectClient() -> Disconnected client with file descriptor: {" + std::to_string(client_file_descriptor) + "}\n");
+    connection.is_tx_scheduled = true;
+    m_pending_tx_file_descriptors.emplace_back(connection.file_descriptor);
+    SignalQueuedWork();
 }
 
-void NonBlockingSocketServer::HandleNonBlockingRead(int client_file_descriptor)
+size_t NonBlockingSocketServer::PickTxPriority(TxMessage* const (&cursors)[TX_PRIORITY_COUNT], uint32_t (&skipped_counts)[TX_PRIORITY_COUNT]) const
 {
-    std::vector<char> read_buffer(MAXIMUM_EPOLL_EVENTS);
+    size_t picked_index = 0;
 
-    // loop until there is nothing left to read
-    while(true)
+    while(picked_index < TX_PRIORITY_COUNT && cursors[picked_index] == nullptr)
     {
-        const ssize_t bytes = read(client_file_descriptor, read_buffer.data(), read_buffer.size());
+        ++picked_index;
+    }
 
-        if(bytes == -1)
+    if(picked_index == TX_PRIORITY_COUNT)
+    {
+        return TX_PRIORITY_COUNT;
+    }
+
+    // the highest class goes first, unless a lower one has been passed over too often
+    if(m_tx_starvation_guard != 0)
+    {
+        for(size_t priority_index = picked_index + 1; priority_index < TX_PRIORITY_COUNT; ++priority_index)
         {
-            // stop reading if the non-blocking socket reports there is nothing left to read or there is an error
-            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EBADF)
+            if(cursors[priority_index] != nullptr && skipped_counts[priority_index] >= m_tx_starvation_guard)
             {
-                perror("NonBlockingSocketServer::ProcessEpollEvent() -> Done reading: ");
+                picked_index = priority_index;
                 break;
             }
         }
+    }
 
-        if(bytes == 0)
+    skipped_counts[picked_index] = 0;
+
+    for(size_t priority_index = picked_index + 1; priority_index < TX_PRIORITY_COUNT; ++priority_index)
+    {
+        if(cursors[priority_index] != nullptr)
         {
-            DisconnectClient(client_file_descriptor);
+            ++skipped_counts[priority_index];
         }
-        else if (bytes > 0) 
-        {
-            std::vector<char> rx_payload(read_buffer.data(), read_buffer.data() + bytes);
-            std::span<char> rx_payload_view (rx_payload.begin(), rx_payload.end());
-            Print("NonBlockingSocketServer::ProcessEpollEvent() -> Received payload from client file descriptor: {" + std::to_string(client_file_descriptor) + "}, payload: {" + std::string(rx_payload.data(), rx_payload.size()) + "}\n");
-            m_rx_callback(client_file_descriptor,rx_payload_view);
-            continue;
-        } 
     }
+
+    return picked_index;
 }
 
-void NonBlockingSocketServer::ProcessTxMessages()
+size_t NonBlockingSocketServer::FanOut(const std::vector<int>& client_file_descriptors, std::span<const char> bytes, TxPriority priority)
 {
-    if(m_tx_messages.empty())
+    if(client_file_descriptors.empty())
     {
-        return;
+        return 0;
     }
 
-    const TxMessage next_tx_message = m_tx_messages.front();
-    m_tx_messages.pop_front();
+    // copy the payload once; every recipient only gets a small message header that points at it
+    void* memory = m_memory_resource->allocate(sizeof(SharedPayload) + bytes.size(), alignof(SharedPayload));
+    SharedPayload* shared_payload = new (memory) SharedPayload{1, bytes.size()};
+    std::memcpy(shared_payload->Data(), bytes.data(), bytes.size());
+    m_tx_queued_bytes += bytes.size();
 
-    for(const int& client_file_descriptor : m_client_file_descriptors)
+    size_t recipient_count = 0;
+
+    for(const int& client_file_descriptor : client_file_descriptors)
     {
-        if(next_tx_message.client_file_descriptor == client_file_descriptor)
+        Connection* connection = FindConnection(client_file_descriptor);
+
+        if(connection == nullptr)
         {
-            SendToClient(next_tx_message);
-            break;
+            continue;
         }
+
+        PushSharedTxMessage(*connection, shared_payload, priority);
+        ScheduleTx(*connection);
+        ++recipient_count;
     }
+
+    // drop the reference held while fanning out, which frees the payload if nobody took it
+    ReleaseSharedPayload(shared_payload);
+
+    return recipient_count;
+}
+
+void NonBlockingSocketServer::PushTxMessage(Connection& connection, std::span<const char> bytes, TxPriority priority)
+{
+    std::memcpy(AppendTxBytes(connection, bytes.size(), priority), bytes.data(), bytes.size());
 }
 
-void NonBlockingSocketServer::SendToClient(const TxMessage &tx_message)
+char* NonBlockingSocketServer::AppendTxBytes(Connection& connection, size_t size, TxPriority priority)
 {
-    ssize_t total_bytes_sent = 0;
+    TxMessage* tx_tail = connection.tx_queues[static_cast<size_t>(priority)].tail;
 
-    while(total_bytes_sent < tx_message.payload.size())
+    // a small payload joins the coalescing block at the tail of the queue while it has room, so that it goes out contiguously with its predecessors
+    if(size < m_tx_coalescing_threshold && tx_tail != nullptr && tx_tail->size + size <= tx_tail->coalescing_capacity)
     {
-        const ssize_t sent_bytes = send(tx_message.client_file_descriptor, tx_message.payload.data() + total_bytes_sent, tx_message.payload.size() - total_bytes_sent,0);
+        char* destination = tx_tail->Data() + tx_tail->size;
+        tx_tail->size += size;
+        AddTxQueuedBytes(connection, size, true);
+        return destination;
+    }
 
-        // if sent_bytes is -1, ether consider it an error and exit or wait for the socket to be ready to send, depending on errno
-        if(sent_bytes == -1)
+    // header and payload share one allocation, which the pool arena serves from a recycled block of the matching size
+    const uint32_t coalescing_capacity = size < m_tx_coalescing_threshold ? m_tx_coalescing_threshold : 0;
+    void* memory = m_memory_resource->allocate(sizeof(TxMessage) + std::max<size_t>(size, coalescing_capacity), alignof(TxMessage));
+    TxMessage* tx_message = new (memory) TxMessage{nullptr, size};
+    tx_message->coalescing_capacity = coalescing_capacity;
+
+    LinkTxMessage(connection, tx_message, priority);
+
+    return tx_message->Data();
+}
+
+void NonBlockingSocketServer::PushSharedTxMessage(Connection& connection, SharedPayload* shared_payload, TxPriority priority)
+{
+    void* memory = m_memory_resource->allocate(sizeof(TxMessage), alignof(TxMessage));
+    TxMessage* tx_message = new (memory) TxMessage{nullptr, shared_payload->size, shared_payload};
+    ++shared_payload->reference_count;
+
+    LinkTxMessage(connection, tx_message, priority);
+}
+
+void NonBlockingSocketServer::PushOwnedTxMessage(Connection& connection, std::vector<char>&& bytes, TxPriority priority)
+{
+    // the vector object lives right behind the header, its bytes stay where the caller allocated them
+    void* memory = m_memory_resource->allocate(sizeof(TxMessage) + sizeof(std::vector<char>), alignof(TxMessage));
+    TxMessage* tx_message = new (memory) TxMessage{nullptr, bytes.size()};
+    tx_message->is_owned_payload = true;
+    new (tx_message->GetOwnedPayload()) std::vector<char>(std::move(bytes));
+
+    LinkTxMessage(connection, tx_message, priority);
+}
+
+void NonBlockingSocketServer::LinkTxMessage(Connection& connection, TxMessage* tx_message, TxPriority priority)
+{
+    TxQueue& tx_queue = connection.tx_queues[static_cast<size_t>(priority)];
+
+    if(tx_queue.tail == nullptr)
+    {
+        tx_queue.head = tx_message;
+    }
+    else
+    {
+        tx_queue.tail->next = tx_message;
+    }
+
+    tx_queue.tail = tx_message;
+    AddTxQueuedBytes(connection, tx_message->size, tx_message->shared_payload == nullptr);
+}
+
+void NonBlockingSocketServer::AddTxQueuedBytes(Connection& connection, size_t size, bool is_owned)
+{
+    connection.tx_queued_bytes += size;
+    connection.tx_high_water_bytes = std::max(connection.tx_high_water_bytes, connection.tx_queued_bytes);
+
+    // a shared payload is counted once, when it is allocated, however many clients it is queued for
+    if(is_owned)
+    {
+        m_tx_queued_bytes += size;
+    }
+}
+
+void NonBlockingSocketServer::PopTxMessage(Connection& connection, size_t priority_index)
+{
+    TxQueue& tx_queue = connection.tx_queues[priority_index];
+    TxMessage* tx_message = tx_queue.head;
+    tx_queue.head = tx_message->next;
+
+    if(tx_queue.head == nullptr)
+    {
+        tx_queue.tail = nullptr;
+        tx_queue.skipped_count = 0;
+    }
+
+    connection.tx_bytes_sent = 0;
+    connection.tx_queued_bytes -= tx_message->size;
+
+    if(tx_message->shared_payload != nullptr)
+    {
+        ReleaseSharedPayload(tx_message->shared_payload);
+    }
+    else
+    {
+        m_tx_queued_bytes -= tx_message->size;
+    }
+
+    if(tx_message->is_owned_payload)
+    {
+        std::destroy_at(tx_message->GetOwnedPayload());
+    }
+
+    m_memory_resource->deallocate(tx_message, tx_message->GetAllocationSize(), alignof(TxMessage));
+}
+
+void NonBlockingSocketServer::ReleaseSharedPayload(SharedPayload* shared_payload)
+{
+    if(--shared_payload->reference_count == 0)
+    {
+        m_tx_queued_bytes -= shared_payload->size;
+        m_memory_resource->deallocate(shared_payload, shared_payload->GetAllocationSize(), alignof(SharedPayload));
+    }
+}
+
+void NonBlockingSocketServer::ClearTxMessages(Connection& connection)
+{
+    for(size_t priority_index = 0; priority_index < TX_PRIORITY_COUNT; ++priority_index)
+    {
+        while(connection.tx_queues[priority_index].head != nullptr)
         {
-            if(errno == EAGAIN || errno == EWOULDBLOCK)
-            {
-                continue;
-            }
-            else if(errno == EBADF)
-            {
-                DisconnectClient(tx_message.client_file_descriptor);
-                return;
-            }
+            PopTxMessage(connection, priority_index);
         }
-        else if(sent_bytes > 0)
+    }
+}
+
+bool NonBlockingSocketServer::HasTxMessages(const Connection& connection)
+{
+    for(const TxQueue& tx_queue : connection.tx_queues)
+    {
+        if(tx_queue.head != nullptr)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+char* NonBlockingSocketServer::TxMessage::Data()
+{
+    if(shared_payload != nullptr)
+    {
+        return shared_payload->Data();
+    }
+
+    return is_owned_payload ? GetOwnedPayload()->data() : reinterpret_cast<char*>(this + 1);
+}
+
+std::vector<char>* NonBlockingSocketServer::TxMessage::GetOwnedPayload()
+{
+    return is_owned_payload ? reinterpret_cast<std::vector<char>*>(this + 1) : nullptr;
+}
+
+const std::vector<char>* NonBlockingSocketServer::TxMessage::GetOwnedPayload() const
+{
+    return is_owned_payload ? reinterpret_cast<const std::vector<char>*>(this + 1) : nullptr;
+}
+
+size_t NonBlockingSocketServer::TxMessage::GetAllocationSize() const
+{
+    if(shared_payload != nullptr)
+    {
+        return sizeof(TxMessage);
+    }
+
+    if(is_owned_payload)
+    {
+        return sizeof(TxMessage) + sizeof(std::vector<char>);
+    }
+
+    return sizeof(TxMessage) + std::max<size_t>(size, coalescing_capacity);
+}
+
+char* NonBlockingSocketServer::SharedPayload::Data()
+{
+    return reinterpret_cast<char*>(this + 1);
+}
+
+size_t NonBlockingSocketServer::SharedPayload::GetAllocationSize() const
+{
+    return sizeof(SharedPayload) + size;
+}
+
+NonBlockingSocketServer::Listener* NonBlockingSocketServer::FindListener(int file_descriptor, size_t& listener_index)
+{
+    // there are only ever a handful of listeners, so a linear search is cheapest
+    for(listener_index = 0; listener_index < m_listeners.size(); ++listener_index)
+    {
+        if(m_listeners[listener_index].file_descriptor == file_descriptor)
         {
-            total_bytes_sent += sent_bytes;
+            return &m_listeners[listener_index];
         }
     }
+
+    return nullptr;
+}
+
+NonBlockingSocketServer::Connection* NonBlockingSocketServer::FindConnection(int client_file_descriptor)
+{
+    if(client_file_descriptor < 0 || static_cast<size_t>(client_file_descriptor) >= m_connections.size())
+    {
+        return nullptr;
+    }
+
+    Connection& connection = m_connections[client_file_descriptor];
+
+    return connection.file_descriptor == client_file_descriptor ? &connection : nullptr;
 }
 
 void NonBlockingSocketServer::Print(const std::string& log)
@@ -11,6 +11,20 @@
 #include <chrono>
 #include <functional>
 #include <span>
+#include <memory_resource>
+#include <vector>
+#include <variant>
+#include <atomic>
+#include <memory>
+#include "buffer_pool.h"
+#include "huge_page_arena.h"
+#include "perf_counters.h"
+#include "socket_options.h"
+#include "worker_pool.h"
+#include "topic_subscriptions.h"
+#include "traffic_recorder.h"
+#include "latency_histogram.h"
+#include "shared_memory_transport.h"
 
 namespace InterProcessCommunication
 {
@@ -25,19 +39,249 @@ public:
         CLOSING
     };
 
+    /*
+        An IPv6 listener is created when "ip_address" is an IPv6 address, such as "::1".
+    */
     struct TcpEndpoint
     {
         std::string ip_address;
         uint16_t port;
     };
 
-    using RxCallback = std::function<void(int client_file_descriptor, const std::span<char>& bytes)>;
-    using ConnectCallback = std::function<void(int client_file_descriptor)>;
-    using DisconnectCallback = std::function<void(int client_file_descriptor)>;
+    /*
+        An abstract Unix domain socket lives in the Linux abstract namespace and does not create a file at "path".
+        With a non-zero "shared_memory_ring_size", every client of the endpoint gets a pair of rings of that size in shared memory, and has to connect with a SharedMemoryClient.
+        Its bytes then bypass the socket, which only carries wakeups and the hangup, while the RxCallback and EnqueueSend() work as for any other client.
+    */
+    struct UnixEndpoint
+    {
+        std::string path;
+        bool is_abstract = false;
+        size_t shared_memory_ring_size = 0;
+    };
+
+    /*
+        A datagram listener. It has no connections: peers are identified by their address, and datagrams go to the DatagramCallback.
+    */
+    struct UdpEndpoint
+    {
+        std::string ip_address;
+        uint16_t port;
+    };
+
+    /*
+        A socket that someone else has already bound, such as a supervisor that keeps the port open across restarts, or systemd socket activation.
+        Start() checks that it is a bound TCP, Unix domain or UDP socket and takes it over as it is: it is not bound again, and listener socket options are not applied.
+        The server owns the file descriptor from then on and closes it when it closes.
+    */
+    struct InheritedEndpoint
+    {
+        int file_descriptor = -1;
+    };
+
+    using ListenerEndpoint = std::variant<TcpEndpoint, UnixEndpoint, UdpEndpoint, InheritedEndpoint>;
 
-    ~NonBlockingSocketServer() = default;
-    NonBlockingSocketServer(const std::string& unix_socket_path, size_t client_limit = DEFAULT_CLIENT_LIMIT, std::chrono::milliseconds blocking_timeout = DEFAULT_BLOCKING_TIMEOUT, bool is_verbose = false);
-    NonBlockingSocketServer(const TcpEndpoint& tcp_endpoint, size_t client_limit = DEFAULT_CLIENT_LIMIT, std::chrono::milliseconds blocking_timeout = DEFAULT_BLOCKING_TIMEOUT, bool is_verbose = false);
+    /*
+        The address a datagram came from, and the address to send a datagram to.
+    */
+    struct DatagramPeer
+    {
+        sockaddr_storage address {};
+        socklen_t address_size = 0;
+
+        bool operator==(const DatagramPeer& other) const;
+        std::string ToString() const;
+    };
+
+    /*
+        Every client has one tx queue per priority class. Higher classes are sent first, switching classes only at message boundaries.
+    */
+    enum class TxPriority : uint8_t
+    {
+        CONTROL,
+        NORMAL,
+        BULK
+    };
+
+    /*
+        A token bucket that refills at "rate" tokens per second and saves up at most "burst" of them. A zero rate means no limit.
+    */
+    struct RateLimit
+    {
+        double rate = 0;
+        double burst = 0;
+    };
+
+    /*
+        The header of every frame of the RPC layer, in host byte order, followed by "payload_size" bytes of payload. A response carries the request id of its request.
+    */
+    struct RpcFrameHeader
+    {
+        uint32_t payload_size = 0;
+        uint32_t reserved = 0;
+        uint64_t request_id = 0;
+    };
+
+    /*
+        A request that the RpcHandler was given and that waits for its response. The connection id tells it apart from a request of an earlier client with the same file descriptor.
+    */
+    struct RpcRequest
+    {
+        int client_file_descriptor = -1;
+        uint64_t connection_id = 0;
+        uint64_t request_id = 0;
+    };
+
+    /*
+        A breakdown of the user-space memory held by the server, in bytes.
+    */
+    struct MemoryUsage
+    {
+        size_t connection_count = 0;
+        size_t connection_table_bytes = 0;
+        size_t client_list_bytes = 0;
+        size_t tx_queue_bytes = 0;
+        size_t buffer_pool_reserved_bytes = 0;
+        size_t buffer_pool_borrowed_bytes = 0;
+        size_t datagram_bytes = 0;
+        size_t rpc_bytes = 0; // partial RPC frames held back until their rest arrives, and the ids of the requests in flight
+        size_t arena_capacity_bytes = 0; // the huge page arena's mapping, which the categories above are carved from, so the total leaves it out
+        size_t arena_used_bytes = 0;
+
+        size_t GetTotalBytes() const;
+    };
+
+    /*
+        System calls the event loop made, by kind, whether they moved bytes or not. Reads include recv(), recvmsg() and recvmmsg() as well as
+        acknowledging the wakeup and timer file descriptors; sends include sendmsg() and sendmmsg().
+    */
+    struct SyscallCounts
+    {
+        size_t epoll_wait_count = 0;
+        size_t read_count = 0;
+        size_t send_count = 0;
+        size_t accept_count = 0;
+        size_t epoll_ctl_count = 0;
+
+        size_t GetTotal() const;
+        SyscallCounts& operator+=(const SyscallCounts& other);
+    };
+
+    /*
+        The work one or more passes of the event loop did.
+    */
+    struct RunStats
+    {
+        size_t event_count = 0;
+        size_t accepted_client_count = 0;
+        size_t disconnected_client_count = 0;
+        size_t received_bytes = 0;
+        size_t read_count = 0;
+        size_t posted_message_count = 0;
+        size_t sent_bytes = 0;
+        size_t sent_message_count = 0;
+        size_t shed_client_count = 0; // clients refused or disconnected because the memory budget was exceeded
+        SyscallCounts syscall_counts;
+        PerfSample perf_counts; // only with EnablePerfCounters()
+
+        bool IsIdle() const;
+        RunStats& operator+=(const RunStats& other);
+    };
+
+    /*
+        The client a callback is about. It converts to the client's file descriptor, so callbacks that take a plain int keep working.
+        The user context is one pointer per connection that the application sets, usually in the ConnectCallback, and gets back in every later callback without a lookup of its own.
+        A ConnectionRef is a snapshot: a context that is set later through another ref does not show up in it.
+        RxCallbacks that run on workers get no context, because the DisconnectCallback may free it while their payload is still queued.
+    */
+    class ConnectionRef
+    {
+    public:
+
+        operator int() const;
+        int GetFileDescriptor() const;
+        void* GetUserContext() const;
+
+        template<typename T>
+        T* GetUserContext() const
+        {
+            return static_cast<T*>(m_user_context);
+        }
+
+        /*
+            Only on the thread that calls Run(). Ignored once the client has disconnected.
+        */
+        void SetUserContext(void* user_context);
+
+    private:
+
+        friend class NonBlockingSocketServer;
+
+        ConnectionRef(NonBlockingSocketServer& server, int client_file_descriptor, void* user_context);
+
+        NonBlockingSocketServer* m_server;
+        int m_file_descriptor;
+        void* m_user_context;
+    };
+
+    using RxCallback = std::function<void(ConnectionRef connection, const std::span<char>& bytes)>;
+    using TimestampedRxCallback = std::function<void(ConnectionRef connection, const std::span<char>& bytes, std::chrono::nanoseconds rx_queue_delay)>;
+    using ConnectCallback = std::function<void(ConnectionRef connection)>;
+    using ListenerConnectCallback = std::function<void(ConnectionRef connection, size_t listener_index)>;
+    using DisconnectCallback = std::function<void(ConnectionRef connection)>;
+
+    /*
+        Bytes received from one client in one read. The bytes are only valid until the RxBatchCallback returns.
+    */
+    struct RxRecord
+    {
+        int client_file_descriptor = -1;
+        std::span<char> bytes;
+        std::chrono::nanoseconds rx_queue_delay {};
+        void* user_context = nullptr;
+    };
+
+    using DatagramCallback = std::function<void(size_t listener_index, const DatagramPeer& peer, const std::span<char>& bytes)>;
+    using RxBatchCallback = std::function<void(std::span<const RxRecord> records)>;
+    using BatchEndCallback = std::function<void()>;
+    using RpcHandler = std::function<void(ConnectionRef connection, const RpcRequest& request, const std::span<char>& payload)>;
+
+    /*
+        One piece of a vectored send. Borrowed bytes are copied when they are queued, a moved-in vector is queued as it is.
+    */
+    using TxFragment = std::variant<std::span<const char>, std::vector<char>>;
+
+    /*
+        Decides whether an accepted TCP client belongs on another reactor. "incoming_cpu" is the CPU that processed the client's packets, or -1 if unknown.
+        Returning true hands the client over: this server forgets it without closing it, and the callback must pass it on, usually to another server's AdoptClient().
+    */
+    using SteeringCallback = std::function<bool(int client_file_descriptor, int incoming_cpu)>;
+
+    /*
+        Queued messages and buffers are allocated from "memory_resource". When it is null, the server uses its own pool arena, which recycles message nodes and buffer blocks without going back to the global heap.
+        A caller supplied memory resource must outlive the server.
+        "socket_options" is applied to the listening socket and to every accepted client.
+    */
+    NonBlockingSocketServer(const std::string& unix_socket_path, size_t client_limit = DEFAULT_CLIENT_LIMIT, std::chrono::milliseconds blocking_timeout = DEFAULT_BLOCKING_TIMEOUT, bool is_verbose = false, std::pmr::memory_resource* memory_resource = nullptr, const SocketOptions& socket_options = SocketOptions());
+    NonBlockingSocketServer(const TcpEndpoint& tcp_endpoint, size_t client_limit = DEFAULT_CLIENT_LIMIT, std::chrono::milliseconds blocking_timeout = DEFAULT_BLOCKING_TIMEOUT, bool is_verbose = false, std::pmr::memory_resource* memory_resource = nullptr, const SocketOptions& socket_options = SocketOptions());
+    NonBlockingSocketServer(const InheritedEndpoint& inherited_endpoint, size_t client_limit = DEFAULT_CLIENT_LIMIT, std::chrono::milliseconds blocking_timeout = DEFAULT_BLOCKING_TIMEOUT, bool is_verbose = false, std::pmr::memory_resource* memory_resource = nullptr, const SocketOptions& socket_options = SocketOptions());
+
+    /*
+        Serve every endpoint in "listener_endpoints" from the same event loop. A listener is identified by its index in this list.
+        "client_limit" applies to the total number of clients across all listeners.
+    */
+    NonBlockingSocketServer(const std::vector<ListenerEndpoint>& listener_endpoints, size_t client_limit = DEFAULT_CLIENT_LIMIT, std::chrono::milliseconds blocking_timeout = DEFAULT_BLOCKING_TIMEOUT, bool is_verbose = false, std::pmr::memory_resource* memory_resource = nullptr, const SocketOptions& socket_options = SocketOptions());
+    ~NonBlockingSocketServer();
+
+    NonBlockingSocketServer(const NonBlockingSocketServer&) = delete;
+    NonBlockingSocketServer& operator=(const NonBlockingSocketServer&) = delete;
+
+    /*
+        The sockets passed by systemd style socket activation: LISTEN_FDS file descriptors from 3 on, if LISTEN_PID names this process.
+        The variables are removed once consumed, so that child processes do not mistake the sockets for theirs; variables naming another process are left alone.
+        Returns an empty list when nothing was passed to this process.
+    */
+    static std::vector<ListenerEndpoint> GetSocketActivationEndpoints();
 
     /*
         Tell the server to start and listen for client connection attempts.
@@ -49,6 +293,28 @@ public:
     */
     void Run();
 
+    /*
+        One pass of the event loop that waits at most "timeout" for events, and reports what it did.
+    */
+    RunStats RunOnce(std::chrono::milliseconds timeout);
+
+    /*
+        Run passes of the event loop until "duration" has elapsed or the server has closed.
+    */
+    RunStats RunFor(std::chrono::milliseconds duration);
+
+    /*
+        Run non-blocking passes of the event loop until one of them finds nothing to do.
+    */
+    RunStats RunUntilIdle();
+
+    /*
+        A file descriptor that becomes readable whenever the server has events to process, for nesting the server inside another event loop.
+        It also turns readable for work the server already holds: payloads enqueued outside Run(), clients left with unread bytes by a read budget,
+        and RPC clients that may be read again. When it is readable, call RunUntilIdle(). Only valid between Start() and the server closing.
+    */
+    int GetPollFileDescriptor() const;
+
     /*
         Order the server to begin shutting down.
     */
@@ -59,19 +325,250 @@ public:
     */
     ServerState GetServerState() const;
 
-    void EnqueueSend(int client_file_descriptor, const std::span<char>& bytes);
-    void EnqueueBroadcast(const std::span<char>& bytes);
+    /*
+        Hot restart. Hand every listener and connected client, together with the payloads still queued for it, to a successor process waiting in Resume() on "control_socket_path".
+        The file descriptors travel over the control socket with SCM_RIGHTS, so no connection is closed or refused on the way. Bytes already read are delivered
+        and posted messages are queued first, while unread bytes stay in the kernel for the successor. Once the successor confirms, this server forgets its clients
+        without reporting them as disconnected, and closes. If the handover fails, the server keeps running as if nothing happened.
+        It is refused while a shared memory client is connected, or while an RPC client has requests in flight or part of a frame read, so that the caller can retry once they settle.
+    */
+    bool HandOver(const std::string& control_socket_path, std::chrono::milliseconds timeout);
+
+    /*
+        Start by taking over the listeners and clients of a predecessor's HandOver() instead of opening the listeners anew. Blocks until the predecessor has connected
+        to "control_socket_path" and handed everything over, or "timeout" has passed. The listener endpoints must be those of the predecessor, in the same order.
+        Resumed clients are reported through the ConnectCallback, and their queued payloads go out on the first Run(). Topic subscriptions are not carried over.
+    */
+    bool Resume(const std::string& control_socket_path, std::chrono::milliseconds timeout);
+
+    /*
+        Hand received payloads to a pool of "worker_count" threads instead of calling the RxCallback on the thread that calls Run().
+        Payloads from one client are delivered in order and never concurrently, but different clients are served in parallel, so the RxCallback must be safe to call from several threads.
+        Its ConnectionRef carries no user context, as the client may be gone and its context freed by the time the worker gets to the payload. Must be called before Start().
+    */
+    void EnableWorkerDispatch(size_t worker_count);
+
+    /*
+        Queue a payload for a client from any thread, typically a reply from an RxCallback running on a worker.
+        The reactor picks it up on its next Run(). A reply posted from the client's own RxCallback is dropped if that client disconnects in the meantime, even if its file descriptor is reused.
+        Payloads for other clients, such as relays from a worker, are sent to whichever client holds the file descriptor when the reactor gets to them.
+    */
+    void PostSend(int client_file_descriptor, std::vector<char> bytes, TxPriority priority = TxPriority::NORMAL);
+
+    /*
+        Pin the thread that calls Run() to "cpu". The pinning and a first touch of the buffer pool happen on the first Run(), so that the kernel places the pool's pages on that CPU's NUMA node.
+        Must be called before Start().
+    */
+    void SetCpuAffinity(int cpu);
+
+    /*
+        Count cycles, instructions and cache misses of every Run() into RunStats::perf_counts. The counters are opened for the thread that calls Run(),
+        on its first pass, and stay zero where the kernel refuses them. Reading them costs two read() calls per pass, which the syscall counts leave out.
+        Must be called before Start().
+    */
+    void EnablePerfCounters();
+    bool HasPerfCounters() const;
+
+    /*
+        Back the server's own arena with "arena_size" bytes of huge pages, so that read buffers and queued payloads take a few TLB entries instead of one per page.
+        Explicit huge pages are tried first, then transparent huge pages, then regular pages, and allocations beyond the arena fall back to the heap.
+        Start() pre-faults the arena and the read buffers in it, or the first Run() does with a CPU affinity. Has no effect with a caller supplied memory resource.
+        Must be called before Start().
+    */
+    bool SetHugePageArena(size_t arena_size);
+    HugePageArena::PageMode GetHugePageMode() const;
+
+    /*
+        Take ownership of a connected client socket from any thread, typically one handed over by another server's SteeringCallback.
+        The client is registered as if it had connected through listener "listener_index" on the next Run().
+    */
+    void AdoptClient(int client_file_descriptor, size_t listener_index = 0);
+    void SetSteeringCallback(SteeringCallback callback);
+
+    /*
+        Limit how much one readiness event may read from a client, in bytes and in read calls. Zero means no limit, which is the default.
+        A client that uses up its budget while bytes are still waiting is put on a ready list, and ready clients get one budget each per Run(), in turn, so that a bulk sender cannot starve the others.
+    */
+    void SetReadBudget(size_t byte_budget, size_t read_budget = 0);
+
+    /*
+        Limit how fast each client may send, in bytes and in reads per second, where every read is one RxCallback. A client that runs out of tokens is not read
+        until the event loop's clock has refilled its bucket: its socket leaves the EPOLLIN set, so bytes pile up in the kernel and flow control pushes back on the sender.
+        Must be called before Start().
+    */
+    void SetRxRateLimit(const RateLimit& byte_limit, const RateLimit& read_limit);
+
+    /*
+        Limit how fast each listener accepts clients. A listener that runs out of tokens is taken out of epoll, and connecting clients wait in its backlog.
+        Must be called before Start().
+    */
+    void SetAcceptRateLimit(const RateLimit& accept_limit);
+
+    /*
+        Append payloads smaller than "threshold_bytes" to one contiguous block per client, so that many tiny sends leave as few large segments.
+        With a zero "flush_delay" the block is flushed at the end of every Run(). Otherwise a client is held back until its queue reaches the threshold
+        or the delay has passed since its first held payload, whichever comes first; the poll file descriptor wakes up for the delay too.
+        A zero threshold, the default, turns coalescing off. Must be called before Start().
+    */
+    void SetTxCoalescing(size_t threshold_bytes, std::chrono::microseconds flush_delay = std::chrono::microseconds(0));
+
+    /*
+        The CPU that processed the most recent packets of a TCP client, as reported by SO_INCOMING_CPU, or -1 if unknown.
+    */
+    int GetIncomingCpu(int client_file_descriptor) const;
+
+    void EnqueueSend(int client_file_descriptor, const std::span<char>& bytes, TxPriority priority = TxPriority::NORMAL);
+
+    /*
+        Queue the concatenation of "fragments" for a client without concatenating them first. Adjacent borrowed fragments are copied into one block,
+        and vectors are moved out of "fragments" and sent from their own storage. The pieces go to the kernel together in one gathered send.
+    */
+    void EnqueueSendv(int client_file_descriptor, std::span<TxFragment> fragments, TxPriority priority = TxPriority::NORMAL);
+    void EnqueueBroadcast(const std::span<char>& bytes, TxPriority priority = TxPriority::NORMAL);
+
+    /*
+        While a lower class has messages waiting, every message sent from a higher class counts against it. After "message_count" of them,
+        the waiting class gets to send one message, so bulk traffic keeps moving under a steady stream of control messages. Zero lets higher classes starve lower ones.
+    */
+    void SetTxStarvationGuard(size_t message_count);
+
+    /*
+        Subscribe a connected client to a topic. Subscriptions are removed automatically when the client disconnects.
+        Returns false if the client is not connected or already subscribed.
+    */
+    bool Subscribe(int client_file_descriptor, const Topic& topic);
+    bool Unsubscribe(int client_file_descriptor, const Topic& topic);
+
+    /*
+        Queue a payload for every subscriber of a topic. The payload is copied once and shared by all subscribers.
+        Returns the number of subscribers the payload was queued for.
+    */
+    size_t Publish(const Topic& topic, std::span<const char> bytes, TxPriority priority = TxPriority::NORMAL);
+    size_t GetSubscriberCount(const Topic& topic) const;
     void SetRxCallback(RxCallback callback);
+
+    /*
+        Like SetRxCallback(), but the callback is also told how long the bytes waited in the kernel between arriving and the callback.
+        The delay is only measured when SocketOptions::rx_timestamping is on, and is zero otherwise.
+    */
+    void SetRxCallback(TimestampedRxCallback callback);
     void SetConnectCallback(ConnectCallback callback);
+
+    /*
+        Like SetConnectCallback(), but the callback is also told which listener the client connected through.
+    */
+    void SetConnectCallback(ListenerConnectCallback callback);
     void SetDisconnectCallback(DisconnectCallback callback);
+
+    /*
+        Receive the datagrams of UDP listeners. A receive reads up to a batch of datagrams with one recvmmsg() call,
+        and with SocketOptions::udp_gro a coalesced read is split back into its datagrams before the callback sees them.
+    */
+    void SetDatagramCallback(DatagramCallback callback);
+
+    /*
+        Queue a datagram on a UDP listener. Queued datagrams are sent at the end of Run() in batches of one sendmmsg() call,
+        and with SocketOptions::udp_gso consecutive equally sized datagrams to one peer leave as a single segmentation offload send.
+        Returns false if the listener is not a UDP listener or the datagram is too large.
+    */
+    bool EnqueueDatagram(size_t listener_index, const DatagramPeer& peer, std::span<const char> bytes);
+
+    /*
+        Deliver everything read during one Run() in a single call instead of one RxCallback per read. Records are in the order the bytes were read.
+        A disconnect delivers the pending records first, so the batch never holds bytes of a client that the DisconnectCallback has already reported.
+        The batch callback replaces the RxCallback and runs on the thread that calls Run(), even when worker dispatch is enabled.
+    */
+    void SetRxBatchCallback(RxBatchCallback callback);
+
+    /*
+        Called once per Run() that received bytes, after all of them were delivered and right before queued payloads are flushed.
+        Replies enqueued here go out in the same Run().
+    */
+    void SetBatchEndCallback(BatchEndCallback callback);
+
+    /*
+        Split the byte stream of every client into RPC frames, and hand each request to "handler" with its payload, which is only valid during the call.
+        The handler completes a request with CompleteRpcRequest(), right away or in a later Run(), and requests may complete in any order, so a slow one does not hold back those behind it.
+        A client with "in_flight_limit" requests outstanding is not read until one of them completes, which pushes back on it through the socket buffers.
+        A frame of more than 16 MiB disconnects the client. The handler replaces the RxCallback and the RxBatchCallback, and runs on the thread that calls Run().
+        Must be called before Start().
+    */
+    void SetRpcHandler(RpcHandler handler, size_t in_flight_limit = DEFAULT_RPC_IN_FLIGHT_LIMIT);
+
+    /*
+        Queue the response to a request. Responses completed during one Run() leave together, in one gathered send per client.
+        Returns false if the request is no longer in flight, because it was completed before or its client is gone. Must be called on the thread that calls Run().
+    */
+    bool CompleteRpcRequest(const RpcRequest& request, std::span<const char> response, TxPriority priority = TxPriority::NORMAL);
+    size_t GetRpcInFlightCount(int client_file_descriptor) const;
+
+    /*
+        The most readiness events one Run() takes from epoll. Larger batches amortize per-wakeup work under load.
+    */
+    void SetEpollEventCapacity(size_t event_capacity);
     const std::vector<int>& GetClientFileDescriptors() const;
 
+    /*
+        Get the index of the listener that a connected client arrived on, or GetListenerCount() if the client is unknown.
+    */
+    size_t GetListenerIndex(int client_file_descriptor) const;
+    size_t GetListenerCount() const;
+
+    /*
+        Attach an opaque pointer to a connected client, which every later callback about it on the thread that calls Run() carries in its ConnectionRef.
+        The server never dereferences or frees it, and the DisconnectCallback is the last to see it. Worker dispatched RxCallbacks never see it.
+        Returns false if the client is not connected.
+    */
+    bool SetUserContext(int client_file_descriptor, void* user_context);
+    void* GetUserContext(int client_file_descriptor) const;
+
+    /*
+        Record every accept, receive, send and disconnect, with its bytes and a monotonic timestamp, to a capture file that TrafficReplayer can replay.
+        The file is written by a background thread, so recording only costs the reactor a copy into memory.
+    */
+    bool StartCapture(const std::string& capture_file_path);
+    void StopCapture();
+
+    /*
+        Report how much user-space memory the server currently holds, broken down by category.
+    */
+    MemoryUsage GetMemoryUsage() const;
+
+    /*
+        Give memory back once a burst is over. A client that has neither read nor sent for "idle_period" has its tx high-water mark reset and drops its worker strand,
+        and read buffer slabs and list capacity beyond what Start() pre-faulted are released. Run() sweeps at most once per period. Zero, the default, turns it off.
+    */
+    void SetIdleReclamation(std::chrono::milliseconds idle_period);
+
+    /*
+        Cap the bytes the server holds in queued tx payloads, partial RPC frames and read buffers. While the budget is exceeded, new clients are accepted and closed right away,
+        and the clients with the largest backlogs are disconnected until the server is back under it. Zero, the default, means no budget.
+    */
+    void SetMemoryBudget(size_t budget_bytes);
+
+    /*
+        The most bytes that were queued for a client at once since it connected, or since idle reclamation last found it idle.
+    */
+    size_t GetTxHighWaterBytes(int client_file_descriptor) const;
+
+    /*
+        Distribution of the time received bytes spent queued in the kernel before their callback ran. Only filled when SocketOptions::rx_timestamping is on.
+        A growing tail here means the event loop, not the network, is falling behind.
+    */
+    const LatencyHistogram& GetRxQueueDelayHistogram() const;
+
 private:
 
+    static constexpr size_t TX_PRIORITY_COUNT = 3;
+    static constexpr size_t DEFAULT_TX_STARVATION_GUARD = 16;
+    static constexpr size_t DEFAULT_RPC_IN_FLIGHT_LIMIT = 64;
+    static constexpr size_t MAXIMUM_RPC_PAYLOAD_SIZE = 16 * 1024 * 1024;
+
     enum EndpointMode
     {
         TCP,
         UNIX_DOMAIN,
+        UDP,
         UNDEFINED
     };
 
@@ -79,60 +576,334 @@ private:
     {
         EndpointMode mode = EndpointMode::UNDEFINED;
         std::string unix_socket_path {};
-        uint16_t tcp_port {};
+        bool is_abstract_unix_socket = false;
+        uint16_t tcp_port {}; // the tcp_ fields hold the IP address of UDP endpoints too
         std::string tcp_ip_address {};
+        bool is_tcp_ipv6 = false;
+        size_t shared_memory_ring_size = 0;
+    };
+
+    struct OutboundDatagram
+    {
+        DatagramPeer peer;
+        size_t offset = 0; // into DatagramState::tx_bytes
+        size_t size = 0;
+    };
+
+    /*
+        The pre-allocated receive batch and the send queue of a UDP listener. Every receive slot has its own buffer, address and control space,
+        so that one recvmmsg() call can fill all of them.
+    */
+    struct DatagramState
+    {
+        std::vector<mmsghdr> rx_messages;
+        std::vector<iovec> rx_io_vectors;
+        std::vector<DatagramPeer> rx_peers;
+        std::vector<char> rx_buffers;
+        std::vector<char> rx_control_buffers;
+        std::vector<char> tx_bytes; // queued datagrams back to back, so that datagrams to one peer are already contiguous for segmentation offload
+        std::vector<OutboundDatagram> tx_datagrams;
+    };
+
+    struct TokenBucket
+    {
+        double tokens = 0;
+        std::chrono::steady_clock::time_point refill_time {};
+
+        void Refill(const RateLimit& limit, std::chrono::steady_clock::time_point now);
+
+        /*
+            The time at which the bucket holds "token_count" tokens again.
+        */
+        std::chrono::steady_clock::time_point GetRefillTime(const RateLimit& limit, double token_count) const;
+    };
+
+    struct Listener
+    {
+        Endpoint endpoint {};
+        int file_descriptor = -1;
+        std::unique_ptr<DatagramState> datagram_state {}; // only for UDP listeners
+        TokenBucket accept_bucket {};
+        bool is_accept_paused = false;
+        std::chrono::steady_clock::time_point accept_resume_time {};
+    };
+
+    /*
+        A reference counted payload that several queued messages point to, used to fan one payload out to many clients.
+        It is a single allocation from the memory resource: this header, immediately followed by the payload bytes.
+    */
+    struct SharedPayload
+    {
+        size_t reference_count = 0;
+        size_t size = 0;
+
+        char* Data();
+        size_t GetAllocationSize() const;
     };
 
+    /*
+        A queued message is a single allocation from the memory resource: this header, immediately followed by the payload bytes.
+        Messages that carry a shared payload are only this header, and messages that own a moved-in vector are this header followed by the vector.
+    */
     struct TxMessage
     {
-        int client_file_descriptor;
+        TxMessage* next = nullptr;
+        size_t size = 0;
+        SharedPayload* shared_payload = nullptr;
+        uint32_t coalescing_capacity = 0; // payload bytes allocated for a coalescing block, which later small payloads are appended to
+        bool is_owned_payload = false;
+
+        char* Data();
+        std::vector<char>* GetOwnedPayload();
+        const std::vector<char>* GetOwnedPayload() const;
+        size_t GetAllocationSize() const;
+    };
+
+    struct TxQueue
+    {
+        TxMessage* head = nullptr;
+        TxMessage* tail = nullptr;
+        uint32_t skipped_count = 0; // messages of higher classes sent while this queue waited, for the starvation guard
+    };
+
+    /*
+        Compact per-client state. An idle connection owns no buffers; its tx queue only holds memory while payloads are waiting to be sent.
+    */
+    struct Connection
+    {
+        int file_descriptor = -1;
+        uint32_t client_list_index = 0;
+        bool is_tx_scheduled = false;
+        bool is_tx_blocked = false;
+        bool is_rx_ready = false; // used up its read budget with bytes left in the socket, and waits on the ready list
+        bool is_tx_held = false; // coalescing holds the tx queue back until tx_flush_deadline
+        bool is_rx_paused = false; // ran out of rate limit tokens, and is not read until rx_resume_time
+        uint8_t tx_sending_priority = 0; // the class whose head message is partly sent, when tx_bytes_sent is not zero
+        uint16_t listener_index = 0;
+        size_t tx_bytes_sent = 0;
+        size_t tx_queued_bytes = 0;
+        size_t tx_high_water_bytes = 0;
+        std::chrono::steady_clock::time_point tx_flush_deadline {};
+        std::chrono::steady_clock::time_point last_active_time {}; // the last Run() that read from or sent to the client, only kept with idle reclamation
+        std::chrono::steady_clock::time_point rx_resume_time {};
+        TokenBucket rx_byte_bucket;
+        TokenBucket rx_read_bucket;
+        TxQueue tx_queues[TX_PRIORITY_COUNT];
+        std::shared_ptr<Strand> strand; // only created once the client has sent something in worker dispatch mode
+        std::unique_ptr<SharedMemoryChannel> shared_memory; // only for clients of a shared memory endpoint, whose bytes go through its rings instead of the socket
+        bool is_shared_memory_hung_up = false; // the client closed its socket, so its ring reads as the end of the connection once drained
+        void* user_context = nullptr;
+        bool is_rpc_paused = false; // has as many RPC requests in flight as allowed, and is not read until one completes
+        uint64_t rpc_connection_id = 0; // handed out with the first RPC frame
+        std::vector<uint64_t> rpc_in_flight_request_ids;
+        std::vector<char> rpc_rx_bytes; // the start of a frame whose rest has not arrived yet
+    };
+
+    /*
+        A payload handed over by PostSend(). Posted messages form a lock-free stack that the reactor takes over in one exchange.
+    */
+    struct PostedMessage
+    {
+        PostedMessage* next = nullptr;
+        int client_file_descriptor = -1;
+        TxPriority priority = TxPriority::NORMAL;
+        std::shared_ptr<Strand> strand;
         std::vector<char> payload;
     };
 
+    /*
+        A client handed over by AdoptClient(), queued on a lock-free stack like posted messages.
+    */
+    struct AdoptedClient
+    {
+        AdoptedClient* next = nullptr;
+        int client_file_descriptor = -1;
+        size_t listener_index = 0;
+    };
+
     static constexpr std::chrono::milliseconds DEFAULT_BLOCKING_TIMEOUT { 10 };
-    static constexpr int MAXIMUM_EPOLL_EVENTS = 10;
+    static constexpr size_t DEFAULT_EPOLL_EVENT_CAPACITY = 10;
     static constexpr size_t DEFAULT_CLIENT_LIMIT = 1;
     static constexpr size_t READ_BUFFER_SIZE = 1024;
+    static constexpr size_t MAXIMUM_TX_IO_VECTORS = 64;
+    static constexpr size_t DATAGRAM_BATCH_SIZE = 32;
+    static constexpr size_t MAXIMUM_GSO_SEGMENTS = 64; // UDP_MAX_SEGMENTS in the kernel
+    static constexpr size_t MAXIMUM_DATAGRAM_SIZE = 65507;
+    static constexpr size_t PREFAULTED_READ_BUFFER_COUNT = 16;
+    static constexpr int SOCKET_ACTIVATION_FIRST_FILE_DESCRIPTOR = 3; // SD_LISTEN_FDS_START
+    static constexpr uint32_t HANDOVER_MAGIC = 0x4E425353; // "NBSS"
+    static constexpr size_t HANDOVER_CHUNK_SIZE = 64 * 1024;
+
+    /*
+        The first message of a handover. The file descriptors follow in batches, listeners first and then clients in the order of the client list,
+        and then the serialized client state in chunks.
+    */
+    struct HandOverHeader
+    {
+        uint32_t magic = HANDOVER_MAGIC;
+        uint32_t listener_count = 0;
+        uint32_t client_count = 0;
+        uint64_t state_size = 0;
+    };
 
-    Endpoint m_endpoint {};
+    std::vector<Listener> m_listeners;
     const size_t m_client_limit;
     const std::chrono::milliseconds m_blocking_timeout;
+    const SocketOptions m_socket_options;
+    HugePageArena m_huge_page_arena; // upstream of m_arena, so it has to outlive it
+    std::pmr::unsynchronized_pool_resource m_arena;
+    std::pmr::memory_resource* const m_memory_resource;
+    BufferPool m_buffer_pool;
     std::vector<int> m_client_file_descriptors;
+    std::vector<Connection> m_connections; // indexed by client file descriptor
+    std::vector<int> m_pending_tx_file_descriptors;
+    std::vector<int> m_rx_ready_file_descriptors;
+    std::vector<int> m_rx_ready_snapshot; // the ready list taken over at the start of a Run(), kept to reuse its capacity
+    std::vector<int> m_held_tx_file_descriptors; // in order of their flush deadlines, because every client is held for the same delay
+    size_t m_tx_coalescing_threshold = 0;
+    size_t m_tx_starvation_guard = DEFAULT_TX_STARVATION_GUARD;
+    std::chrono::microseconds m_tx_flush_delay {};
+    int m_tx_flush_timer_file_descriptor = -1;
+    bool m_is_tx_flush_timer_armed = false;
+    mutable bool m_is_nested = false; // GetPollFileDescriptor() was asked for, so an outer event loop waits on it
+    bool m_is_in_run = false;
+    bool m_is_queued_work_signalled = false; // the wakeup file descriptor was written for queued work and not read yet
+    size_t m_read_byte_budget = 0;
+    size_t m_read_call_budget = 0;
+    std::chrono::milliseconds m_idle_reclamation_period {};
+    std::chrono::steady_clock::time_point m_next_reclamation_time {};
+    std::chrono::steady_clock::time_point m_run_time {}; // taken once per Run() while idle reclamation is on, so that clients do not each read the clock
+    size_t m_memory_budget = 0;
+    RateLimit m_rx_byte_limit;
+    RateLimit m_rx_read_limit;
+    RateLimit m_accept_limit;
+    bool m_is_rx_rate_limited = false;
+    std::vector<int> m_rx_paused_file_descriptors;
+    int m_rate_limit_timer_file_descriptor = -1;
+    std::chrono::steady_clock::time_point m_rate_limit_timer_deadline {}; // the epoch while the timer is not armed
+    size_t m_tx_queued_bytes = 0; // over all clients, with a shared payload counted once
+    size_t m_rpc_rx_bytes = 0; // partial RPC frames over all clients
     ServerState m_server_state { ServerState::CLOSED };
-    RxCallback m_rx_callback = [](int client_file_descriptor, const std::span<char>& bytes){
-        (void)client_file_descriptor;
+    TimestampedRxCallback m_rx_callback = [](ConnectionRef connection, const std::span<char>& bytes, std::chrono::nanoseconds rx_queue_delay){
+        (void)connection;
         (void)bytes;
+        (void)rx_queue_delay;
     };
-    ConnectCallback m_connect_callback = [](int client_file_descriptor){(void)client_file_descriptor;};
-    DisconnectCallback m_disconnect_callback = [](int client_file_descriptor){(void)client_file_descriptor;};
-    std::list<TxMessage> m_tx_messages;
+    ListenerConnectCallback m_connect_callback = [](ConnectionRef connection, size_t listener_index){(void)connection; (void)listener_index;};
+    DisconnectCallback m_disconnect_callback = [](ConnectionRef connection){(void)connection;};
+    DatagramCallback m_datagram_callback = [](size_t listener_index, const DatagramPeer& peer, const std::span<char>& bytes){(void)listener_index; (void)peer; (void)bytes;};
+    SteeringCallback m_steering_callback;
+    RxBatchCallback m_rx_batch_callback;
+    BatchEndCallback m_batch_end_callback;
+    RpcHandler m_rpc_handler;
+    size_t m_rpc_in_flight_limit = DEFAULT_RPC_IN_FLIGHT_LIMIT;
+    uint64_t m_rpc_connection_count = 0;
+    std::vector<RxRecord> m_rx_batch;
+    std::vector<char*> m_rx_batch_buffers; // read buffers the batch points into, returned to the pool once it was delivered
+    RunStats m_run_stats; // what the current pass has done so far
+    std::vector<epoll_event> m_epoll_events;
     bool m_is_verbose;
 
-    int m_server_socket_file_descriptor = -1; // server file descriptor
     int m_server_epoll_file_descriptor = -1; // server epoll file descriptor
+    int m_wakeup_file_descriptor = -1; // eventfd that interrupts epoll_wait when another thread posts a message or hands over a client
+    std::unique_ptr<WorkerPool> m_worker_pool;
+    std::atomic<PostedMessage*> m_posted_messages { nullptr };
+    std::atomic<AdoptedClient*> m_adopted_clients { nullptr };
+    int m_cpu_affinity = -1;
+    bool m_is_cpu_affinity_pending = false;
+    bool m_is_perf_counters_enabled = false;
+    bool m_is_perf_counters_pending = false;
+    PerfCounters m_perf_counters;
+    TopicSubscriptions m_topic_subscriptions;
+    LatencyHistogram m_rx_queue_delay_histogram;
+    std::unique_ptr<TrafficRecorder> m_traffic_recorder;
     
-    bool CreateSocket();
-    bool BindToEndpoint();
-    bool BindToUnixDomainSocket();
-    bool BindToTcpSocket();
-    bool Bind(const sockaddr* address, socklen_t size);
-    bool Listen();
-    bool AcceptClient();
+    static Endpoint MakeEndpoint(const ListenerEndpoint& listener_endpoint);
+    bool StartListener(Listener& listener);
+    bool InspectBoundListener(Listener& listener, bool& is_listening);
+    bool CreateSocket(Listener& listener);
+    bool BindToEndpoint(Listener& listener);
+    bool BindToUnixDomainSocket(Listener& listener);
+    bool BindToIpSocket(Listener& listener);
+    bool Bind(const Listener& listener, const sockaddr* address, socklen_t size);
+    bool Listen(const Listener& listener);
+    void CloseListeners();
+    bool ApplyListenerSocketOptions(const Listener& listener);
+    bool ApplyClientSocketOptions(int client_file_descriptor, const Endpoint& endpoint);
+    bool SetSocketOption(int file_descriptor, int level, int option_name, int value, const std::string& option_label);
+    bool AcceptClient(size_t listener_index);
+    void CreateDatagramState(Listener& listener);
+    void ReceiveDatagrams(size_t listener_index);
+    void SendDatagrams(Listener& listener);
+    bool RegisterClient(int client_file_descriptor, size_t listener_index);
+    bool OpenSharedMemory(Connection& connection, size_t ring_size);
+    void HandleSharedMemoryEvent(int client_file_descriptor);
+    ssize_t ReadSharedMemory(Connection& connection, char* buffer, size_t size);
+    ssize_t WriteSharedMemory(Connection& connection, const iovec* io_vectors, size_t io_vector_count);
+    void RingSharedMemoryDoorbell(int client_file_descriptor);
+    void ApplyCpuAffinity();
+    void WakeUp();
+
+    /*
+        Make the poll file descriptor readable for work that is queued without an event of its own, when an outer event loop waits on it.
+    */
+    void SignalQueuedWork();
+    Listener* FindListener(int file_descriptor, size_t& listener_index);
     bool MakeFileDescriptorNonBlocking(int file_descriptor);
-    bool ConfigureServerFileDescriptorForEpoll();
+    bool ConfigureServerFileDescriptorForEpoll(int listener_file_descriptor);
     bool ConfigureClientFileDescriptorForEpoll(int client_file_descriptor);
     /*
         This function processes events that are returned from epoll_wait, such as client connects, disconnects, and payloads
     */
-    void ProcessEpollEvent();
+    void ProcessEpollEvent(std::chrono::milliseconds timeout);
     void CloseServer();
+    std::vector<char> SerializeHandOverState();
+    bool SendHandOver(int control_file_descriptor, const std::vector<char>& state);
+    bool ReceiveHandOver(int control_file_descriptor, std::vector<int>& file_descriptors, std::vector<char>& state);
+    bool RestoreHandOverState(const std::vector<int>& client_file_descriptors, const std::vector<char>& state);
     void DisconnectClient(int client_file_descriptor);
     void HandleNonBlockingRead(int client_file_descriptor);
+
+    /*
+        Hand the complete frames of "bytes", after any bytes held back from earlier reads, to the RpcHandler until the client reaches its in-flight limit,
+        and hold back the rest. Returns false if the client was disconnected.
+    */
+    bool DispatchRpcFrames(int client_file_descriptor, std::span<char> bytes);
+    void ProcessRxReadyConnections();
+    void DeliverRxBatch();
+    ssize_t ReadWithTimestamp(int client_file_descriptor, char* buffer, size_t size, timespec& kernel_timestamp);
     /*
         This function sends messages to clients. Messages are queued by end-users of this server.
     */
     void ProcessTxMessages();
-    void SendToClient(const TxMessage& tx_message);
+    void ProcessHeldTxMessages();
+    void ArmTxFlushTimer(std::chrono::steady_clock::time_point deadline);
+    void ProcessPostedMessages();
+    void ProcessAdoptedClients();
+    void ReclaimIdleMemory();
+    bool HasRxTokens(const Connection& connection) const;
+    void PauseRx(Connection& connection);
+    void PauseAccept(Listener& listener);
+    void ResumeRateLimited();
+    void ArmRateLimitTimer(std::chrono::steady_clock::time_point deadline);
+    void EnforceMemoryBudget();
+    size_t GetBudgetedBytes() const;
+    void DispatchToWorker(Connection& connection, const std::span<char>& bytes, std::chrono::nanoseconds rx_queue_delay);
+    void SendToClient(Connection& connection);
+    void ScheduleTx(Connection& connection);
+    size_t PickTxPriority(TxMessage* const (&cursors)[TX_PRIORITY_COUNT], uint32_t (&skipped_counts)[TX_PRIORITY_COUNT]) const;
+    size_t FanOut(const std::vector<int>& client_file_descriptors, std::span<const char> bytes, TxPriority priority);
+    void PushTxMessage(Connection& connection, std::span<const char> bytes, TxPriority priority);
+    char* AppendTxBytes(Connection& connection, size_t size, TxPriority priority);
+    void PushSharedTxMessage(Connection& connection, SharedPayload* shared_payload, TxPriority priority);
+    void PushOwnedTxMessage(Connection& connection, std::vector<char>&& bytes, TxPriority priority);
+    void LinkTxMessage(Connection& connection, TxMessage* tx_message, TxPriority priority);
+    void AddTxQueuedBytes(Connection& connection, size_t size, bool is_owned);
+    void ReleaseSharedPayload(SharedPayload* shared_payload);
+    void PopTxMessage(Connection& connection, size_t priority_index);
+    static bool HasTxMessages(const Connection& connection);
+    void ClearTxMessages(Connection& connection);
+    Connection* FindConnection(int client_file_descriptor);
     void Print(const std::string& log);
 };
 } // namespace InterProcessCommunication
\ No newline at end of file
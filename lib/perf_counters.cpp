@@ -0,0 +1,106 @@
+#include "perf_counters.h"
+#include <cstdio>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace InterProcessCommunication
+{
+PerfSample PerfSample::operator-(const PerfSample& other) const
+{
+    return PerfSample{cycles - other.cycles, instructions - other.instructions, cache_misses - other.cache_misses};
+}
+
+PerfSample& PerfSample::operator+=(const PerfSample& other)
+{
+    cycles += other.cycles;
+    instructions += other.instructions;
+    cache_misses += other.cache_misses;
+
+    return *this;
+}
+
+PerfCounters::~PerfCounters()
+{
+    Close();
+}
+
+bool PerfCounters::Open()
+{
+    if(IsOpen())
+    {
+        return true;
+    }
+
+    const uint64_t configs[EVENT_COUNT] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+
+    for(int index = 0; index < EVENT_COUNT; ++index)
+    {
+        perf_event_attr attributes {};
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.config = configs[index];
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format = PERF_FORMAT_GROUP;
+        // the leader starts disabled, so that the whole group is switched on at once below
+        attributes.disabled = index == 0 ? 1 : 0;
+
+        // glibc has no wrapper for perf_event_open(); pid 0 and cpu -1 count the calling thread on any CPU
+        m_file_descriptors[index] = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, m_file_descriptors[0], PERF_FLAG_FD_CLOEXEC));
+
+        if(m_file_descriptors[index] == -1)
+        {
+            perror("PerfCounters::Open() -> Failed to open a hardware counter");
+            Close();
+            return false;
+        }
+    }
+
+    ioctl(m_file_descriptors[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(m_file_descriptors[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    return true;
+}
+
+void PerfCounters::Close()
+{
+    for(int& file_descriptor : m_file_descriptors)
+    {
+        if(file_descriptor != -1)
+        {
+            close(file_descriptor);
+            file_descriptor = -1;
+        }
+    }
+}
+
+bool PerfCounters::IsOpen() const
+{
+    return m_file_descriptors[0] != -1;
+}
+
+bool PerfCounters::Read(PerfSample& sample) const
+{
+    if(not IsOpen())
+    {
+        return false;
+    }
+
+    // PERF_FORMAT_GROUP: the event count, then one value per event in the order they were opened
+    uint64_t values[1 + EVENT_COUNT] {};
+
+    if(read(m_file_descriptors[0], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values)) || values[0] != EVENT_COUNT)
+    {
+        return false;
+    }
+
+    sample.cycles = values[1];
+    sample.instructions = values[2];
+    sample.cache_misses = values[3];
+
+    return true;
+}
+
+} // namespace InterProcessCommunication
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+
+namespace InterProcessCommunication
+{
+/*
+    Hardware event counts, either running totals or the difference between two reads.
+*/
+struct PerfSample
+{
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cache_misses = 0;
+
+    PerfSample operator-(const PerfSample& other) const;
+    PerfSample& operator+=(const PerfSample& other);
+};
+
+/*
+    Cycle, instruction and cache miss counters of one thread, opened with perf_event_open() as a group so that one read() returns all three.
+    Only user space is counted, which the default perf_event_paranoid setting allows without privileges.
+*/
+class PerfCounters
+{
+public:
+
+    PerfCounters() = default;
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    /*
+        Start counting for the calling thread. Fails where the kernel or the hypervisor does not expose the events.
+    */
+    bool Open();
+    void Close();
+    bool IsOpen() const;
+
+    /*
+        Read the running totals. The group is small enough for the counters of common CPUs, so the totals are reported as counted, without scaling for multiplexing.
+    */
+    bool Read(PerfSample& sample) const;
+
+private:
+
+    static constexpr int EVENT_COUNT = 3;
+
+    int m_file_descriptors[EVENT_COUNT] { -1, -1, -1 }; // the first is the group leader
+};
+} // namespace InterProcessCommunication
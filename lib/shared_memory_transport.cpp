@@ -0,0 +1,408 @@
+#include "shared_memory_transport.h"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace InterProcessCommunication
+{
+SharedMemoryRing::SharedMemoryRing(void* memory, size_t capacity)
+: m_header(static_cast<Header*>(memory))
+, m_data(static_cast<char*>(memory) + sizeof(Header))
+, m_capacity(capacity)
+, m_write_position(m_header->write_position.load(std::memory_order_relaxed))
+, m_read_position(m_header->read_position.load(std::memory_order_relaxed))
+{
+}
+
+size_t SharedMemoryRing::GetMappingSize(size_t capacity)
+{
+    return sizeof(Header) + capacity;
+}
+
+ssize_t SharedMemoryRing::Write(std::span<const char> bytes)
+{
+    const uint64_t write_position = m_write_position;
+    const uint64_t used_size = write_position - m_header->read_position.load(std::memory_order_acquire);
+
+    // a consumer position ahead of ours, or further behind than the ring is long, wraps the distance past the capacity
+    if(used_size > m_capacity)
+    {
+        return -1;
+    }
+
+    const size_t size = std::min<size_t>(bytes.size(), m_capacity - used_size);
+    const size_t offset = write_position & (m_capacity - 1);
+    const size_t first_part_size = std::min(size, m_capacity - offset);
+
+    // the free space may wrap around the end of the ring
+    std::memcpy(m_data + offset, bytes.data(), first_part_size);
+    std::memcpy(m_data, bytes.data() + first_part_size, size - first_part_size);
+
+    m_write_position = write_position + size;
+    m_header->write_position.store(m_write_position, std::memory_order_release);
+
+    return size;
+}
+
+ssize_t SharedMemoryRing::Read(char* buffer, size_t size)
+{
+    const uint64_t read_position = m_read_position;
+    const uint64_t used_size = m_header->write_position.load(std::memory_order_acquire) - read_position;
+
+    if(used_size > m_capacity)
+    {
+        return -1;
+    }
+
+    const size_t read_size = std::min<size_t>(size, used_size);
+    const size_t offset = read_position & (m_capacity - 1);
+    const size_t first_part_size = std::min(read_size, m_capacity - offset);
+
+    std::memcpy(buffer, m_data + offset, first_part_size);
+    std::memcpy(buffer + first_part_size, m_data, read_size - first_part_size);
+
+    m_read_position = read_position + read_size;
+    m_header->read_position.store(m_read_position, std::memory_order_release);
+
+    return read_size;
+}
+
+bool SharedMemoryRing::IsEmpty() const
+{
+    return m_header->write_position.load(std::memory_order_acquire) == m_read_position;
+}
+
+bool SharedMemoryRing::IsFull() const
+{
+    return m_write_position - m_header->read_position.load(std::memory_order_acquire) >= m_capacity;
+}
+
+bool SharedMemoryRing::ArmConsumerWakeup()
+{
+    m_header->is_consumer_waiting.store(1, std::memory_order_relaxed);
+
+    // the flag has to be visible before the positions are read again, or a write in between would go unnoticed by both sides
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    return IsEmpty();
+}
+
+bool SharedMemoryRing::TakeConsumerWakeup()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // the plain load keeps the common case, an awake consumer, free of a locked instruction
+    return m_header->is_consumer_waiting.load(std::memory_order_relaxed) != 0 && m_header->is_consumer_waiting.exchange(0) != 0;
+}
+
+bool SharedMemoryRing::ArmProducerWakeup()
+{
+    m_header->is_producer_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    return IsFull();
+}
+
+bool SharedMemoryRing::TakeProducerWakeup()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    return m_header->is_producer_waiting.load(std::memory_order_relaxed) != 0 && m_header->is_producer_waiting.exchange(0) != 0;
+}
+
+SharedMemoryChannel::~SharedMemoryChannel()
+{
+    if(m_memory != nullptr)
+    {
+        munmap(m_memory, m_mapping_size);
+    }
+}
+
+int SharedMemoryChannel::Create(size_t ring_capacity)
+{
+    // a power of two lets positions wrap with a mask, and keeps the second ring on a cache line boundary
+    const size_t capacity = std::bit_ceil(std::max<size_t>(ring_capacity, 64));
+    const int memory_fd = memfd_create("non_blocking_socket_server", MFD_CLOEXEC);
+
+    if(memory_fd == -1 || ftruncate(memory_fd, 2 * SharedMemoryRing::GetMappingSize(capacity)) == -1 || not MapRings(memory_fd, capacity))
+    {
+        perror("SharedMemoryChannel::Create() -> Failed to create the shared memory");
+
+        if(memory_fd != -1)
+        {
+            close(memory_fd);
+        }
+
+        return -1;
+    }
+
+    // the server sleeps in epoll from the start, so the client's first bytes have to ring
+    m_client_to_server_ring.ArmConsumerWakeup();
+
+    return memory_fd;
+}
+
+bool SharedMemoryChannel::Map(int memory_file_descriptor, size_t ring_capacity)
+{
+    struct stat memory_status {};
+
+    if(ring_capacity < 64 || not std::has_single_bit(ring_capacity) || fstat(memory_file_descriptor, &memory_status) == -1
+        || static_cast<size_t>(memory_status.st_size) < 2 * SharedMemoryRing::GetMappingSize(ring_capacity))
+    {
+        return false;
+    }
+
+    return MapRings(memory_file_descriptor, ring_capacity);
+}
+
+size_t SharedMemoryChannel::GetRingCapacity() const
+{
+    return m_ring_capacity;
+}
+
+size_t SharedMemoryChannel::GetMappingSize() const
+{
+    return m_mapping_size;
+}
+
+SharedMemoryRing& SharedMemoryChannel::GetClientToServerRing()
+{
+    return m_client_to_server_ring;
+}
+
+SharedMemoryRing& SharedMemoryChannel::GetServerToClientRing()
+{
+    return m_server_to_client_ring;
+}
+
+bool SharedMemoryChannel::MapRings(int memory_file_descriptor, size_t ring_capacity)
+{
+    const size_t ring_mapping_size = SharedMemoryRing::GetMappingSize(ring_capacity);
+    void* memory = mmap(nullptr, 2 * ring_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, memory_file_descriptor, 0);
+
+    if(memory == MAP_FAILED)
+    {
+        return false;
+    }
+
+    m_memory = memory;
+    m_mapping_size = 2 * ring_mapping_size;
+    m_ring_capacity = ring_capacity;
+    m_client_to_server_ring = SharedMemoryRing(memory, ring_capacity);
+    m_server_to_client_ring = SharedMemoryRing(static_cast<char*>(memory) + ring_mapping_size, ring_capacity);
+
+    return true;
+}
+
+SharedMemoryClient::~SharedMemoryClient()
+{
+    Close();
+}
+
+bool SharedMemoryClient::Connect(const std::string& unix_socket_path, std::chrono::milliseconds timeout, bool is_abstract)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    socklen_t address_size = sizeof(address);
+
+    if(is_abstract)
+    {
+        const size_t name_size = std::min(unix_socket_path.size(), sizeof(address.sun_path) - 1);
+        std::memcpy(address.sun_path + 1, unix_socket_path.data(), name_size);
+        address_size = offsetof(sockaddr_un, sun_path) + 1 + name_size;
+    }
+    else
+    {
+        strncpy(address.sun_path, unix_socket_path.c_str(), sizeof(address.sun_path) - 1);
+    }
+
+    m_socket_file_descriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if(m_socket_file_descriptor == -1 || connect(m_socket_file_descriptor, reinterpret_cast<sockaddr*>(&address), address_size) == -1)
+    {
+        perror("SharedMemoryClient::Connect() -> Failed to connect to the server");
+        Close();
+        return false;
+    }
+
+    // the server sends the greeting once it has accepted the connection
+    pollfd poll_file_descriptor{m_socket_file_descriptor, POLLIN, 0};
+    SharedMemoryChannel::Greeting greeting{};
+    alignas(cmsghdr) char control_buffer[CMSG_SPACE(sizeof(int))];
+    iovec io_vector{&greeting, sizeof(greeting)};
+    msghdr message {};
+    message.msg_iov = &io_vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control_buffer;
+    message.msg_controllen = sizeof(control_buffer);
+
+    if(poll(&poll_file_descriptor, 1, timeout.count()) != 1 || recvmsg(m_socket_file_descriptor, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC) != sizeof(greeting))
+    {
+        Close();
+        return false;
+    }
+
+    const cmsghdr* control_message = CMSG_FIRSTHDR(&message);
+    int memory_fd = -1;
+
+    if(control_message != nullptr && control_message->cmsg_level == SOL_SOCKET && control_message->cmsg_type == SCM_RIGHTS)
+    {
+        std::memcpy(&memory_fd, CMSG_DATA(control_message), sizeof(memory_fd));
+    }
+
+    const bool is_mapped = memory_fd != -1 && greeting.magic == SharedMemoryChannel::GREETING_MAGIC && m_channel.Map(memory_fd, greeting.ring_capacity);
+
+    // the mapping keeps the memory alive on its own
+    if(memory_fd != -1)
+    {
+        close(memory_fd);
+    }
+
+    if(not is_mapped)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool SharedMemoryClient::Send(std::span<const char> bytes, std::chrono::milliseconds timeout)
+{
+    if(m_socket_file_descriptor == -1)
+    {
+        return false;
+    }
+
+    SharedMemoryRing& ring = m_channel.GetClientToServerRing();
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    size_t spin_count = 0;
+
+    while(not bytes.empty())
+    {
+        const ssize_t written_size = ring.Write(bytes);
+
+        if(written_size == -1)
+        {
+            return false;
+        }
+
+        if(written_size != 0)
+        {
+            bytes = bytes.subspan(written_size);
+            spin_count = 0;
+
+            if(ring.TakeConsumerWakeup())
+            {
+                RingDoorbell();
+            }
+
+            continue;
+        }
+
+        // the server usually drains the ring within a few microseconds, which is much cheaper to wait out than a sleep
+        if(++spin_count < SPIN_COUNT)
+        {
+            continue;
+        }
+
+        if(ring.ArmProducerWakeup() && WaitForDoorbell(deadline) != 1)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+ssize_t SharedMemoryClient::Receive(char* buffer, size_t size, std::chrono::milliseconds timeout)
+{
+    if(m_socket_file_descriptor == -1)
+    {
+        return -1;
+    }
+
+    SharedMemoryRing& ring = m_channel.GetServerToClientRing();
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    size_t spin_count = 0;
+
+    while(true)
+    {
+        const ssize_t read_size = ring.Read(buffer, size);
+
+        if(read_size == -1)
+        {
+            return -1;
+        }
+
+        if(read_size != 0)
+        {
+            if(ring.TakeProducerWakeup())
+            {
+                RingDoorbell();
+            }
+
+            return read_size;
+        }
+
+        if(++spin_count < SPIN_COUNT || not ring.ArmConsumerWakeup())
+        {
+            continue;
+        }
+
+        const int wait_result = WaitForDoorbell(deadline);
+
+        // bytes the server wrote before it hung up are still delivered
+        if(wait_result == 0 || (wait_result == -1 && ring.IsEmpty()))
+        {
+            return wait_result;
+        }
+
+        spin_count = 0;
+    }
+}
+
+void SharedMemoryClient::Close()
+{
+    if(m_socket_file_descriptor != -1)
+    {
+        close(m_socket_file_descriptor);
+        m_socket_file_descriptor = -1;
+    }
+}
+
+int SharedMemoryClient::WaitForDoorbell(std::chrono::steady_clock::time_point deadline)
+{
+    const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    pollfd poll_file_descriptor{m_socket_file_descriptor, POLLIN, 0};
+
+    if(remaining.count() <= 0 || poll(&poll_file_descriptor, 1, remaining.count()) != 1)
+    {
+        return 0;
+    }
+
+    // several doorbells may have piled up, one wakeup covers all of them
+    char doorbells[64];
+    ssize_t read_bytes = 0;
+
+    while((read_bytes = recv(m_socket_file_descriptor, doorbells, sizeof(doorbells), MSG_DONTWAIT)) > 0)
+    {
+    }
+
+    return read_bytes == 0 ? -1 : 1;
+}
+
+void SharedMemoryClient::RingDoorbell()
+{
+    const char doorbell = 0;
+    (void)send(m_socket_file_descriptor, &doorbell, sizeof(doorbell), MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+} // namespace InterProcessCommunication
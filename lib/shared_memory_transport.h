@@ -0,0 +1,175 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <sys/types.h>
+
+namespace InterProcessCommunication
+{
+/*
+    A single producer, single consumer byte ring that lives in memory shared by two processes. Like a stream socket, it carries a byte stream
+    without message boundaries. Positions only ever grow, and the capacity is a power of two, so a position maps to its byte with a mask.
+    Either side can write anything into the mapping, so each side keeps its own position to itself and only trusts the other's as far as it fits the ring.
+*/
+class SharedMemoryRing
+{
+public:
+
+    /*
+        The control block at the start of a ring. The positions sit on cache lines of their own, so that the producer and the consumer do not contend for one.
+    */
+    struct Header
+    {
+        alignas(64) std::atomic<uint64_t> write_position;
+        alignas(64) std::atomic<uint64_t> read_position;
+        alignas(64) std::atomic<uint32_t> is_consumer_waiting; // the consumer sleeps until the producer rings its doorbell
+        std::atomic<uint32_t> is_producer_waiting; // the producer sleeps until the consumer makes room
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring positions have to be lock-free to be shared between processes");
+
+    SharedMemoryRing() = default;
+    SharedMemoryRing(void* memory, size_t capacity);
+
+    /*
+        Bytes that a ring of "capacity" takes up in the mapping, header included.
+    */
+    static size_t GetMappingSize(size_t capacity);
+
+    /*
+        Copy as many of "bytes" into the ring as fit, and return how many did, or -1 if the consumer's position is out of range. Producer only.
+    */
+    ssize_t Write(std::span<const char> bytes);
+
+    /*
+        Copy up to "size" bytes out of the ring, and return how many there were, or -1 if the producer's position is out of range. Consumer only.
+    */
+    ssize_t Read(char* buffer, size_t size);
+
+    /*
+        Consumer only. A position out of range counts as not empty, so that the next Read() reports it.
+    */
+    bool IsEmpty() const;
+
+    /*
+        Producer only. A position out of range counts as full.
+    */
+    bool IsFull() const;
+
+    /*
+        Spin-then-sleep support. A side that found nothing to do arms its wakeup and checks again: only if the ring is still empty (or full) may it sleep,
+        because the other side may have acted just before the wakeup was armed. The other side takes the wakeup after it acted, and rings the doorbell if there was one.
+    */
+    bool ArmConsumerWakeup();
+    bool TakeConsumerWakeup();
+    bool ArmProducerWakeup();
+    bool TakeProducerWakeup();
+
+private:
+
+    Header* m_header = nullptr;
+    char* m_data = nullptr;
+    size_t m_capacity = 0;
+    uint64_t m_write_position = 0; // the producer's own copy, which the consumer cannot touch
+    uint64_t m_read_position = 0; // the consumer's own copy
+};
+
+/*
+    The shared mapping behind one shared memory client: a ring for each direction in a single memfd.
+*/
+class SharedMemoryChannel
+{
+public:
+
+    /*
+        The greeting the server sends on the Unix socket, with the memfd attached as SCM_RIGHTS.
+    */
+    struct Greeting
+    {
+        uint32_t magic = GREETING_MAGIC;
+        uint32_t reserved = 0;
+        uint64_t ring_capacity = 0;
+    };
+
+    static constexpr uint32_t GREETING_MAGIC = 0x4E42534D; // "NBSM"
+
+    SharedMemoryChannel() = default;
+    ~SharedMemoryChannel();
+
+    SharedMemoryChannel(const SharedMemoryChannel&) = delete;
+    SharedMemoryChannel& operator=(const SharedMemoryChannel&) = delete;
+
+    /*
+        Create and map a new memfd with rings of "ring_capacity" bytes, rounded up to a power of two. Returns the memfd for the peer, which the caller closes, or -1.
+    */
+    int Create(size_t ring_capacity);
+
+    /*
+        Map the memfd a peer created.
+    */
+    bool Map(int memory_file_descriptor, size_t ring_capacity);
+
+    size_t GetRingCapacity() const;
+    size_t GetMappingSize() const;
+    SharedMemoryRing& GetClientToServerRing();
+    SharedMemoryRing& GetServerToClientRing();
+
+private:
+
+    void* m_memory = nullptr;
+    size_t m_mapping_size = 0;
+    size_t m_ring_capacity = 0;
+    SharedMemoryRing m_client_to_server_ring;
+    SharedMemoryRing m_server_to_client_ring;
+
+    bool MapRings(int memory_file_descriptor, size_t ring_capacity);
+};
+
+/*
+    The client side of a shared memory endpoint. The Unix socket only carries the greeting, single doorbell bytes and the hangup;
+    the bytes themselves go through the rings without a system call while the other side is awake.
+*/
+class SharedMemoryClient
+{
+public:
+
+    SharedMemoryClient() = default;
+    ~SharedMemoryClient();
+
+    SharedMemoryClient(const SharedMemoryClient&) = delete;
+    SharedMemoryClient& operator=(const SharedMemoryClient&) = delete;
+
+    /*
+        Connect to a server endpoint that was configured for shared memory, and wait up to "timeout" for its greeting.
+    */
+    bool Connect(const std::string& unix_socket_path, std::chrono::milliseconds timeout, bool is_abstract = false);
+
+    /*
+        Send all of "bytes", waiting up to "timeout" for the server to make room when the ring is full.
+    */
+    bool Send(std::span<const char> bytes, std::chrono::milliseconds timeout);
+
+    /*
+        Receive up to "size" bytes, spinning for a while and then sleeping up to "timeout" for them to arrive.
+        Returns the number of bytes, 0 on timeout, or -1 once the server has hung up.
+    */
+    ssize_t Receive(char* buffer, size_t size, std::chrono::milliseconds timeout);
+    void Close();
+
+private:
+
+    static constexpr size_t SPIN_COUNT = 4096;
+
+    int m_socket_file_descriptor = -1;
+    SharedMemoryChannel m_channel;
+
+    /*
+        Returns 1 when the server rang, 0 when "deadline" passed, and -1 when the server has hung up.
+    */
+    int WaitForDoorbell(std::chrono::steady_clock::time_point deadline);
+    void RingDoorbell();
+};
+} // namespace InterProcessCommunication
@@ -0,0 +1,33 @@
+#pragma once
+
+namespace InterProcessCommunication
+{
+/*
+    Socket level tuning that the server applies to its listening socket and to every accepted client.
+    A value of zero keeps the kernel default. TCP specific options are ignored on Unix domain endpoints.
+*/
+struct SocketOptions
+{
+    // listener options
+    bool reuse_address = true;          // SO_REUSEADDR, lets a restarted server bind while old connections sit in TIME_WAIT
+    bool reuse_port = false;            // SO_REUSEPORT
+    int tcp_defer_accept_seconds = 0;   // TCP_DEFER_ACCEPT, only wake the server once a client has sent data
+    int tcp_fast_open_queue_length = 0; // TCP_FASTOPEN
+
+    // client options
+    bool tcp_no_delay = false;          // TCP_NODELAY, disables Nagle's algorithm
+    bool tcp_quick_ack = false;         // TCP_QUICKACK, re-armed after every read because the kernel clears it
+    int send_buffer_size = 0;           // SO_SNDBUF
+    int receive_buffer_size = 0;        // SO_RCVBUF, also applied to the listener so the TCP window is negotiated with it
+    bool keep_alive = false;            // SO_KEEPALIVE
+    int keep_alive_idle_seconds = 0;    // TCP_KEEPIDLE
+    int keep_alive_interval_seconds = 0;// TCP_KEEPINTVL
+    int keep_alive_probe_count = 0;     // TCP_KEEPCNT
+    bool rx_timestamping = false;       // SO_TIMESTAMPING with software receive timestamps, reads switch to recvmsg() to collect them
+
+    // UDP listener options
+    int udp_max_datagram_size = 2048;   // size of every receive slot, larger datagrams are dropped as truncated
+    bool udp_gro = false;               // UDP_GRO, lets the kernel coalesce datagrams of one flow into a slot, which is then sized for 64 KiB
+    bool udp_gso = false;               // UDP_SEGMENT, sends runs of equally sized datagrams to one peer as a single buffer
+};
+} // namespace InterProcessCommunication
@@ -3,6 +3,8 @@
 #include <thread>
 #include <semaphore>
 #include <memory>
+#include <netinet/tcp.h>
+#include <set>
 
 namespace InterProcessCommunication::Test
 {
@@ -40,6 +42,33 @@ protected:
         return true;
     }
 
+    /*
+        Open a client socket and connect it to the server. Returns -1 on failure.
+    */
+    int ConnectClientSocket(const TcpEndpoint& tcp_endpoint)
+    {
+        const int client_socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+        if (client_socket_fd == -1) 
+        {
+            return -1;
+        }
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(tcp_endpoint.port);
+        address.sin_addr.s_addr = inet_addr(tcp_endpoint.ip_address.c_str());
+
+        if (connect(client_socket_fd, (struct sockaddr*)&address, sizeof(address)) == -1) 
+        {
+            perror("CLIENT -> Connect failed");
+            close(client_socket_fd);
+            return -1;
+        }
+
+        return client_socket_fd;
+    }
+
 public:
     void ConnectorClient(TcpEndpoint tcp_endpoint, std::binary_semaphore& close_condition, std::function<void()> end_callback)
     {
@@ -238,7 +267,7 @@ TEST_F(NonBlockingTcpSocketServerTest, SendAndReceivePayload_OneClient)
     std::vector<char> rx_buffer;
     rx_buffer.reserve(CLIENT_RX_BUFFER_SIZE);
 
-    server.SetRxCallback([&](int client_fd, const std::span<char>& rx_payload)
+    server.SetRxCallback([&](int, const std::span<char>& rx_payload)
     {
         for(const char& byte : rx_payload)
         {
@@ -347,19 +376,15 @@ TEST_F(NonBlockingTcpSocketServerTest, SendAndReceivePayload_TwoClients)
     , "2"
     );
 
-    uint rx_payloads_received = 0;
+    const auto is_payload_complete = [&](const auto& pair)
+    {
+        return pair.second.size() == client_tx_payload.size();
+    };
 
-    while(rx_payloads_received < client_count)
+    // a client counts once its whole payload is in, no matter how many passes it stays complete for
+    while(static_cast<uint>(std::count_if(rx_buffers.begin(),rx_buffers.end(),is_payload_complete)) < client_count)
     {
         server.Run();
-
-        for(const auto& pair : rx_buffers)
-        {
-            if(pair.second.size() == client_tx_payload.size())
-            {
-                ++rx_payloads_received;
-            }
-        }
     }
 
     // shutdown the server to free the port and not interfere with other tests
@@ -380,6 +405,322 @@ TEST_F(NonBlockingTcpSocketServerTest, SendAndReceivePayload_TwoClients)
     }
 }
 
+/*
+    This test validates that socket options are applied to accepted clients and that the listener can be rebound right away
+*/
+TEST_F(NonBlockingTcpSocketServerTest, SocketOptions)
+{
+    SocketOptions socket_options;
+    socket_options.tcp_no_delay = true;
+    socket_options.keep_alive = true;
+    socket_options.keep_alive_idle_seconds = 30;
 
-} // InterProcessCommunication::Test
+    int client_no_delay = 0;
+    int client_keep_alive = 0;
+    int client_keep_alive_idle = 0;
+
+    for(size_t iteration = 0; iteration < 2; ++iteration)
+    {
+        NonBlockingSocketServer server(m_tcp_endpoint,1,std::chrono::milliseconds(10),false,nullptr,socket_options);
+        bool client_connected = false;
+
+        server.SetConnectCallback([&](int client_fd)
+        {
+            socklen_t size = sizeof(int);
+            getsockopt(client_fd,IPPROTO_TCP,TCP_NODELAY,&client_no_delay,&size);
+            getsockopt(client_fd,SOL_SOCKET,SO_KEEPALIVE,&client_keep_alive,&size);
+            getsockopt(client_fd,IPPROTO_TCP,TCP_KEEPIDLE,&client_keep_alive_idle,&size);
+            client_connected = true;
+        });
+
+        // SO_REUSEADDR lets the second iteration bind while the first connection is still in TIME_WAIT
+        ASSERT_TRUE(server.Start());
+
+        const int client_fd = ConnectClientSocket(m_tcp_endpoint);
+        ASSERT_NE(client_fd,-1);
+
+        while(not client_connected)
+        {
+            server.Run();
+        }
+
+        server.RequestStop();
+
+        while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+        {
+            server.Run();
+        }
+
+        close(client_fd);
+
+        EXPECT_NE(client_no_delay,0);
+        EXPECT_NE(client_keep_alive,0);
+        EXPECT_EQ(client_keep_alive_idle,30);
+    }
+}
+
+/*
+    This test validates that one server accepts clients on TCP, Unix domain and abstract Unix domain listeners, and reports which listener each client used
+*/
+TEST_F(NonBlockingTcpSocketServerTest, MultipleListeners)
+{
+    const std::string unix_socket_path = "multiple_listeners.sock";
+    const std::string abstract_socket_name = "non_blocking_socket_server_test";
+
+    const std::vector<NonBlockingSocketServer::ListenerEndpoint> listener_endpoints
+    {
+        m_tcp_endpoint,
+        NonBlockingSocketServer::UnixEndpoint{ .path = unix_socket_path },
+        NonBlockingSocketServer::UnixEndpoint{ .path = abstract_socket_name, .is_abstract = true }
+    };
+
+    NonBlockingSocketServer server(listener_endpoints,listener_endpoints.size());
+
+    std::map<int,size_t> client_listener_indices;
+
+    server.SetConnectCallback([&](int client_fd, size_t listener_index)
+    {
+        client_listener_indices[client_fd] = listener_index;
+    });
+
+    ASSERT_TRUE(server.Start());
+    EXPECT_EQ(server.GetListenerCount(),listener_endpoints.size());
+
+    std::vector<int> client_fds;
+    client_fds.emplace_back(ConnectClientSocket(m_tcp_endpoint));
+
+    sockaddr_un unix_address{};
+    unix_address.sun_family = AF_UNIX;
+    strncpy(unix_address.sun_path, unix_socket_path.c_str(), sizeof(unix_address.sun_path) - 1);
+    client_fds.emplace_back(socket(AF_UNIX, SOCK_STREAM, 0));
+    EXPECT_EQ(connect(client_fds.back(), (struct sockaddr*)&unix_address, sizeof(unix_address)),0);
+
+    sockaddr_un abstract_address{};
+    abstract_address.sun_family = AF_UNIX;
+    memcpy(abstract_address.sun_path + 1, abstract_socket_name.data(), abstract_socket_name.size());
+    client_fds.emplace_back(socket(AF_UNIX, SOCK_STREAM, 0));
+    EXPECT_EQ(connect(client_fds.back(), (struct sockaddr*)&abstract_address, offsetof(sockaddr_un, sun_path) + 1 + abstract_socket_name.size()),0);
+
+    while(client_listener_indices.size() < listener_endpoints.size())
+    {
+        server.Run();
+    }
+
+    // every listener index shows up exactly once
+    std::set<size_t> listener_indices;
+
+    for(const auto& pair : client_listener_indices)
+    {
+        EXPECT_EQ(server.GetListenerIndex(pair.first),pair.second);
+        listener_indices.insert(pair.second);
+    }
+
+    EXPECT_EQ(listener_indices,(std::set<size_t>{0,1,2}));
+
+    for(const int& client_fd : client_fds)
+    {
+        close(client_fd);
+    }
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that kernel receive timestamps produce a queueing delay for the callback and the histogram
+*/
+TEST_F(NonBlockingTcpSocketServerTest, RxTimestamping)
+{
+    SocketOptions socket_options;
+    socket_options.rx_timestamping = true;
+
+    NonBlockingSocketServer server(m_tcp_endpoint,1,std::chrono::milliseconds(10),false,nullptr,socket_options);
+
+    bool client_connected = false;
+    bool payload_received = false;
+    std::chrono::nanoseconds rx_queue_delay {};
+
+    server.SetConnectCallback([&](int)
+    {
+        client_connected = true;
+    });
+
+    server.SetRxCallback([&](int, const std::span<char>&, std::chrono::nanoseconds delay)
+    {
+        rx_queue_delay = delay;
+        payload_received = true;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int client_fd = ConnectClientSocket(m_tcp_endpoint);
+    ASSERT_NE(client_fd,-1);
+
+    while(not client_connected)
+    {
+        server.Run();
+    }
+
+    // the kernel switches receive timestamps on from deferred work, so bytes sent right after the option was set may arrive without one
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // let the bytes sit in the socket for a while before the server gets to them
+    const std::string payload = "timestamped";
+    ASSERT_EQ(send(client_fd,payload.data(),payload.size(),0),payload.size());
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    while(not payload_received)
+    {
+        server.Run();
+    }
+
+    EXPECT_GE(rx_queue_delay,std::chrono::milliseconds(20));
+    EXPECT_EQ(server.GetRxQueueDelayHistogram().GetCount(),1);
+    EXPECT_GE(server.GetRxQueueDelayHistogram().GetPercentile(50),std::chrono::milliseconds(20));
+
+    close(client_fd);
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that a steering callback can hand an accepted client over to another server
+*/
+TEST_F(NonBlockingTcpSocketServerTest, SteerClientToAnotherServer)
+{
+    const NonBlockingSocketServer::TcpEndpoint other_endpoint{m_tcp_endpoint.ip_address, static_cast<uint16_t>(m_tcp_endpoint.port + 1)};
+
+    NonBlockingSocketServer accepting_server(m_tcp_endpoint);
+    NonBlockingSocketServer serving_server(other_endpoint);
+
+    int steered_incoming_cpu = -2;
+    int served_client_fd = -1;
+    std::string received_payload;
+
+    accepting_server.SetSteeringCallback([&](int client_fd, int incoming_cpu)
+    {
+        steered_incoming_cpu = incoming_cpu;
+        serving_server.AdoptClient(client_fd);
+        return true;
+    });
+
+    serving_server.SetConnectCallback([&](int client_fd, size_t listener_index)
+    {
+        EXPECT_EQ(listener_index,0);
+        served_client_fd = client_fd;
+    });
+
+    serving_server.SetRxCallback([&](int, const std::span<char>& rx_payload)
+    {
+        received_payload.append(rx_payload.begin(),rx_payload.end());
+    });
+
+    ASSERT_TRUE(accepting_server.Start());
+    ASSERT_TRUE(serving_server.Start());
+
+    const int client_fd = ConnectClientSocket(m_tcp_endpoint);
+    ASSERT_NE(client_fd,-1);
+
+    while(served_client_fd == -1)
+    {
+        accepting_server.Run();
+        serving_server.Run();
+    }
+
+    EXPECT_GE(steered_incoming_cpu,-1);
+    EXPECT_TRUE(accepting_server.GetClientFileDescriptors().empty());
+    EXPECT_EQ(serving_server.GetClientFileDescriptors().size(),1);
+    EXPECT_EQ(serving_server.GetIncomingCpu(served_client_fd),steered_incoming_cpu);
+
+    const std::string payload = "steered";
+    ASSERT_EQ(send(client_fd,payload.data(),payload.size(),0),payload.size());
+
+    while(received_payload != payload)
+    {
+        serving_server.Run();
+    }
+
+    close(client_fd);
+
+    accepting_server.RequestStop();
+    serving_server.RequestStop();
+
+    while(accepting_server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED || serving_server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        accepting_server.Run();
+        serving_server.Run();
+    }
+}
+
+TEST_F(NonBlockingTcpSocketServerTest, InheritedListener)
+{
+    // the supervisor side: a socket that is bound and listening before the server exists
+    const int listener_fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_NE(listener_fd,-1);
+
+    const int reuse_address = 1;
+    ASSERT_EQ(setsockopt(listener_fd,SOL_SOCKET,SO_REUSEADDR,&reuse_address,sizeof(reuse_address)),0);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(m_tcp_endpoint.port);
+    address.sin_addr.s_addr = inet_addr(m_tcp_endpoint.ip_address.c_str());
+    ASSERT_EQ(bind(listener_fd,reinterpret_cast<sockaddr*>(&address),sizeof(address)),0);
+    ASSERT_EQ(listen(listener_fd,SOMAXCONN),0);
+
+    // a client that connects before the server has started is already queued on the socket instead of refused
+    const int client_fd = ConnectClientSocket(m_tcp_endpoint);
+    ASSERT_NE(client_fd,-1);
+
+    NonBlockingSocketServer server(NonBlockingSocketServer::InheritedEndpoint{listener_fd});
+    ASSERT_TRUE(server.Start());
+
+    while(server.GetClientFileDescriptors().empty())
+    {
+        server.Run();
+    }
+
+    EXPECT_EQ(server.GetListenerIndex(server.GetClientFileDescriptors().front()),0);
+
+    close(client_fd);
 
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+
+    // the server closed the socket it took over
+    EXPECT_EQ(fcntl(listener_fd,F_GETFD),-1);
+
+    // what is not a bound socket is refused
+    int pipe_fds[2];
+    ASSERT_EQ(pipe(pipe_fds),0);
+    close(pipe_fds[1]);
+    NonBlockingSocketServer pipe_server(NonBlockingSocketServer::InheritedEndpoint{pipe_fds[0]});
+    EXPECT_FALSE(pipe_server.Start());
+
+    NonBlockingSocketServer unbound_server(NonBlockingSocketServer::InheritedEndpoint{socket(AF_INET, SOCK_STREAM, 0)});
+    EXPECT_FALSE(unbound_server.Start());
+
+    // activation variables meant for another process are ignored and left for that process
+    setenv("LISTEN_PID",std::to_string(getpid() + 1).c_str(),1);
+    setenv("LISTEN_FDS","1",1);
+    EXPECT_TRUE(NonBlockingSocketServer::GetSocketActivationEndpoints().empty());
+    EXPECT_STREQ(getenv("LISTEN_FDS"),"1");
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+}
+
+
+} // InterProcessCommunication::Test
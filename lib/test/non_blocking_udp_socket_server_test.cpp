@@ -0,0 +1,176 @@
+#include "non_blocking_socket_server.h"
+#include <gtest/gtest.h>
+#include <poll.h>
+
+namespace InterProcessCommunication::Test
+{
+
+using UdpEndpoint = NonBlockingSocketServer::UdpEndpoint;
+
+class NonBlockingUdpSocketServerTest : public ::testing::Test
+{
+protected:
+    const UdpEndpoint m_udp_endpoint { .ip_address = "127.0.0.1", .port = 20100 };
+
+    void SetUp() {}
+    void TearDown() {}
+
+    /*
+        Open a client socket that sends to the server by default. Returns -1 on failure.
+    */
+    int ConnectClientSocket(const UdpEndpoint& udp_endpoint)
+    {
+        const int client_socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+        if (client_socket_fd == -1)
+        {
+            return -1;
+        }
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(udp_endpoint.port);
+        address.sin_addr.s_addr = inet_addr(udp_endpoint.ip_address.c_str());
+
+        if (connect(client_socket_fd, (struct sockaddr*)&address, sizeof(address)) == -1)
+        {
+            perror("CLIENT -> Connect failed");
+            close(client_socket_fd);
+            return -1;
+        }
+
+        return client_socket_fd;
+    }
+
+    /*
+        Run the server until the client has a datagram to read, then read it. Returns an empty string on timeout.
+    */
+    std::string ReceiveDatagram(NonBlockingSocketServer& server, int client_fd)
+    {
+        for(size_t attempt = 0; attempt < 100; ++attempt)
+        {
+            server.RunOnce(std::chrono::milliseconds(0));
+
+            pollfd poll_fd{client_fd, POLLIN, 0};
+
+            if(poll(&poll_fd, 1, 10) == 1)
+            {
+                char rx_buffer[2048];
+                const ssize_t read_bytes = recv(client_fd, rx_buffer, sizeof(rx_buffer), 0);
+                return read_bytes > 0 ? std::string(rx_buffer, read_bytes) : std::string();
+            }
+        }
+
+        return {};
+    }
+
+    void Stop(NonBlockingSocketServer& server)
+    {
+        server.RequestStop();
+
+        while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+        {
+            server.Run();
+        }
+    }
+};
+
+TEST_F(NonBlockingUdpSocketServerTest, EchoDatagrams)
+{
+    NonBlockingSocketServer server(std::vector<NonBlockingSocketServer::ListenerEndpoint>{m_udp_endpoint});
+    std::vector<std::string> received_datagrams;
+
+    server.SetDatagramCallback([&](size_t listener_index, const NonBlockingSocketServer::DatagramPeer& peer, const std::span<char>& datagram)
+    {
+        EXPECT_EQ(listener_index,0);
+        EXPECT_EQ(peer.ToString().rfind("127.0.0.1:",0),0);
+        received_datagrams.emplace_back(datagram.begin(),datagram.end());
+        EXPECT_TRUE(server.EnqueueDatagram(listener_index,peer,datagram));
+    });
+
+    ASSERT_TRUE(server.Start());
+    EXPECT_TRUE(server.GetClientFileDescriptors().empty());
+
+    const int client_fd = ConnectClientSocket(m_udp_endpoint);
+    ASSERT_NE(client_fd,-1);
+
+    const std::vector<std::string> payloads = {"first", "", "third datagram"};
+
+    for(const std::string& payload : payloads)
+    {
+        ASSERT_EQ(send(client_fd,payload.data(),payload.size(),0),payload.size());
+    }
+
+    // the empty datagram is echoed as well, so the non-empty one behind it shows that nothing was skipped
+    for(const std::string& payload : payloads)
+    {
+        EXPECT_EQ(ReceiveDatagram(server,client_fd),payload);
+    }
+
+    EXPECT_EQ(received_datagrams,payloads);
+
+    // datagrams that do not fit one UDP payload are refused
+    const std::vector<char> oversized_datagram(70000);
+    NonBlockingSocketServer::DatagramPeer peer{};
+    EXPECT_FALSE(server.EnqueueDatagram(0,peer,oversized_datagram));
+    EXPECT_FALSE(server.EnqueueDatagram(1,peer,std::span<const char>()));
+
+    close(client_fd);
+    Stop(server);
+}
+
+TEST_F(NonBlockingUdpSocketServerTest, SegmentationOffload)
+{
+    SocketOptions socket_options;
+    socket_options.udp_gro = true;
+    socket_options.udp_gso = true;
+
+    NonBlockingSocketServer server(std::vector<NonBlockingSocketServer::ListenerEndpoint>{m_udp_endpoint},1,std::chrono::milliseconds(10),false,nullptr,socket_options);
+    std::vector<std::string> received_datagrams;
+    NonBlockingSocketServer::DatagramPeer client_peer{};
+
+    server.SetDatagramCallback([&](size_t, const NonBlockingSocketServer::DatagramPeer& peer, const std::span<char>& datagram)
+    {
+        client_peer = peer;
+        received_datagrams.emplace_back(datagram.begin(),datagram.end());
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int client_fd = ConnectClientSocket(m_udp_endpoint);
+    ASSERT_NE(client_fd,-1);
+
+    // equally sized datagrams of one flow may be coalesced by GRO, but are still delivered one by one
+    std::vector<std::string> payloads;
+
+    for(char index = 0; index < 5; ++index)
+    {
+        payloads.emplace_back(100,static_cast<char>('a' + index));
+        ASSERT_EQ(send(client_fd,payloads.back().data(),payloads.back().size(),0),payloads.back().size());
+    }
+
+    for(size_t attempt = 0; attempt < 100 && received_datagrams.size() < payloads.size(); ++attempt)
+    {
+        server.RunOnce(std::chrono::milliseconds(10));
+    }
+
+    EXPECT_EQ(received_datagrams,payloads);
+
+    // a run of equally sized datagrams with a shorter last one goes out as one GSO send, and arrives as separate datagrams
+    payloads.emplace_back(40,'z');
+
+    for(const std::string& payload : payloads)
+    {
+        ASSERT_TRUE(server.EnqueueDatagram(0,client_peer,std::span<const char>(payload.data(),payload.size())));
+    }
+
+    for(const std::string& payload : payloads)
+    {
+        EXPECT_EQ(ReceiveDatagram(server,client_fd),payload);
+    }
+
+    close(client_fd);
+    Stop(server);
+}
+
+} // InterProcessCommunication::Test
@@ -3,9 +3,41 @@
 #include <thread>
 #include <semaphore>
 #include <memory>
+#include <memory_resource>
+#include <poll.h>
+#include <sys/mman.h>
 
 namespace InterProcessCommunication::Test
 {
+/*
+    Memory resource that counts the allocations it forwards to the global heap
+*/
+class CountingMemoryResource : public std::pmr::memory_resource
+{
+public:
+    size_t allocation_count = 0;
+    size_t outstanding_bytes = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        ++allocation_count;
+        outstanding_bytes += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes,alignment);
+    }
+
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+    {
+        outstanding_bytes -= bytes;
+        std::pmr::new_delete_resource()->deallocate(pointer,bytes,alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
 class NonBlockingUnixDomainSocketServerTest : public ::testing::Test
 {
 protected:
@@ -37,6 +69,32 @@ protected:
         return true;
     }
 
+    /*
+        Open a client socket and connect it to the server. Returns -1 on failure.
+    */
+    int ConnectClientSocket(const std::string& unix_socket_path)
+    {
+        const int client_socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (client_socket_fd == -1) 
+        {
+            return -1;
+        }
+
+        sockaddr_un server_address{};
+        server_address.sun_family = AF_UNIX;
+        strncpy(server_address.sun_path, unix_socket_path.c_str(), sizeof(server_address.sun_path) - 1);
+
+        if (connect(client_socket_fd, (struct sockaddr*)&server_address, sizeof(server_address)) == -1) 
+        {
+            perror("CLIENT -> Connect failed");
+            close(client_socket_fd);
+            return -1;
+        }
+
+        return client_socket_fd;
+    }
+
 public:
     void ConnectorClient(std::string unix_socket_path, std::binary_semaphore& close_condition, std::function<void()> end_callback)
     {
@@ -224,7 +282,7 @@ TEST_F(NonBlockingUnixDomainSocketServerTest, SendAndReceivePayload_OneClient)
     std::vector<char> rx_buffer;
     rx_buffer.reserve(CLIENT_RX_BUFFER_SIZE);
 
-    server.SetRxCallback([&](int client_fd, const std::span<char>& rx_payload)
+    server.SetRxCallback([&](int, const std::span<char>& rx_payload)
     {
         for(const char& byte : rx_payload)
         {
@@ -324,30 +382,1921 @@ TEST_F(NonBlockingUnixDomainSocketServerTest, SendAndReceivePayload_TwoClients)
     , "2"
     );
 
-    uint rx_payloads_received = 0;
+    const auto is_payload_complete = [&](const auto& pair)
+    {
+        return pair.second.size() == client_tx_payload.size();
+    };
+
+    // a client counts once its whole payload is in, no matter how many passes it stays complete for
+    while(static_cast<uint>(std::count_if(rx_buffers.begin(),rx_buffers.end(),is_payload_complete)) < client_count)
+    {
+        server.Run();
+    }
+
+    client_thread1.join();
+    client_thread2.join();
+
+    for(const auto& pair : rx_buffers)
+    {
+         EXPECT_TRUE(ArePayloadsEqual(client_tx_payload,pair.second));
+    }
+}
+
+/*
+    This test validates that idle clients hold no buffers and stay well under 1 KB of user-space state each
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, IdleConnectionMemoryUsage)
+{
+    const size_t client_count = 64;
+    NonBlockingSocketServer server(m_unix_socket_path,client_count);
+
+    server.Start();
+
+    std::vector<int> client_fds;
+
+    for(size_t index = 0; index < client_count; ++index)
+    {
+        const int client_fd = ConnectClientSocket(m_unix_socket_path);
+        ASSERT_NE(client_fd,-1);
+        client_fds.emplace_back(client_fd);
+    }
+
+    while(server.GetClientFileDescriptors().size() < client_count)
+    {
+        server.Run();
+    }
+
+    const NonBlockingSocketServer::MemoryUsage usage = server.GetMemoryUsage();
+
+    EXPECT_EQ(usage.connection_count,client_count);
+    EXPECT_EQ(usage.buffer_pool_borrowed_bytes,0);
+    EXPECT_EQ(usage.tx_queue_bytes,0);
+    EXPECT_LT((usage.connection_table_bytes + usage.client_list_bytes) / client_count, 1024);
+
+    for(const int& client_fd : client_fds)
+    {
+        close(client_fd);
+    }
 
-    while(rx_payloads_received < client_count)
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
     {
         server.Run();
+    }
+}
+
+/*
+    This test validates that queued messages and buffers are allocated from a caller supplied memory resource
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, CustomMemoryResource)
+{
+    CountingMemoryResource memory_resource;
+
+    {
+        NonBlockingSocketServer server(m_unix_socket_path,1,std::chrono::milliseconds(10),false,&memory_resource);
+
+        const std::string server_tx_string = "hello from server";
+        const std::string client_tx_string = "hello from client";
+        std::vector<char> server_tx_payload(server_tx_string.begin(), server_tx_string.end());
+        const std::vector<char> client_tx_payload(client_tx_string.begin(), client_tx_string.end());
+
+        std::vector<char> rx_buffer;
+
+        server.SetRxCallback([&](int, const std::span<char>& rx_payload)
+        {
+            rx_buffer.insert(rx_buffer.end(),rx_payload.begin(),rx_payload.end());
+        });
+
+        server.SetConnectCallback([&](int client_fd)
+        {
+            server.EnqueueSend(client_fd,server_tx_payload);
+        });
+
+        server.Start();
+
+        std::thread client_thread(&NonBlockingUnixDomainSocketServerTest::ReaderSenderClient
+        ,this
+        ,m_unix_socket_path
+        ,[]()
+        {
+            std::cout << "CLIENT -> Done\n";
+        }
+        , client_tx_payload
+        , server_tx_payload
+        , "1"
+        );
+
+        while(rx_buffer.size() < client_tx_payload.size())
+        {
+            server.Run();
+        }
+
+        server.RequestStop();
+
+        while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+        {
+            server.Run();
+        }
+
+        client_thread.join();
+
+        EXPECT_TRUE(ArePayloadsEqual(client_tx_payload,rx_buffer));
+        // at least the tx message and the read buffer slab came from the memory resource
+        EXPECT_GE(memory_resource.allocation_count,2);
+    }
+
+    // everything is handed back once the server is gone
+    EXPECT_EQ(memory_resource.outstanding_bytes,0);
+}
+
+/*
+    This test validates that received payloads are handled on worker threads, in order, and that replies posted from a worker reach the client
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, WorkerDispatch)
+{
+    NonBlockingSocketServer server(m_unix_socket_path);
+    server.EnableWorkerDispatch(2);
+
+    const std::thread::id reactor_thread_id = std::this_thread::get_id();
+    std::atomic<bool> ran_on_reactor_thread = false;
+    std::atomic<bool> saw_user_context = false;
+    std::atomic<bool> client_disconnected = false;
+    int user_context = 0;
+
+    server.SetConnectCallback([&](NonBlockingSocketServer::ConnectionRef connection)
+    {
+        connection.SetUserContext(&user_context);
+    });
+
+    // the worker echoes everything back, so the client reading its own bytes back in order proves the ordering end to end
+    server.SetRxCallback([&](NonBlockingSocketServer::ConnectionRef connection, const std::span<char>& rx_payload)
+    {
+        if(std::this_thread::get_id() == reactor_thread_id)
+        {
+            ran_on_reactor_thread = true;
+        }
+
+        // the context may already be freed by the DisconnectCallback while a worker runs
+        if(connection.GetUserContext() != nullptr)
+        {
+            saw_user_context = true;
+        }
+
+        server.PostSend(connection,std::vector<char>(rx_payload.begin(),rx_payload.end()));
+    });
+
+    server.SetDisconnectCallback([&](int)
+    {
+        client_disconnected = true;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    std::vector<char> client_tx_payload;
+
+    for(size_t index = 0; index < 4096; ++index)
+    {
+        client_tx_payload.emplace_back(static_cast<char>('a' + index % 26));
+    }
 
-        for(const auto& pair : rx_buffers)
+    std::thread client_thread([&]()
+    {
+        const int client_fd = ConnectClientSocket(m_unix_socket_path);
+        ASSERT_NE(client_fd,-1);
+
+        ASSERT_EQ(send(client_fd,client_tx_payload.data(),client_tx_payload.size(),0),client_tx_payload.size());
+
+        std::vector<char> accumulated_rx_payload;
+        std::vector<char> rx_buffer(CLIENT_RX_BUFFER_SIZE);
+
+        while(accumulated_rx_payload.size() < client_tx_payload.size())
         {
-            if(pair.second.size() == client_tx_payload.size())
+            const ssize_t read_result = read(client_fd,rx_buffer.data(),rx_buffer.size());
+
+            if(read_result <= 0)
             {
-                ++rx_payloads_received;
+                break;
             }
+
+            accumulated_rx_payload.insert(accumulated_rx_payload.end(),rx_buffer.begin(),rx_buffer.begin() + read_result);
         }
+
+        EXPECT_TRUE(ArePayloadsEqual(client_tx_payload,accumulated_rx_payload));
+        close(client_fd);
+    });
+
+    while(not client_disconnected)
+    {
+        server.Run();
     }
 
-    client_thread1.join();
-    client_thread2.join();
+    client_thread.join();
 
-    for(const auto& pair : rx_buffers)
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
     {
-         EXPECT_TRUE(ArePayloadsEqual(client_tx_payload,pair.second));
+        server.Run();
     }
+
+    EXPECT_FALSE(ran_on_reactor_thread);
+    EXPECT_FALSE(saw_user_context);
 }
 
+/*
+    This test validates that a payload a worker posts to another client reaches that client
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, WorkerDispatchRelay)
+{
+    NonBlockingSocketServer server(m_unix_socket_path,2);
+    server.EnableWorkerDispatch(2);
+
+    std::vector<int> server_side_fds;
+    std::atomic<int> relay_target_fd = -1;
+    bool client_disconnected = false;
 
-} // InterProcessCommunication::Test
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fds.emplace_back(client_fd);
+    });
+
+    // the first client's payloads are relayed to the second client from the first client's strand
+    server.SetRxCallback([&](int, const std::span<char>& rx_payload)
+    {
+        server.PostSend(relay_target_fd,std::vector<char>(rx_payload.begin(),rx_payload.end()));
+    });
+
+    server.SetDisconnectCallback([&](int)
+    {
+        client_disconnected = true;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int sending_client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(sending_client_fd,-1);
+
+    while(server_side_fds.size() < 1)
+    {
+        server.Run();
+    }
+
+    const int receiving_client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(receiving_client_fd,-1);
+
+    while(server_side_fds.size() < 2)
+    {
+        server.Run();
+    }
+
+    relay_target_fd = server_side_fds[1];
+
+    const std::vector<char> client_tx_payload = {'r','e','l','a','y'};
+    ASSERT_EQ(send(sending_client_fd,client_tx_payload.data(),client_tx_payload.size(),0),client_tx_payload.size());
+
+    std::vector<char> accumulated_rx_payload;
+    std::vector<char> rx_buffer(CLIENT_RX_BUFFER_SIZE);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+    while(accumulated_rx_payload.size() < client_tx_payload.size() && std::chrono::steady_clock::now() < deadline)
+    {
+        server.Run();
+
+        const ssize_t read_result = recv(receiving_client_fd,rx_buffer.data(),rx_buffer.size(),MSG_DONTWAIT);
+
+        if(read_result > 0)
+        {
+            accumulated_rx_payload.insert(accumulated_rx_payload.end(),rx_buffer.begin(),rx_buffer.begin() + read_result);
+        }
+    }
+
+    EXPECT_TRUE(ArePayloadsEqual(client_tx_payload,accumulated_rx_payload));
+
+    close(sending_client_fd);
+    close(receiving_client_fd);
+
+    while(not client_disconnected)
+    {
+        server.Run();
+    }
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that published payloads only reach the subscribers of a topic and that subscriptions end with the connection
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, PublishToSubscribers)
+{
+    const size_t client_count = 3;
+    NonBlockingSocketServer server(m_unix_socket_path,client_count);
+
+    std::vector<int> server_side_fds;
+    bool client_disconnected = false;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fds.emplace_back(client_fd);
+    });
+
+    server.SetDisconnectCallback([&](int)
+    {
+        client_disconnected = true;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    std::vector<int> client_fds;
+
+    for(size_t index = 0; index < client_count; ++index)
+    {
+        client_fds.emplace_back(ConnectClientSocket(m_unix_socket_path));
+        ASSERT_NE(client_fds.back(),-1);
+
+        // accept one client at a time, so that server_side_fds lines up with client_fds
+        while(server_side_fds.size() <= index)
+        {
+            server.Run();
+        }
+    }
+
+    EXPECT_TRUE(server.Subscribe(server_side_fds[0],"prices"));
+    EXPECT_TRUE(server.Subscribe(server_side_fds[1],"prices"));
+    EXPECT_FALSE(server.Subscribe(server_side_fds[1],"prices"));
+    EXPECT_TRUE(server.Subscribe(server_side_fds[2],7));
+
+    const std::string tick = "tick";
+    EXPECT_EQ(server.Publish("prices",std::span<const char>(tick.data(),tick.size())),2);
+    server.Run();
+
+    std::vector<char> rx_buffer(CLIENT_RX_BUFFER_SIZE);
+
+    for(size_t index = 0; index < 2; ++index)
+    {
+        const ssize_t read_result = read(client_fds[index],rx_buffer.data(),rx_buffer.size());
+        ASSERT_EQ(read_result,tick.size());
+        EXPECT_EQ(std::string(rx_buffer.data(),read_result),tick);
+    }
+
+    // the subscriber of the numbered topic got nothing
+    EXPECT_EQ(recv(client_fds[2],rx_buffer.data(),rx_buffer.size(),MSG_DONTWAIT),-1);
+
+    close(client_fds[0]);
+
+    while(not client_disconnected)
+    {
+        server.Run();
+    }
+
+    EXPECT_EQ(server.GetSubscriberCount("prices"),1);
+    EXPECT_EQ(server.GetSubscriberCount(7),1);
+
+    for(size_t index = 1; index < client_count; ++index)
+    {
+        close(client_fds[index]);
+    }
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
 
+/*
+    This test validates that a read budget keeps a bulk sender from delaying a small client until the bulk transfer is drained
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, ReadBudget)
+{
+    NonBlockingSocketServer server(m_unix_socket_path,2);
+    server.SetReadBudget(1024,1);
+
+    std::vector<int> server_side_fds;
+    size_t bulk_bytes_received = 0;
+    size_t bulk_bytes_received_before_small = 0;
+    bool small_payload_received = false;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fds.emplace_back(client_fd);
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int bulk_client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(bulk_client_fd,-1);
+
+    while(server_side_fds.size() < 1)
+    {
+        server.Run();
+    }
+
+    const int small_client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(small_client_fd,-1);
+
+    while(server_side_fds.size() < 2)
+    {
+        server.Run();
+    }
+
+    server.SetRxCallback([&](int client_fd, const std::span<char>& rx_payload)
+    {
+        if(client_fd == server_side_fds[0])
+        {
+            bulk_bytes_received += rx_payload.size();
+        }
+        else if(not small_payload_received)
+        {
+            small_payload_received = true;
+            bulk_bytes_received_before_small = bulk_bytes_received;
+        }
+    });
+
+    const std::vector<char> bulk_payload(64 * 1024, 'b');
+    ASSERT_EQ(send(bulk_client_fd,bulk_payload.data(),bulk_payload.size(),0),bulk_payload.size());
+
+    const std::string small_payload = "small";
+    ASSERT_EQ(send(small_client_fd,small_payload.data(),small_payload.size(),0),small_payload.size());
+
+    while(bulk_bytes_received < bulk_payload.size() || not small_payload_received)
+    {
+        server.Run();
+    }
+
+    EXPECT_LT(bulk_bytes_received_before_small,bulk_payload.size() / 2);
+
+    close(bulk_client_fd);
+    close(small_client_fd);
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that a vectored send delivers borrowed and moved-in fragments in order, including across partial sends
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, EnqueueSendv)
+{
+    NonBlockingSocketServer server(m_unix_socket_path);
+
+    int server_side_fd = -1;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fd = client_fd;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    while(server_side_fd == -1)
+    {
+        server.Run();
+    }
+
+    const std::string header = "header:";
+    const std::string trailer = ":trailer";
+    std::vector<char> body(256 * 1024);
+
+    for(size_t index = 0; index < body.size(); ++index)
+    {
+        body[index] = static_cast<char>('a' + index % 26);
+    }
+
+    const std::string expected = header + std::string(body.begin(),body.end()) + trailer;
+
+    NonBlockingSocketServer::TxFragment fragments[] = {
+        std::span<const char>(header.data(),header.size()),
+        std::move(body),
+        std::span<const char>(trailer.data(),trailer.size())
+    };
+
+    server.EnqueueSendv(server_side_fd,fragments);
+
+    // the vector was moved into the server rather than copied
+    EXPECT_TRUE(std::get<std::vector<char>>(fragments[1]).empty());
+
+    std::string received;
+    std::vector<char> rx_buffer(CLIENT_RX_BUFFER_SIZE);
+
+    while(received.size() < expected.size())
+    {
+        server.Run();
+
+        ssize_t read_result = 0;
+
+        while((read_result = recv(client_fd,rx_buffer.data(),rx_buffer.size(),MSG_DONTWAIT)) > 0)
+        {
+            received.append(rx_buffer.data(),read_result);
+        }
+    }
+
+    EXPECT_EQ(received,expected);
+
+    close(client_fd);
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that bytes from several clients arrive in one batch, and that the end of batch hook runs before replies are flushed
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, RxBatch)
+{
+    const size_t client_count = 3;
+    NonBlockingSocketServer server(m_unix_socket_path,client_count);
+    server.SetEpollEventCapacity(16);
+
+    std::vector<size_t> batch_sizes;
+    size_t batch_end_count = 0;
+    bool is_reply_flushed_before_batch_end = false;
+    std::vector<int> client_fds;
+
+    server.SetRxBatchCallback([&](std::span<const NonBlockingSocketServer::RxRecord> records)
+    {
+        batch_sizes.emplace_back(records.size());
+
+        for(const NonBlockingSocketServer::RxRecord& record : records)
+        {
+            server.EnqueueSend(record.client_file_descriptor,record.bytes);
+        }
+    });
+
+    server.SetBatchEndCallback([&]()
+    {
+        ++batch_end_count;
+
+        char rx_byte = 0;
+        is_reply_flushed_before_batch_end = is_reply_flushed_before_batch_end || recv(client_fds[0],&rx_byte,1,MSG_DONTWAIT | MSG_PEEK) > 0;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    for(size_t index = 0; index < client_count; ++index)
+    {
+        client_fds.emplace_back(ConnectClientSocket(m_unix_socket_path));
+        ASSERT_NE(client_fds.back(),-1);
+    }
+
+    while(server.GetClientFileDescriptors().size() < client_count)
+    {
+        server.Run();
+    }
+
+    const std::string payload = "batched";
+
+    for(const int& client_fd : client_fds)
+    {
+        ASSERT_EQ(send(client_fd,payload.data(),payload.size(),0),payload.size());
+    }
+
+    while(batch_end_count == 0)
+    {
+        server.Run();
+    }
+
+    ASSERT_EQ(batch_sizes.size(),1);
+    EXPECT_EQ(batch_sizes[0],client_count);
+    EXPECT_FALSE(is_reply_flushed_before_batch_end);
+
+    std::vector<char> rx_buffer(CLIENT_RX_BUFFER_SIZE);
+
+    for(const int& client_fd : client_fds)
+    {
+        const ssize_t read_result = read(client_fd,rx_buffer.data(),rx_buffer.size());
+        ASSERT_EQ(read_result,payload.size());
+        EXPECT_EQ(std::string(rx_buffer.data(),read_result),payload);
+        close(client_fd);
+    }
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that the server can be driven from an outer poll loop, and that each run reports the work it did
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, RunLoopControl)
+{
+    NonBlockingSocketServer server(m_unix_socket_path);
+    int server_side_fd = -1;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fd = client_fd;
+    });
+
+    server.SetRxCallback([&](int client_fd, const std::span<char>& rx_payload)
+    {
+        server.EnqueueSend(client_fd,rx_payload);
+    });
+
+    EXPECT_EQ(server.GetPollFileDescriptor(),-1);
+    ASSERT_TRUE(server.Start());
+
+    pollfd server_poll_fd { server.GetPollFileDescriptor(), POLLIN, 0 };
+    EXPECT_EQ(poll(&server_poll_fd,1,0),0);
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    ASSERT_EQ(poll(&server_poll_fd,1,1000),1);
+    NonBlockingSocketServer::RunStats run_stats = server.RunUntilIdle();
+    EXPECT_EQ(run_stats.accepted_client_count,1);
+
+    const std::string payload = "ping";
+    ASSERT_EQ(send(client_fd,payload.data(),payload.size(),0),payload.size());
+
+    ASSERT_EQ(poll(&server_poll_fd,1,1000),1);
+    run_stats = server.RunUntilIdle();
+    EXPECT_EQ(run_stats.received_bytes,payload.size());
+    EXPECT_EQ(run_stats.read_count,1);
+    EXPECT_EQ(run_stats.sent_bytes,payload.size());
+    EXPECT_EQ(run_stats.sent_message_count,1);
+
+    std::vector<char> rx_buffer(CLIENT_RX_BUFFER_SIZE);
+    EXPECT_EQ(read(client_fd,rx_buffer.data(),rx_buffer.size()),payload.size());
+
+    // reading the reply frees send buffer space, which edge-triggered epoll reports once
+    server.RunUntilIdle();
+
+    // nothing happens while idle, but RunFor() still takes its time
+    const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    EXPECT_TRUE(server.RunFor(std::chrono::milliseconds(30)).IsIdle());
+    EXPECT_GE(std::chrono::steady_clock::now() - start_time,std::chrono::milliseconds(30));
+
+    // a payload enqueued between runs has no event of its own, but still wakes the outer loop
+    EXPECT_EQ(poll(&server_poll_fd,1,0),0);
+    std::string notice = "notice";
+    server.EnqueueSend(server_side_fd,notice);
+    ASSERT_EQ(poll(&server_poll_fd,1,0),1);
+    EXPECT_EQ(server.RunUntilIdle().sent_bytes,notice.size());
+    EXPECT_EQ(read(client_fd,rx_buffer.data(),rx_buffer.size()),notice.size());
+    server.RunUntilIdle();
+    EXPECT_EQ(poll(&server_poll_fd,1,0),0);
+
+    close(client_fd);
+    EXPECT_EQ(server.RunUntilIdle().disconnected_client_count,1);
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that small payloads are coalesced into one block, held until the flush deadline, and flushed early once they reach the threshold
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, TxCoalescing)
+{
+    NonBlockingSocketServer server(m_unix_socket_path);
+    server.SetTxCoalescing(256,std::chrono::milliseconds(20));
+
+    int server_side_fd = -1;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fd = client_fd;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    while(server_side_fd == -1)
+    {
+        server.Run();
+    }
+
+    server.RunUntilIdle();
+
+    std::string small_payload = "x";
+
+    for(size_t index = 0; index < 10; ++index)
+    {
+        server.EnqueueSend(server_side_fd,small_payload);
+    }
+
+    // held until the deadline
+    EXPECT_EQ(server.RunOnce(std::chrono::milliseconds(0)).sent_message_count,0);
+
+    std::vector<char> rx_buffer(CLIENT_RX_BUFFER_SIZE);
+    EXPECT_EQ(recv(client_fd,rx_buffer.data(),rx_buffer.size(),MSG_DONTWAIT),-1);
+
+    // the deadline wakes up an outer poll loop, and all ten payloads leave as one block
+    pollfd server_poll_fd { server.GetPollFileDescriptor(), POLLIN, 0 };
+    ASSERT_EQ(poll(&server_poll_fd,1,1000),1);
+    EXPECT_EQ(server.RunUntilIdle().sent_message_count,1);
+    EXPECT_EQ(read(client_fd,rx_buffer.data(),rx_buffer.size()),10);
+
+    server.RunUntilIdle();
+
+    // reaching the threshold flushes without waiting for the deadline
+    std::string medium_payload(100,'m');
+
+    for(size_t index = 0; index < 3; ++index)
+    {
+        server.EnqueueSend(server_side_fd,medium_payload);
+    }
+
+    EXPECT_EQ(server.RunOnce(std::chrono::milliseconds(0)).sent_bytes,300);
+
+    close(client_fd);
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that control messages overtake queued bulk messages, and that the starvation guard still lets bulk messages through
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, TxPriority)
+{
+    NonBlockingSocketServer server(m_unix_socket_path);
+    server.SetTxStarvationGuard(2);
+
+    int server_side_fd = -1;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fd = client_fd;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    while(server_side_fd == -1)
+    {
+        server.Run();
+    }
+
+    std::string bulk = "b";
+    std::string control = "c";
+
+    server.EnqueueSend(server_side_fd,bulk,NonBlockingSocketServer::TxPriority::BULK);
+    server.EnqueueSend(server_side_fd,bulk,NonBlockingSocketServer::TxPriority::BULK);
+
+    for(size_t index = 0; index < 5; ++index)
+    {
+        server.EnqueueSend(server_side_fd,control,NonBlockingSocketServer::TxPriority::CONTROL);
+    }
+
+    server.RunUntilIdle();
+
+    // every two control messages, the waiting bulk class gets a turn
+    std::vector<char> rx_buffer(CLIENT_RX_BUFFER_SIZE);
+    const ssize_t read_result = read(client_fd,rx_buffer.data(),rx_buffer.size());
+    ASSERT_EQ(read_result,7);
+    EXPECT_EQ(std::string(rx_buffer.data(),read_result),"ccbccbc");
+
+    close(client_fd);
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that a send the socket refuses does not count against waiting classes, so the starvation guard does not let them through early
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, TxPriorityBlockedSend)
+{
+    constexpr size_t CONTROL_MESSAGE_COUNT = 100;
+    NonBlockingSocketServer server(m_unix_socket_path);
+    server.SetTxStarvationGuard(CONTROL_MESSAGE_COUNT);
+
+    int server_side_fd = -1;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fd = client_fd;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    while(server_side_fd == -1)
+    {
+        server.Run();
+    }
+
+    // fill the socket behind the server's back, so that its first send attempt finds no room
+    std::vector<char> filler(CLIENT_RX_BUFFER_SIZE,'f');
+    size_t filler_byte_count = 0;
+    ssize_t write_result = 0;
+
+    while((write_result = send(server_side_fd,filler.data(),filler.size(),MSG_DONTWAIT)) > 0)
+    {
+        filler_byte_count += write_result;
+    }
+
+    std::string bulk = "b";
+    std::string control = "c";
+
+    server.EnqueueSend(server_side_fd,bulk,NonBlockingSocketServer::TxPriority::BULK);
+
+    for(size_t index = 0; index < CONTROL_MESSAGE_COUNT; ++index)
+    {
+        server.EnqueueSend(server_side_fd,control,NonBlockingSocketServer::TxPriority::CONTROL);
+    }
+
+    server.RunUntilIdle();
+
+    // once the filler is read, the bulk message only gets its turn after the guard's worth of control messages has really been sent
+    std::string received;
+    std::vector<char> rx_buffer(CLIENT_RX_BUFFER_SIZE);
+
+    while(received.size() < filler_byte_count + CONTROL_MESSAGE_COUNT + 1)
+    {
+        server.Run();
+        const ssize_t read_result = recv(client_fd,rx_buffer.data(),rx_buffer.size(),MSG_DONTWAIT);
+
+        if(read_result > 0)
+        {
+            received.append(rx_buffer.data(),read_result);
+        }
+    }
+
+    EXPECT_EQ(received.substr(filler_byte_count),std::string(CONTROL_MESSAGE_COUNT,'c') + "b");
+
+    close(client_fd);
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+TEST_F(NonBlockingUnixDomainSocketServerTest, HandOver)
+{
+    const std::string control_socket_path = "server.control.sock";
+
+    NonBlockingSocketServer predecessor(m_unix_socket_path,2);
+    NonBlockingSocketServer successor(m_unix_socket_path,2);
+
+    int predecessor_side_fd = -1;
+    int successor_side_fd = -1;
+    bool is_predecessor_disconnected = false;
+    std::string received_payload;
+
+    predecessor.SetConnectCallback([&](int client_fd)
+    {
+        predecessor_side_fd = client_fd;
+    });
+
+    predecessor.SetDisconnectCallback([&](int)
+    {
+        is_predecessor_disconnected = true;
+    });
+
+    successor.SetConnectCallback([&](int client_fd)
+    {
+        successor_side_fd = client_fd;
+    });
+
+    successor.SetRxCallback([&](int, const std::span<char>& rx_payload)
+    {
+        received_payload.append(rx_payload.begin(),rx_payload.end());
+    });
+
+    ASSERT_TRUE(predecessor.Start());
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    while(predecessor_side_fd == -1)
+    {
+        predecessor.Run();
+    }
+
+    // bytes the predecessor has not read yet stay in the socket, and a payload it has not sent yet travels with the handover
+    const std::string request = "request";
+    ASSERT_EQ(write(client_fd,request.data(),request.size()),request.size());
+
+    std::string reply = "queued reply";
+    predecessor.EnqueueSend(predecessor_side_fd,reply);
+
+    bool is_resumed = false;
+    std::thread successor_thread([&]()
+    {
+        is_resumed = successor.Resume(control_socket_path,std::chrono::milliseconds(1000));
+    });
+
+    const bool is_handed_over = predecessor.HandOver(control_socket_path,std::chrono::milliseconds(1000));
+    successor_thread.join();
+
+    ASSERT_TRUE(is_handed_over);
+    ASSERT_TRUE(is_resumed);
+    EXPECT_EQ(predecessor.GetServerState(),NonBlockingSocketServer::ServerState::CLOSED);
+    EXPECT_TRUE(predecessor.GetClientFileDescriptors().empty());
+    EXPECT_FALSE(is_predecessor_disconnected);
+    EXPECT_EQ(successor.GetClientFileDescriptors().size(),1);
+    EXPECT_NE(successor_side_fd,-1);
+
+    while(received_payload != request)
+    {
+        successor.Run();
+    }
+
+    std::vector<char> rx_buffer(CLIENT_RX_BUFFER_SIZE);
+    const ssize_t read_result = read(client_fd,rx_buffer.data(),rx_buffer.size());
+    ASSERT_EQ(read_result,reply.size());
+    EXPECT_EQ(std::string(rx_buffer.data(),read_result),reply);
+
+    // the listener was handed over too, so new clients reach the successor
+    const int new_client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(new_client_fd,-1);
+
+    while(successor.GetClientFileDescriptors().size() != 2)
+    {
+        successor.Run();
+    }
+
+    close(new_client_fd);
+    close(client_fd);
+
+    successor.RequestStop();
+
+    while(successor.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        successor.Run();
+    }
+
+    // with nobody waiting on the control socket the handover fails, and the server carries on
+    NonBlockingSocketServer lonely_server(m_unix_socket_path);
+    ASSERT_TRUE(lonely_server.Start());
+    EXPECT_FALSE(lonely_server.HandOver(control_socket_path,std::chrono::milliseconds(20)));
+    EXPECT_EQ(lonely_server.GetServerState(),NonBlockingSocketServer::ServerState::RUNNING);
+
+    lonely_server.RequestStop();
+
+    while(lonely_server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        lonely_server.Run();
+    }
+}
+
+/*
+    This test validates that a handed over client the successor cannot register is dropped without its queued payloads ending up on another client
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, HandOverFailedRegistration)
+{
+    const std::string control_socket_path = "server.control.sock";
+    const std::string second_unix_socket_path = m_unix_socket_path + ".second";
+
+    const std::vector<NonBlockingSocketServer::ListenerEndpoint> predecessor_endpoints{
+        NonBlockingSocketServer::UnixEndpoint{ .path = m_unix_socket_path },
+        NonBlockingSocketServer::UnixEndpoint{ .path = second_unix_socket_path }};
+
+    // rings too large to allocate make every client of the first listener fail to register in the successor
+    const std::vector<NonBlockingSocketServer::ListenerEndpoint> successor_endpoints{
+        NonBlockingSocketServer::UnixEndpoint{ .path = m_unix_socket_path, .shared_memory_ring_size = size_t(1) << 62 },
+        NonBlockingSocketServer::UnixEndpoint{ .path = second_unix_socket_path }};
+
+    NonBlockingSocketServer predecessor(predecessor_endpoints,2);
+    NonBlockingSocketServer successor(successor_endpoints,2);
+    std::vector<int> predecessor_side_fds;
+    int successor_side_fd = -1;
+
+    predecessor.SetConnectCallback([&](int client_fd)
+    {
+        predecessor_side_fds.emplace_back(client_fd);
+    });
+
+    successor.SetConnectCallback([&](int client_fd)
+    {
+        successor_side_fd = client_fd;
+    });
+
+    ASSERT_TRUE(predecessor.Start());
+
+    const int dropped_client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(dropped_client_fd,-1);
+
+    while(predecessor_side_fds.size() != 1)
+    {
+        predecessor.Run();
+    }
+
+    const int kept_client_fd = ConnectClientSocket(second_unix_socket_path);
+    ASSERT_NE(kept_client_fd,-1);
+
+    while(predecessor_side_fds.size() != 2)
+    {
+        predecessor.Run();
+    }
+
+    std::string dropped_reply = "reply for the dropped client";
+    std::string kept_reply = "reply for the kept client";
+    predecessor.EnqueueSend(predecessor_side_fds[0],dropped_reply);
+    predecessor.EnqueueSend(predecessor_side_fds[1],kept_reply);
+
+    bool is_resumed = false;
+    std::thread successor_thread([&]()
+    {
+        is_resumed = successor.Resume(control_socket_path,std::chrono::milliseconds(1000));
+    });
+
+    const bool is_handed_over = predecessor.HandOver(control_socket_path,std::chrono::milliseconds(1000));
+    successor_thread.join();
+
+    ASSERT_TRUE(is_handed_over);
+    ASSERT_TRUE(is_resumed);
+    EXPECT_EQ(successor.GetClientFileDescriptors().size(),1);
+    EXPECT_NE(successor_side_fd,-1);
+    successor.Run();
+
+    // the kept client gets exactly its own reply, and the dropped one sees its connection end
+    std::vector<char> rx_buffer(CLIENT_RX_BUFFER_SIZE);
+    const ssize_t read_result = read(kept_client_fd,rx_buffer.data(),rx_buffer.size());
+    ASSERT_EQ(read_result,kept_reply.size());
+    EXPECT_EQ(std::string(rx_buffer.data(),read_result),kept_reply);
+    EXPECT_EQ(read(dropped_client_fd,rx_buffer.data(),rx_buffer.size()),0);
+
+    close(dropped_client_fd);
+    close(kept_client_fd);
+
+    successor.RequestStop();
+
+    while(successor.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        successor.Run();
+    }
+
+    unlink(second_unix_socket_path.c_str());
+}
+
+TEST_F(NonBlockingUnixDomainSocketServerTest, SharedMemoryTransport)
+{
+    const NonBlockingSocketServer::UnixEndpoint shared_memory_endpoint{ .path = m_unix_socket_path, .shared_memory_ring_size = 4096 };
+    NonBlockingSocketServer server(std::vector<NonBlockingSocketServer::ListenerEndpoint>{shared_memory_endpoint});
+
+    size_t received_byte_count = 0;
+
+    // echo everything back, so that the ring in each direction fills up many times over
+    server.SetRxCallback([&](int client_fd, const std::span<char>& rx_payload)
+    {
+        received_byte_count += rx_payload.size();
+        server.EnqueueSend(client_fd,rx_payload);
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    std::string payload(64 * 1024,'\0');
+
+    for(size_t index = 0; index < payload.size(); ++index)
+    {
+        payload[index] = static_cast<char>(index % 251);
+    }
+
+    std::string echoed_payload;
+    bool is_connected = false;
+    bool is_sent = false;
+    std::atomic<bool> is_client_done = false;
+
+    std::thread client_thread([&]()
+    {
+        {
+            SharedMemoryClient client;
+            is_connected = client.Connect(m_unix_socket_path,std::chrono::milliseconds(1000));
+
+            if(is_connected)
+            {
+                is_sent = client.Send(payload,std::chrono::milliseconds(1000));
+                char rx_buffer[CLIENT_RX_BUFFER_SIZE];
+
+                while(echoed_payload.size() < payload.size())
+                {
+                    const ssize_t read_result = client.Receive(rx_buffer,sizeof(rx_buffer),std::chrono::milliseconds(1000));
+
+                    if(read_result <= 0)
+                    {
+                        break;
+                    }
+
+                    echoed_payload.append(rx_buffer,read_result);
+                }
+            }
+        }
+
+        is_client_done = true;
+    });
+
+    while(not is_client_done)
+    {
+        server.RunOnce(std::chrono::milliseconds(1));
+    }
+
+    client_thread.join();
+
+    EXPECT_TRUE(is_connected);
+    EXPECT_TRUE(is_sent);
+    EXPECT_EQ(received_byte_count,payload.size());
+    EXPECT_TRUE(echoed_payload == payload);
+
+    // the socket still reports the hangup
+    while(not server.GetClientFileDescriptors().empty())
+    {
+        server.Run();
+    }
+
+    // bytes written right before the client closes arrive together with the hangup, and are still delivered
+    received_byte_count = 0;
+    const std::string last_payload(1000,'x');
+    SharedMemoryClient closing_client;
+    bool is_closing_client_connected = false;
+    std::atomic<bool> is_connect_done = false;
+
+    std::thread connect_thread([&]()
+    {
+        is_closing_client_connected = closing_client.Connect(m_unix_socket_path,std::chrono::milliseconds(1000));
+        is_connect_done = true;
+    });
+
+    while(not is_connect_done)
+    {
+        server.RunOnce(std::chrono::milliseconds(1));
+    }
+
+    connect_thread.join();
+
+    ASSERT_TRUE(is_closing_client_connected);
+    ASSERT_TRUE(closing_client.Send(last_payload,std::chrono::milliseconds(1000)));
+    closing_client.Close();
+
+    while(not server.GetClientFileDescriptors().empty())
+    {
+        server.Run();
+    }
+
+    EXPECT_EQ(received_byte_count,last_payload.size());
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that a client which corrupts the ring positions in its shared mapping is disconnected instead of making the server copy past the ring
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, SharedMemoryCorruptedRing)
+{
+    constexpr size_t RING_SIZE = 4096;
+    const NonBlockingSocketServer::UnixEndpoint shared_memory_endpoint{ .path = m_unix_socket_path, .shared_memory_ring_size = RING_SIZE };
+    NonBlockingSocketServer server(std::vector<NonBlockingSocketServer::ListenerEndpoint>{shared_memory_endpoint});
+
+    int server_side_fd = -1;
+    size_t disconnect_count = 0;
+    size_t received_byte_count = 0;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fd = client_fd;
+    });
+
+    server.SetDisconnectCallback([&](int)
+    {
+        ++disconnect_count;
+    });
+
+    server.SetRxCallback([&](int, const std::span<char>& rx_payload)
+    {
+        received_byte_count += rx_payload.size();
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    // a hand-rolled client that maps the rings itself, so that it can write whatever it likes into their headers
+    const auto connect_and_map = [&](void*& memory)
+    {
+        server_side_fd = -1;
+        const int client_fd = ConnectClientSocket(m_unix_socket_path);
+
+        while(server_side_fd == -1)
+        {
+            server.Run();
+        }
+
+        SharedMemoryChannel::Greeting greeting{};
+        alignas(cmsghdr) char control_buffer[CMSG_SPACE(sizeof(int))];
+        iovec io_vector{&greeting, sizeof(greeting)};
+        msghdr message {};
+        message.msg_iov = &io_vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control_buffer;
+        message.msg_controllen = sizeof(control_buffer);
+        EXPECT_EQ(recvmsg(client_fd,&message,MSG_WAITALL),static_cast<ssize_t>(sizeof(greeting)));
+
+        int memory_fd = -1;
+        memcpy(&memory_fd,CMSG_DATA(CMSG_FIRSTHDR(&message)),sizeof(memory_fd));
+        memory = mmap(nullptr,2 * SharedMemoryRing::GetMappingSize(RING_SIZE),PROT_READ | PROT_WRITE,MAP_SHARED,memory_fd,0);
+        close(memory_fd);
+        EXPECT_NE(memory,MAP_FAILED);
+
+        return client_fd;
+    };
+
+    // a producer position far ahead of the server's read position would make the server read past the ring
+    void* memory = nullptr;
+    int client_fd = connect_and_map(memory);
+    auto* client_to_server_header = static_cast<SharedMemoryRing::Header*>(memory);
+    client_to_server_header->write_position.store(RING_SIZE * 4);
+    const char doorbell = 0;
+    ASSERT_EQ(send(client_fd,&doorbell,sizeof(doorbell),0),1);
+
+    while(disconnect_count != 1)
+    {
+        server.Run();
+    }
+
+    EXPECT_EQ(received_byte_count,0);
+    munmap(memory,2 * SharedMemoryRing::GetMappingSize(RING_SIZE));
+    close(client_fd);
+
+    // a consumer position ahead of the server's write position would make the server write past the ring
+    client_fd = connect_and_map(memory);
+    auto* server_to_client_header = reinterpret_cast<SharedMemoryRing::Header*>(static_cast<char*>(memory) + SharedMemoryRing::GetMappingSize(RING_SIZE));
+    server_to_client_header->read_position.store(100);
+
+    std::string payload(64,'c');
+    server.EnqueueSend(server_side_fd,payload);
+
+    while(disconnect_count != 2)
+    {
+        server.Run();
+    }
+
+    EXPECT_TRUE(server.GetClientFileDescriptors().empty());
+    munmap(memory,2 * SharedMemoryRing::GetMappingSize(RING_SIZE));
+    close(client_fd);
+}
+
+/*
+    This test validates that a user context set in the connect callback comes back in the rx and disconnect callbacks
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, UserContext)
+{
+    struct Session
+    {
+        size_t received_bytes = 0;
+    };
+
+    NonBlockingSocketServer server(m_unix_socket_path);
+
+    Session session;
+    Session* disconnected_session = nullptr;
+    int server_side_fd = -1;
+
+    server.SetConnectCallback([&](NonBlockingSocketServer::ConnectionRef connection)
+    {
+        server_side_fd = connection;
+        connection.SetUserContext(&session);
+        EXPECT_EQ(connection.GetUserContext<Session>(),&session);
+    });
+
+    server.SetRxCallback([&](NonBlockingSocketServer::ConnectionRef connection, const std::span<char>& rx_payload)
+    {
+        connection.GetUserContext<Session>()->received_bytes += rx_payload.size();
+    });
+
+    server.SetDisconnectCallback([&](NonBlockingSocketServer::ConnectionRef connection)
+    {
+        EXPECT_EQ(connection.GetFileDescriptor(),server_side_fd);
+        disconnected_session = connection.GetUserContext<Session>();
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    while(server_side_fd == -1)
+    {
+        server.Run();
+    }
+
+    EXPECT_EQ(server.GetUserContext(server_side_fd),&session);
+
+    const std::string payload = "context";
+    ASSERT_EQ(send(client_fd,payload.data(),payload.size(),0),payload.size());
+
+    while(session.received_bytes < payload.size())
+    {
+        server.Run();
+    }
+
+    EXPECT_EQ(session.received_bytes,payload.size());
+
+    close(client_fd);
+
+    while(disconnected_session == nullptr)
+    {
+        server.Run();
+    }
+
+    EXPECT_EQ(disconnected_session,&session);
+
+    // the slot went away with the connection
+    EXPECT_EQ(server.GetUserContext(server_side_fd),nullptr);
+    EXPECT_FALSE(server.SetUserContext(server_side_fd,&session));
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that the tx high-water mark of a client is reset once it has been idle for the reclamation period
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, IdleReclamation)
+{
+    NonBlockingSocketServer server(m_unix_socket_path);
+    server.SetIdleReclamation(std::chrono::milliseconds(20));
+
+    int server_side_fd = -1;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fd = client_fd;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    while(server_side_fd == -1)
+    {
+        server.Run();
+    }
+
+    std::string payload(100,'p');
+    server.EnqueueSend(server_side_fd,payload);
+    server.RunUntilIdle();
+    EXPECT_EQ(server.GetTxHighWaterBytes(server_side_fd),payload.size());
+
+    std::vector<char> rx_buffer(CLIENT_RX_BUFFER_SIZE);
+    EXPECT_EQ(read(client_fd,rx_buffer.data(),rx_buffer.size()),payload.size());
+
+    server.RunFor(std::chrono::milliseconds(60));
+    EXPECT_EQ(server.GetTxHighWaterBytes(server_side_fd),0);
+
+    close(client_fd);
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that a client whose backlog pushes the server over its memory budget is disconnected
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, MemoryBudget)
+{
+    NonBlockingSocketServer server(m_unix_socket_path);
+    server.SetMemoryBudget(512 * 1024);
+
+    int server_side_fd = -1;
+    bool is_disconnected = false;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fd = client_fd;
+    });
+
+    server.SetDisconnectCallback([&](int client_fd)
+    {
+        (void)client_fd;
+        is_disconnected = true;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    while(server_side_fd == -1)
+    {
+        server.Run();
+    }
+
+    // the client never reads, so most of the payload stays queued in the server
+    std::string payload(4 * 1024 * 1024,'b');
+    server.EnqueueSend(server_side_fd,payload);
+
+    const NonBlockingSocketServer::RunStats run_stats = server.RunOnce(std::chrono::milliseconds(0));
+    EXPECT_EQ(run_stats.shed_client_count,1);
+    EXPECT_TRUE(is_disconnected);
+    EXPECT_TRUE(server.GetClientFileDescriptors().empty());
+    EXPECT_EQ(server.GetMemoryUsage().tx_queue_bytes,0);
+
+    close(client_fd);
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that a payload published to many subscribers counts once against the memory budget, as it is only allocated once
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, MemoryBudgetFanOut)
+{
+    const size_t client_count = 8;
+    const size_t payload_size = 4 * 1024 * 1024;
+    NonBlockingSocketServer server(m_unix_socket_path,client_count);
+    server.SetMemoryBudget(2 * payload_size);
+
+    std::vector<int> server_side_fds;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fds.emplace_back(client_fd);
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    std::vector<int> client_fds;
+
+    for(size_t index = 0; index < client_count; ++index)
+    {
+        client_fds.emplace_back(ConnectClientSocket(m_unix_socket_path));
+        ASSERT_NE(client_fds.back(),-1);
+    }
+
+    while(server_side_fds.size() < client_count)
+    {
+        server.Run();
+    }
+
+    for(const int& server_side_fd : server_side_fds)
+    {
+        EXPECT_TRUE(server.Subscribe(server_side_fd,"snapshots"));
+    }
+
+    // the clients never read, so nearly all of the payload stays queued for every one of them
+    const std::string payload(payload_size,'s');
+    EXPECT_EQ(server.Publish("snapshots",std::span<const char>(payload.data(),payload.size())),client_count);
+
+    const NonBlockingSocketServer::RunStats run_stats = server.RunOnce(std::chrono::milliseconds(0));
+    EXPECT_EQ(run_stats.shed_client_count,0);
+    EXPECT_EQ(server.GetClientFileDescriptors().size(),client_count);
+
+    const NonBlockingSocketServer::MemoryUsage memory_usage = server.GetMemoryUsage();
+    EXPECT_GT(memory_usage.tx_queue_bytes,payload_size / 2);
+    EXPECT_LT(memory_usage.tx_queue_bytes,payload_size + 4096);
+
+    for(const int& client_fd : client_fds)
+    {
+        close(client_fd);
+    }
+
+    while(not server.GetClientFileDescriptors().empty())
+    {
+        server.Run();
+    }
+
+    EXPECT_EQ(server.GetMemoryUsage().tx_queue_bytes,0);
+}
+
+/*
+    This test validates that a client which outruns its byte rate limit is paused after its burst and read again as its bucket refills
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, RxRateLimit)
+{
+    NonBlockingSocketServer server(m_unix_socket_path);
+    server.SetRxRateLimit(NonBlockingSocketServer::RateLimit{64 * 1024, 1024}, NonBlockingSocketServer::RateLimit{});
+
+    int server_side_fd = -1;
+    size_t received_bytes = 0;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        server_side_fd = client_fd;
+    });
+
+    server.SetRxCallback([&](int client_fd, const std::span<char>& rx_payload)
+    {
+        (void)client_fd;
+        received_bytes += rx_payload.size();
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    while(server_side_fd == -1)
+    {
+        server.Run();
+    }
+
+    const std::string payload(16 * 1024,'r');
+    ASSERT_EQ(send(client_fd,payload.data(),payload.size(),0),payload.size());
+
+    // the burst allows one read, after which the client is paused
+    const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    server.RunFor(std::chrono::milliseconds(5));
+    EXPECT_LT(received_bytes,payload.size() / 2);
+
+    while(received_bytes < payload.size() && std::chrono::steady_clock::now() - start_time < std::chrono::seconds(5))
+    {
+        server.Run();
+    }
+
+    // the 15 KiB beyond the burst take about 230 ms at 64 KiB per second
+    EXPECT_EQ(received_bytes,payload.size());
+    EXPECT_GE(std::chrono::steady_clock::now() - start_time,std::chrono::milliseconds(150));
+
+    close(client_fd);
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that the accept rate limit leaves connecting clients in the backlog until the listener has tokens again
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, AcceptRateLimit)
+{
+    NonBlockingSocketServer server(m_unix_socket_path,4);
+    server.SetAcceptRateLimit(NonBlockingSocketServer::RateLimit{20, 1});
+
+    size_t connected_count = 0;
+
+    server.SetConnectCallback([&](int client_fd)
+    {
+        (void)client_fd;
+        ++connected_count;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    std::vector<int> client_fds;
+
+    for(size_t index = 0; index < 3; ++index)
+    {
+        client_fds.emplace_back(ConnectClientSocket(m_unix_socket_path));
+        ASSERT_NE(client_fds.back(),-1);
+    }
+
+    server.RunFor(std::chrono::milliseconds(20));
+    EXPECT_EQ(connected_count,1);
+
+    // one token every 50 ms
+    const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+    while(connected_count < client_fds.size() && std::chrono::steady_clock::now() - start_time < std::chrono::seconds(5))
+    {
+        server.Run();
+    }
+
+    EXPECT_EQ(connected_count,client_fds.size());
+    EXPECT_GE(std::chrono::steady_clock::now() - start_time,std::chrono::milliseconds(50));
+
+    for(const int& client_fd : client_fds)
+    {
+        close(client_fd);
+    }
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates the system call counts of an accept and an echo, and the perf counts where the kernel provides them
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, SyscallCounts)
+{
+    NonBlockingSocketServer server(m_unix_socket_path);
+    server.EnablePerfCounters();
+
+    server.SetRxCallback([&](int client_fd, const std::span<char>& rx_payload)
+    {
+        server.EnqueueSend(client_fd,rx_payload);
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    pollfd server_poll_fd { server.GetPollFileDescriptor(), POLLIN, 0 };
+    ASSERT_EQ(poll(&server_poll_fd,1,1000),1);
+    NonBlockingSocketServer::RunStats run_stats = server.RunOnce(std::chrono::milliseconds(0));
+    EXPECT_EQ(run_stats.syscall_counts.epoll_wait_count,1);
+    EXPECT_EQ(run_stats.syscall_counts.accept_count,1);
+    EXPECT_EQ(run_stats.syscall_counts.epoll_ctl_count,1);
+
+    // the new client's socket is writable, which edge-triggered epoll reports once
+    server.RunUntilIdle();
+
+    const std::string payload = "ping";
+    ASSERT_EQ(send(client_fd,payload.data(),payload.size(),0),payload.size());
+    ASSERT_EQ(poll(&server_poll_fd,1,1000),1);
+
+    // one read for the payload, one that finds the socket drained, and one send for the echo
+    run_stats = server.RunOnce(std::chrono::milliseconds(0));
+    EXPECT_EQ(run_stats.syscall_counts.read_count,2);
+    EXPECT_EQ(run_stats.syscall_counts.send_count,1);
+    EXPECT_EQ(run_stats.syscall_counts.GetTotal(),4);
+
+    if(server.HasPerfCounters())
+    {
+        EXPECT_GT(run_stats.perf_counts.instructions,0);
+    }
+
+    close(client_fd);
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that a server backed by a huge page arena serves clients from it, and that the arena cannot be replaced once the server runs
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, HugePageArena)
+{
+    constexpr size_t ARENA_SIZE = 1024 * 1024;
+    NonBlockingSocketServer server(m_unix_socket_path);
+    ASSERT_TRUE(server.SetHugePageArena(ARENA_SIZE));
+
+    server.SetRxCallback([&](int client_fd, const std::span<char>& rx_payload)
+    {
+        server.EnqueueSend(client_fd,rx_payload);
+    });
+
+    ASSERT_TRUE(server.Start());
+    EXPECT_FALSE(server.SetHugePageArena(ARENA_SIZE));
+
+    // the arena covers at least whole pages of the kind the host gave it, and Start() already carved the pre-faulted read buffers out of it
+    const size_t page_size = server.GetHugePageMode() == HugePageArena::PageMode::HUGETLB ? 2 * 1024 * 1024 : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    NonBlockingSocketServer::MemoryUsage memory_usage = server.GetMemoryUsage();
+    EXPECT_GE(memory_usage.arena_capacity_bytes,(ARENA_SIZE + page_size - 1) / page_size * page_size);
+    EXPECT_GT(memory_usage.arena_used_bytes,0);
+    EXPECT_LE(memory_usage.arena_used_bytes,memory_usage.arena_capacity_bytes);
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    const std::string message = "arena";
+    ASSERT_EQ(send(client_fd,message.data(),message.size(),0),static_cast<ssize_t>(message.size()));
+
+    std::string echoed;
+    char rx_buffer[64];
+
+    while(echoed.size() < message.size())
+    {
+        server.Run();
+        const ssize_t read_bytes = recv(client_fd,rx_buffer,sizeof(rx_buffer),MSG_DONTWAIT);
+
+        if(read_bytes > 0)
+        {
+            echoed.append(rx_buffer,read_bytes);
+        }
+    }
+
+    EXPECT_EQ(echoed,message);
+    EXPECT_GE(server.GetMemoryUsage().arena_used_bytes,memory_usage.arena_used_bytes);
+
+    close(client_fd);
+
+    while(not server.GetClientFileDescriptors().empty())
+    {
+        server.Run();
+    }
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+/*
+    This test validates that returned arena blocks of varying sizes are reused, instead of piling up until requests spill to the upstream resource
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, HugePageArenaMixedSizes)
+{
+    constexpr size_t ARENA_SIZE = 8 * 1024 * 1024;
+    HugePageArena arena;
+    ASSERT_TRUE(arena.Map(ARENA_SIZE));
+
+    std::vector<std::pair<void*,size_t>> blocks;
+    size_t peak_used_bytes = 0;
+
+    // the oldest block goes back while newer ones are still out, so it cannot simply move the offset back
+    for(size_t round = 0; round < 10000; ++round)
+    {
+        const size_t size = 64 * 1024 + (round * 7919) % (448 * 1024);
+        blocks.emplace_back(arena.allocate(size),size);
+
+        if(blocks.size() > 4)
+        {
+            arena.deallocate(blocks.front().first,blocks.front().second);
+            blocks.erase(blocks.begin());
+        }
+
+        peak_used_bytes = std::max(peak_used_bytes,arena.GetUsedBytes());
+    }
+
+    EXPECT_EQ(arena.GetFallbackBytes(),0);
+    EXPECT_LE(peak_used_bytes,5 * 512 * 1024);
+
+    for(const auto& [address, size] : blocks)
+    {
+        arena.deallocate(address,size);
+    }
+
+    EXPECT_EQ(arena.GetUsedBytes(),0);
+}
+
+/*
+    This test validates that pipelined RPC requests are dispatched up to the in-flight limit and answered in completion order with their request ids
+*/
+TEST_F(NonBlockingUnixDomainSocketServerTest, RpcPipelining)
+{
+    using RpcFrameHeader = NonBlockingSocketServer::RpcFrameHeader;
+    using RpcRequest = NonBlockingSocketServer::RpcRequest;
+
+    NonBlockingSocketServer server(m_unix_socket_path);
+    std::vector<std::pair<RpcRequest,std::string>> requests;
+
+    server.SetRpcHandler([&](int client_fd, const RpcRequest& request, const std::span<char>& payload)
+    {
+        (void)client_fd;
+        requests.emplace_back(request,std::string(payload.begin(),payload.end()));
+    }, 2);
+
+    ASSERT_TRUE(server.Start());
+
+    const int client_fd = ConnectClientSocket(m_unix_socket_path);
+    ASSERT_NE(client_fd,-1);
+
+    // four requests on one socket, the last of them split across two sends
+    std::vector<char> frames;
+
+    for(uint64_t request_id = 10; request_id < 14; ++request_id)
+    {
+        const std::string payload = "request " + std::to_string(request_id);
+        const RpcFrameHeader header {static_cast<uint32_t>(payload.size()),0,request_id};
+        frames.insert(frames.end(),reinterpret_cast<const char*>(&header),reinterpret_cast<const char*>(&header) + sizeof(header));
+        frames.insert(frames.end(),payload.begin(),payload.end());
+    }
+
+    const size_t first_send_size = frames.size() - 4;
+    ASSERT_EQ(send(client_fd,frames.data(),first_send_size,0),static_cast<ssize_t>(first_send_size));
+
+    for(int run_count = 0; run_count < 5; ++run_count)
+    {
+        server.Run();
+    }
+
+    // the in-flight limit holds the third request back
+    ASSERT_EQ(requests.size(),2);
+    EXPECT_EQ(requests[0].second,"request 10");
+    EXPECT_EQ(requests[1].second,"request 11");
+    EXPECT_EQ(server.GetRpcInFlightCount(requests[0].first.client_file_descriptor),2);
+
+    // the frames held back count towards the server's memory
+    EXPECT_GE(server.GetMemoryUsage().rpc_bytes,first_send_size - frames.size() / 2);
+
+    // the requests in flight can only be completed by this server
+    EXPECT_FALSE(server.HandOver(m_unix_socket_path + ".control",std::chrono::milliseconds(10)));
+    EXPECT_EQ(server.GetServerState(),NonBlockingSocketServer::ServerState::RUNNING);
+
+    // the second request completes first
+    const std::string response = "response 11";
+    EXPECT_TRUE(server.CompleteRpcRequest(requests[1].first,response));
+    EXPECT_FALSE(server.CompleteRpcRequest(requests[1].first,response));
+
+    ASSERT_EQ(send(client_fd,frames.data() + first_send_size,4,0),4);
+
+    for(int run_count = 0; run_count < 5; ++run_count)
+    {
+        server.Run();
+    }
+
+    ASSERT_EQ(requests.size(),3);
+    EXPECT_EQ(requests[2].second,"request 12");
+
+    EXPECT_TRUE(server.CompleteRpcRequest(requests[0].first,std::string_view("response 10")));
+    EXPECT_TRUE(server.CompleteRpcRequest(requests[2].first,std::string_view("response 12")));
+
+    for(int run_count = 0; run_count < 5; ++run_count)
+    {
+        server.Run();
+    }
+
+    ASSERT_EQ(requests.size(),4);
+    EXPECT_EQ(requests[3].second,"request 13");
+    EXPECT_TRUE(server.CompleteRpcRequest(requests[3].first,std::string_view("response 13")));
+    server.Run();
+
+    // responses come back in completion order, each with the id of its request
+    std::vector<char> rx_bytes;
+    char rx_buffer[256];
+    ssize_t read_bytes = 0;
+
+    while((read_bytes = recv(client_fd,rx_buffer,sizeof(rx_buffer),MSG_DONTWAIT)) > 0)
+    {
+        rx_bytes.insert(rx_bytes.end(),rx_buffer,rx_buffer + read_bytes);
+    }
+
+    std::vector<std::pair<uint64_t,std::string>> responses;
+
+    for(size_t offset = 0; offset + sizeof(RpcFrameHeader) <= rx_bytes.size();)
+    {
+        RpcFrameHeader header;
+        memcpy(&header,rx_bytes.data() + offset,sizeof(header));
+        offset += sizeof(header);
+        responses.emplace_back(header.request_id,std::string(rx_bytes.data() + offset,header.payload_size));
+        offset += header.payload_size;
+    }
+
+    ASSERT_EQ(responses.size(),4);
+    EXPECT_EQ(responses[0],std::make_pair(uint64_t(11),std::string("response 11")));
+    EXPECT_EQ(responses[1],std::make_pair(uint64_t(10),std::string("response 10")));
+    EXPECT_EQ(responses[2],std::make_pair(uint64_t(12),std::string("response 12")));
+    EXPECT_EQ(responses[3],std::make_pair(uint64_t(13),std::string("response 13")));
+
+    close(client_fd);
+
+    while(not server.GetClientFileDescriptors().empty())
+    {
+        server.Run();
+    }
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+}
+
+
+} // InterProcessCommunication::Test
@@ -0,0 +1,178 @@
+#include "non_blocking_socket_server.h"
+#include "traffic_replayer.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <atomic>
+
+namespace InterProcessCommunication::Test
+{
+
+class TrafficCaptureTest : public ::testing::Test
+{
+protected:
+    const std::string m_unix_socket_path = "capture.sock";
+    const std::string m_capture_file_path = "traffic_capture_test.bin";
+    const std::string m_client_tx_string = "hello from client";
+
+    void SetUp() {}
+    void TearDown()
+    {
+        unlink(m_capture_file_path.c_str());
+    }
+
+    void RunUntilClosed(NonBlockingSocketServer& server)
+    {
+        server.RequestStop();
+
+        while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+        {
+            server.Run();
+        }
+    }
+
+    /*
+        Run an echo server for one client session while capturing its traffic
+    */
+    void CaptureEchoSession()
+    {
+        NonBlockingSocketServer server(m_unix_socket_path);
+        bool client_disconnected = false;
+
+        server.SetRxCallback([&](int client_fd, const std::span<char>& rx_payload)
+        {
+            server.EnqueueSend(client_fd,rx_payload);
+        });
+
+        server.SetDisconnectCallback([&](int)
+        {
+            client_disconnected = true;
+        });
+
+        ASSERT_TRUE(server.Start());
+        ASSERT_TRUE(server.StartCapture(m_capture_file_path));
+
+        std::thread client_thread([&]()
+        {
+            const int client_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un server_address{};
+            server_address.sun_family = AF_UNIX;
+            strncpy(server_address.sun_path, m_unix_socket_path.c_str(), sizeof(server_address.sun_path) - 1);
+            ASSERT_EQ(connect(client_fd, (struct sockaddr*)&server_address, sizeof(server_address)),0);
+
+            ASSERT_EQ(send(client_fd,m_client_tx_string.data(),m_client_tx_string.size(),0),m_client_tx_string.size());
+
+            // wait for the echo, so that the capture holds the send before the disconnect
+            std::vector<char> rx_buffer(m_client_tx_string.size());
+            size_t total_read_bytes = 0;
+
+            while(total_read_bytes < rx_buffer.size())
+            {
+                const ssize_t read_result = read(client_fd,rx_buffer.data() + total_read_bytes,rx_buffer.size() - total_read_bytes);
+                ASSERT_GT(read_result,0);
+                total_read_bytes += read_result;
+            }
+
+            close(client_fd);
+        });
+
+        while(not client_disconnected)
+        {
+            server.Run();
+        }
+
+        client_thread.join();
+        server.StopCapture();
+        RunUntilClosed(server);
+    }
+};
+
+/*
+    This test validates that a capture holds the accept, receive, send and disconnect of a session, in order
+*/
+TEST_F(TrafficCaptureTest, CaptureRecordsSession)
+{
+    CaptureEchoSession();
+
+    TrafficCaptureReader reader;
+    ASSERT_TRUE(reader.Open(m_capture_file_path));
+
+    std::vector<TrafficRecord> records;
+    TrafficRecord record;
+
+    while(reader.ReadNext(record))
+    {
+        records.emplace_back(record);
+    }
+
+    ASSERT_GE(records.size(),4);
+    EXPECT_EQ(records.front().type,TrafficEventType::ACCEPT);
+    EXPECT_EQ(records.back().type,TrafficEventType::DISCONNECT);
+
+    std::string received;
+    std::string sent;
+
+    for(const TrafficRecord& captured : records)
+    {
+        EXPECT_EQ(captured.connection_id,records.front().connection_id);
+        EXPECT_GE(captured.timestamp,records.front().timestamp);
+
+        if(captured.type == TrafficEventType::RECEIVE)
+        {
+            received.append(captured.payload.begin(),captured.payload.end());
+        }
+        else if(captured.type == TrafficEventType::SEND)
+        {
+            sent.append(captured.payload.begin(),captured.payload.end());
+        }
+    }
+
+    EXPECT_EQ(received,m_client_tx_string);
+    EXPECT_EQ(sent,m_client_tx_string);
+}
+
+/*
+    This test validates that replaying a capture re-drives a fresh server with the captured client traffic
+*/
+TEST_F(TrafficCaptureTest, ReplayCapture)
+{
+    CaptureEchoSession();
+
+    NonBlockingSocketServer server(m_unix_socket_path);
+    std::string received;
+    bool client_disconnected = false;
+
+    server.SetRxCallback([&](int, const std::span<char>& rx_payload)
+    {
+        received.append(rx_payload.begin(),rx_payload.end());
+    });
+
+    server.SetDisconnectCallback([&](int)
+    {
+        client_disconnected = true;
+    });
+
+    ASSERT_TRUE(server.Start());
+
+    std::atomic<bool> is_replay_done = false;
+    TrafficReplayer replayer(NonBlockingSocketServer::UnixEndpoint{ .path = m_unix_socket_path }, 0);
+
+    std::thread replay_thread([&]()
+    {
+        EXPECT_TRUE(replayer.Replay(m_capture_file_path));
+        is_replay_done = true;
+    });
+
+    while(not is_replay_done || not client_disconnected)
+    {
+        server.Run();
+    }
+
+    replay_thread.join();
+    RunUntilClosed(server);
+
+    EXPECT_EQ(received,m_client_tx_string);
+    EXPECT_EQ(replayer.GetConnectionCount(),1);
+    EXPECT_EQ(replayer.GetSentByteCount(),m_client_tx_string.size());
+}
+
+} // InterProcessCommunication::Test
@@ -0,0 +1,114 @@
+#include "topic_subscriptions.h"
+#include <algorithm>
+
+namespace InterProcessCommunication
+{
+Topic::Topic(uint64_t id)
+: m_key(id)
+{
+}
+
+Topic::Topic(std::string name)
+: m_key(std::move(name))
+{
+}
+
+Topic::Topic(const char* name)
+: m_key(std::string(name))
+{
+}
+
+size_t Topic::GetHash() const
+{
+    return std::hash<std::variant<uint64_t, std::string>>{}(m_key);
+}
+
+bool TopicSubscriptions::Subscribe(int client_file_descriptor, const Topic& topic)
+{
+    std::vector<int>& subscribers = m_subscribers_by_topic[topic];
+    const auto position = std::lower_bound(subscribers.begin(), subscribers.end(), client_file_descriptor);
+
+    if(position != subscribers.end() && *position == client_file_descriptor)
+    {
+        return false;
+    }
+
+    subscribers.insert(position, client_file_descriptor);
+    m_topics_by_client[client_file_descriptor].emplace_back(topic);
+
+    return true;
+}
+
+bool TopicSubscriptions::Unsubscribe(int client_file_descriptor, const Topic& topic)
+{
+    const auto topic_it = m_subscribers_by_topic.find(topic);
+
+    if(topic_it == m_subscribers_by_topic.end())
+    {
+        return false;
+    }
+
+    std::vector<int>& subscribers = topic_it->second;
+    const auto position = std::lower_bound(subscribers.begin(), subscribers.end(), client_file_descriptor);
+
+    if(position == subscribers.end() || *position != client_file_descriptor)
+    {
+        return false;
+    }
+
+    subscribers.erase(position);
+
+    // drop topics nobody listens to, so that short lived topics do not pile up
+    if(subscribers.empty())
+    {
+        m_subscribers_by_topic.erase(topic_it);
+    }
+
+    std::vector<Topic>& topics = m_topics_by_client[client_file_descriptor];
+    topics.erase(std::find(topics.begin(), topics.end(), topic));
+
+    if(topics.empty())
+    {
+        m_topics_by_client.erase(client_file_descriptor);
+    }
+
+    return true;
+}
+
+void TopicSubscriptions::RemoveClient(int client_file_descriptor)
+{
+    const auto client_it = m_topics_by_client.find(client_file_descriptor);
+
+    if(client_it == m_topics_by_client.end())
+    {
+        return;
+    }
+
+    for(const Topic& topic : client_it->second)
+    {
+        const auto topic_it = m_subscribers_by_topic.find(topic);
+        std::vector<int>& subscribers = topic_it->second;
+        subscribers.erase(std::lower_bound(subscribers.begin(), subscribers.end(), client_file_descriptor));
+
+        if(subscribers.empty())
+        {
+            m_subscribers_by_topic.erase(topic_it);
+        }
+    }
+
+    m_topics_by_client.erase(client_it);
+}
+
+const std::vector<int>& TopicSubscriptions::GetSubscribers(const Topic& topic) const
+{
+    const auto topic_it = m_subscribers_by_topic.find(topic);
+
+    return topic_it == m_subscribers_by_topic.end() ? m_no_subscribers : topic_it->second;
+}
+
+size_t TopicSubscriptions::GetTopicCount() const
+{
+    return m_subscribers_by_topic.size();
+}
+
+} // namespace InterProcessCommunication
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace InterProcessCommunication
+{
+/*
+    A publish/subscribe topic, identified either by a number or by a name.
+*/
+class Topic
+{
+public:
+
+    Topic(uint64_t id);
+    Topic(std::string name);
+    Topic(const char* name);
+
+    bool operator==(const Topic& other) const = default;
+    size_t GetHash() const;
+
+private:
+
+    std::variant<uint64_t, std::string> m_key;
+};
+
+struct TopicHash
+{
+    size_t operator()(const Topic& topic) const
+    {
+        return topic.GetHash();
+    }
+};
+
+/*
+    Keeps track of which clients are subscribed to which topics.
+    Subscribers of a topic are kept in a sorted vector, so fanning out walks contiguous memory.
+*/
+class TopicSubscriptions
+{
+public:
+
+    /*
+        Returns false if the client was already subscribed to the topic.
+    */
+    bool Subscribe(int client_file_descriptor, const Topic& topic);
+
+    /*
+        Returns false if the client was not subscribed to the topic.
+    */
+    bool Unsubscribe(int client_file_descriptor, const Topic& topic);
+
+    /*
+        Remove every subscription of a client, for example when it disconnects.
+    */
+    void RemoveClient(int client_file_descriptor);
+
+    /*
+        Get the subscribers of a topic. The returned vector is invalidated by the next change to the subscriptions.
+    */
+    const std::vector<int>& GetSubscribers(const Topic& topic) const;
+
+    size_t GetTopicCount() const;
+
+private:
+
+    std::unordered_map<Topic, std::vector<int>, TopicHash> m_subscribers_by_topic;
+    std::unordered_map<int, std::vector<Topic>> m_topics_by_client;
+    const std::vector<int> m_no_subscribers;
+};
+} // namespace InterProcessCommunication
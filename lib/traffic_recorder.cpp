@@ -0,0 +1,204 @@
+#include "traffic_recorder.h"
+#include <cstring>
+
+namespace InterProcessCommunication
+{
+namespace
+{
+template<typename T>
+void AppendValue(std::vector<char>& buffer, T value)
+{
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+template<typename T>
+bool ReadValue(std::FILE* file, T& value)
+{
+    return std::fread(&value, sizeof(value), 1, file) == 1;
+}
+}
+
+TrafficRecorder::TrafficRecorder(size_t buffer_size)
+: m_buffer_size(buffer_size)
+{
+}
+
+TrafficRecorder::~TrafficRecorder()
+{
+    Close();
+}
+
+bool TrafficRecorder::Open(const std::string& file_path)
+{
+    if(m_file != nullptr)
+    {
+        return false;
+    }
+
+    m_file = std::fopen(file_path.c_str(), "wb");
+
+    if(m_file == nullptr)
+    {
+        perror("TrafficRecorder::Open() -> Failed to open capture file");
+        return false;
+    }
+
+    m_start_time = std::chrono::steady_clock::now();
+    m_active_buffer.reserve(m_buffer_size);
+    m_write_buffer.reserve(m_buffer_size);
+    m_active_buffer.insert(m_active_buffer.end(), FILE_MAGIC, FILE_MAGIC + sizeof(FILE_MAGIC));
+    m_is_stopping = false;
+    m_writer = std::thread(&TrafficRecorder::WriterLoop, this);
+
+    return true;
+}
+
+void TrafficRecorder::Record(TrafficEventType type, int connection_id, std::span<const char> payload)
+{
+    if(m_file == nullptr)
+    {
+        return;
+    }
+
+    if(m_active_buffer.size() + RECORD_HEADER_SIZE + payload.size() > m_buffer_size && not m_active_buffer.empty())
+    {
+        HandOverActiveBuffer();
+    }
+
+    const uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start_time).count();
+
+    AppendValue(m_active_buffer, static_cast<uint8_t>(type));
+    AppendValue(m_active_buffer, timestamp);
+    AppendValue(m_active_buffer, static_cast<int32_t>(connection_id));
+    AppendValue(m_active_buffer, static_cast<uint32_t>(payload.size()));
+    m_active_buffer.insert(m_active_buffer.end(), payload.begin(), payload.end());
+}
+
+void TrafficRecorder::Close()
+{
+    if(m_file == nullptr)
+    {
+        return;
+    }
+
+    HandOverActiveBuffer();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_is_stopping = true;
+    }
+
+    m_condition.notify_all();
+    m_writer.join();
+
+    std::fclose(m_file);
+    m_file = nullptr;
+}
+
+bool TrafficRecorder::IsOpen() const
+{
+    return m_file != nullptr;
+}
+
+void TrafficRecorder::HandOverActiveBuffer()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // only block when the writer has not finished the previous buffer yet
+    m_condition.wait(lock, [this](){ return not m_is_write_pending; });
+
+    m_write_buffer.swap(m_active_buffer);
+    m_active_buffer.clear();
+    m_is_write_pending = true;
+
+    lock.unlock();
+    m_condition.notify_all();
+}
+
+void TrafficRecorder::WriterLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while(true)
+    {
+        m_condition.wait(lock, [this](){ return m_is_write_pending || m_is_stopping; });
+
+        if(m_is_write_pending)
+        {
+            // the recorder never touches the write buffer while a write is pending, so the lock is not needed for the write itself
+            lock.unlock();
+
+            if(std::fwrite(m_write_buffer.data(), 1, m_write_buffer.size(), m_file) != m_write_buffer.size())
+            {
+                perror("TrafficRecorder::WriterLoop() -> Failed to write capture file");
+            }
+
+            std::fflush(m_file);
+
+            lock.lock();
+            m_is_write_pending = false;
+            m_condition.notify_all();
+            continue;
+        }
+
+        return;
+    }
+}
+
+TrafficCaptureReader::~TrafficCaptureReader()
+{
+    if(m_file != nullptr)
+    {
+        std::fclose(m_file);
+    }
+}
+
+bool TrafficCaptureReader::Open(const std::string& file_path)
+{
+    m_file = std::fopen(file_path.c_str(), "rb");
+
+    if(m_file == nullptr)
+    {
+        perror("TrafficCaptureReader::Open() -> Failed to open capture file");
+        return false;
+    }
+
+    char magic[sizeof(TrafficRecorder::FILE_MAGIC)] {};
+
+    if(std::fread(magic, sizeof(magic), 1, m_file) != 1 || std::memcmp(magic, TrafficRecorder::FILE_MAGIC, sizeof(magic)) != 0)
+    {
+        std::fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+bool TrafficCaptureReader::ReadNext(TrafficRecord& record)
+{
+    if(m_file == nullptr)
+    {
+        return false;
+    }
+
+    uint8_t type = 0;
+    uint64_t timestamp = 0;
+    int32_t connection_id = 0;
+    uint32_t payload_size = 0;
+
+    if(not ReadValue(m_file, type) || not ReadValue(m_file, timestamp) || not ReadValue(m_file, connection_id) || not ReadValue(m_file, payload_size))
+    {
+        return false;
+    }
+
+    record.type = static_cast<TrafficEventType>(type);
+    record.timestamp = std::chrono::nanoseconds(timestamp);
+    record.connection_id = connection_id;
+    record.payload.resize(payload_size);
+
+    return payload_size == 0 || std::fread(record.payload.data(), payload_size, 1, m_file) == 1;
+}
+
+} // namespace InterProcessCommunication
@@ -0,0 +1,105 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace InterProcessCommunication
+{
+/*
+    Capture file layout, all integers in host byte order:
+        file header:   8 byte magic "NBSSCAP" followed by a null byte
+        record header: uint8 event type, uint64 nanoseconds since the capture started, int32 connection id, uint32 payload size
+        record body:   payload bytes, only present for RECEIVE and SEND records
+*/
+enum class TrafficEventType : uint8_t
+{
+    ACCEPT = 1,
+    RECEIVE = 2,
+    SEND = 3,
+    DISCONNECT = 4
+};
+
+struct TrafficRecord
+{
+    TrafficEventType type = TrafficEventType::ACCEPT;
+    std::chrono::nanoseconds timestamp {};
+    int32_t connection_id = -1;
+    std::vector<char> payload;
+};
+
+/*
+    Appends traffic records to a capture file. Records are gathered in memory and a background thread writes full buffers to disk,
+    so the thread that records never waits on the file system unless the writer falls a whole buffer behind.
+*/
+class TrafficRecorder
+{
+public:
+
+    static constexpr char FILE_MAGIC[8] = {'N','B','S','S','C','A','P','\0'};
+    static constexpr size_t RECORD_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint64_t) + sizeof(int32_t) + sizeof(uint32_t);
+
+    explicit TrafficRecorder(size_t buffer_size = DEFAULT_BUFFER_SIZE);
+    ~TrafficRecorder();
+
+    TrafficRecorder(const TrafficRecorder&) = delete;
+    TrafficRecorder& operator=(const TrafficRecorder&) = delete;
+
+    bool Open(const std::string& file_path);
+    void Record(TrafficEventType type, int connection_id, std::span<const char> payload = {});
+
+    /*
+        Write everything recorded so far and close the file.
+    */
+    void Close();
+    bool IsOpen() const;
+
+private:
+
+    static constexpr size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+    const size_t m_buffer_size;
+    std::FILE* m_file = nullptr;
+    std::chrono::steady_clock::time_point m_start_time;
+    std::vector<char> m_active_buffer;
+    std::vector<char> m_write_buffer; // handed to the writer thread, guarded by m_mutex
+    bool m_is_write_pending = false;
+    bool m_is_stopping = false;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::thread m_writer;
+
+    void HandOverActiveBuffer();
+    void WriterLoop();
+};
+
+/*
+    Reads the records of a capture file written by TrafficRecorder, in the order they were recorded.
+*/
+class TrafficCaptureReader
+{
+public:
+
+    TrafficCaptureReader() = default;
+    ~TrafficCaptureReader();
+
+    TrafficCaptureReader(const TrafficCaptureReader&) = delete;
+    TrafficCaptureReader& operator=(const TrafficCaptureReader&) = delete;
+
+    bool Open(const std::string& file_path);
+
+    /*
+        Returns false at the end of the file or when the file is truncated.
+    */
+    bool ReadNext(TrafficRecord& record);
+
+private:
+
+    std::FILE* m_file = nullptr;
+};
+} // namespace InterProcessCommunication
@@ -0,0 +1,273 @@
+#include "traffic_replayer.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <poll.h>
+
+namespace InterProcessCommunication
+{
+TrafficReplayer::TrafficReplayer(const NonBlockingSocketServer::ListenerEndpoint& target_endpoint, double speed)
+: m_target_endpoint(target_endpoint)
+, m_speed(speed)
+{
+}
+
+TrafficReplayer::~TrafficReplayer()
+{
+    for(const auto& pair : m_client_file_descriptors)
+    {
+        if(pair.second != -1)
+        {
+            close(pair.second);
+        }
+    }
+}
+
+bool TrafficReplayer::Replay(const std::string& capture_file_path)
+{
+    TrafficCaptureReader reader;
+
+    if(not reader.Open(capture_file_path))
+    {
+        return false;
+    }
+
+    const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    TrafficRecord record;
+
+    while(reader.ReadNext(record))
+    {
+        if(m_speed > 0)
+        {
+            const auto scaled_timestamp = std::chrono::duration_cast<std::chrono::steady_clock::duration>(record.timestamp / m_speed);
+            WaitUntil(start_time + scaled_timestamp);
+        }
+
+        switch(record.type)
+        {
+            case TrafficEventType::ACCEPT:
+            {
+                // a reused connection id means the previous connection is over, even if its disconnect was not captured
+                CloseClient(record.connection_id);
+
+                const int client_fd = ConnectClient();
+
+                if(client_fd != -1)
+                {
+                    m_client_file_descriptors[record.connection_id] = client_fd;
+                    ++m_connection_count;
+                }
+
+                break;
+            }
+            case TrafficEventType::RECEIVE:
+            {
+                const auto client_it = m_client_file_descriptors.find(record.connection_id);
+
+                if(client_it != m_client_file_descriptors.end() && client_it->second != -1 && SendAll(client_it->second, record.payload))
+                {
+                    m_sent_byte_count += record.payload.size();
+                }
+
+                break;
+            }
+            case TrafficEventType::DISCONNECT:
+            {
+                CloseClient(record.connection_id);
+                break;
+            }
+            default:
+            {
+                // what the server sent is its own output, which the replay reproduces rather than sends
+                break;
+            }
+        }
+
+        DrainResponses();
+    }
+
+    while(not m_client_file_descriptors.empty())
+    {
+        CloseClient(m_client_file_descriptors.begin()->first);
+    }
+
+    return true;
+}
+
+size_t TrafficReplayer::GetConnectionCount() const
+{
+    return m_connection_count;
+}
+
+size_t TrafficReplayer::GetSentByteCount() const
+{
+    return m_sent_byte_count;
+}
+
+size_t TrafficReplayer::GetReceivedByteCount() const
+{
+    return m_received_byte_count;
+}
+
+int TrafficReplayer::ConnectClient()
+{
+    int client_fd = -1;
+    int connect_result = -1;
+
+    if(const auto* tcp_endpoint = std::get_if<NonBlockingSocketServer::TcpEndpoint>(&m_target_endpoint))
+    {
+        if(tcp_endpoint->ip_address.find(':') != std::string::npos)
+        {
+            sockaddr_in6 address{};
+            address.sin6_family = AF_INET6;
+            address.sin6_port = htons(tcp_endpoint->port);
+            inet_pton(AF_INET6, tcp_endpoint->ip_address.c_str(), &address.sin6_addr);
+            client_fd = socket(AF_INET6, SOCK_STREAM, 0);
+            connect_result = connect(client_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        }
+        else
+        {
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(tcp_endpoint->port);
+            inet_pton(AF_INET, tcp_endpoint->ip_address.c_str(), &address.sin_addr);
+            client_fd = socket(AF_INET, SOCK_STREAM, 0);
+            connect_result = connect(client_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        }
+    }
+    else if(const auto* unix_endpoint = std::get_if<NonBlockingSocketServer::UnixEndpoint>(&m_target_endpoint))
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        socklen_t address_size = sizeof(address);
+
+        if(unix_endpoint->is_abstract)
+        {
+            const size_t name_size = std::min(unix_endpoint->path.size(), sizeof(address.sun_path) - 1);
+            memcpy(address.sun_path + 1, unix_endpoint->path.data(), name_size);
+            address_size = offsetof(sockaddr_un, sun_path) + 1 + name_size;
+        }
+        else
+        {
+            strncpy(address.sun_path, unix_endpoint->path.c_str(), sizeof(address.sun_path) - 1);
+        }
+
+        client_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        connect_result = connect(client_fd, reinterpret_cast<sockaddr*>(&address), address_size);
+    }
+
+    if(client_fd == -1 || connect_result == -1)
+    {
+        perror("TrafficReplayer::ConnectClient() -> Failed to connect to the server");
+
+        if(client_fd != -1)
+        {
+            close(client_fd);
+        }
+
+        return -1;
+    }
+
+    return client_fd;
+}
+
+bool TrafficReplayer::SendAll(int client_file_descriptor, const std::vector<char>& payload)
+{
+    size_t total_sent_bytes = 0;
+
+    while(total_sent_bytes < payload.size())
+    {
+        const ssize_t sent_bytes = send(client_file_descriptor, payload.data() + total_sent_bytes, payload.size() - total_sent_bytes, MSG_NOSIGNAL);
+
+        if(sent_bytes == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            perror("TrafficReplayer::SendAll() -> Failed to send");
+            return false;
+        }
+
+        total_sent_bytes += sent_bytes;
+    }
+
+    return true;
+}
+
+void TrafficReplayer::WaitUntil(std::chrono::steady_clock::time_point deadline)
+{
+    // keep reading responses while waiting, so that the server never stalls on a full client socket
+    while(true)
+    {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+
+        if(remaining.count() <= 0)
+        {
+            return;
+        }
+
+        std::vector<pollfd> poll_file_descriptors;
+        poll_file_descriptors.reserve(m_client_file_descriptors.size());
+
+        for(const auto& pair : m_client_file_descriptors)
+        {
+            poll_file_descriptors.emplace_back(pollfd{pair.second, POLLIN, 0});
+        }
+
+        if(poll(poll_file_descriptors.data(), poll_file_descriptors.size(), remaining.count()) > 0)
+        {
+            DrainResponses();
+        }
+    }
+}
+
+void TrafficReplayer::DrainResponses()
+{
+    char rx_buffer[4096];
+
+    for(auto& pair : m_client_file_descriptors)
+    {
+        while(pair.second != -1)
+        {
+            const ssize_t read_bytes = recv(pair.second, rx_buffer, sizeof(rx_buffer), MSG_DONTWAIT);
+
+            // the server hung up; keep the entry so later records of this connection are skipped, poll() ignores negative descriptors
+            if(read_bytes == 0)
+            {
+                close(pair.second);
+                pair.second = -1;
+                break;
+            }
+
+            if(read_bytes < 0)
+            {
+                break;
+            }
+
+            m_received_byte_count += read_bytes;
+        }
+    }
+}
+
+void TrafficReplayer::CloseClient(int32_t connection_id)
+{
+    const auto client_it = m_client_file_descriptors.find(connection_id);
+
+    if(client_it == m_client_file_descriptors.end())
+    {
+        return;
+    }
+
+    DrainResponses();
+
+    if(client_it->second != -1)
+    {
+        close(client_it->second);
+    }
+
+    m_client_file_descriptors.erase(client_it);
+}
+
+} // namespace InterProcessCommunication
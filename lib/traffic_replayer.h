@@ -0,0 +1,49 @@
+#pragma once
+#include "non_blocking_socket_server.h"
+#include "traffic_recorder.h"
+#include <unordered_map>
+
+namespace InterProcessCommunication
+{
+/*
+    Re-drives a server with the client side of a capture file. Every captured connection becomes a client socket that connects,
+    sends what the original client sent, and disconnects at the captured moments. Whatever the server sends back is read and discarded.
+*/
+class TrafficReplayer
+{
+public:
+
+    /*
+        "speed" scales the captured timing: 2.0 replays twice as fast, and 0 replays as fast as possible.
+    */
+    explicit TrafficReplayer(const NonBlockingSocketServer::ListenerEndpoint& target_endpoint, double speed = 1.0);
+    ~TrafficReplayer();
+
+    TrafficReplayer(const TrafficReplayer&) = delete;
+    TrafficReplayer& operator=(const TrafficReplayer&) = delete;
+
+    /*
+        Replay a whole capture file. Blocks the calling thread until the last record has been replayed.
+    */
+    bool Replay(const std::string& capture_file_path);
+
+    size_t GetConnectionCount() const;
+    size_t GetSentByteCount() const;
+    size_t GetReceivedByteCount() const;
+
+private:
+
+    const NonBlockingSocketServer::ListenerEndpoint m_target_endpoint;
+    const double m_speed;
+    std::unordered_map<int32_t, int> m_client_file_descriptors; // captured connection id to replay socket
+    size_t m_connection_count = 0;
+    size_t m_sent_byte_count = 0;
+    size_t m_received_byte_count = 0;
+
+    int ConnectClient();
+    bool SendAll(int client_file_descriptor, const std::vector<char>& payload);
+    void WaitUntil(std::chrono::steady_clock::time_point deadline);
+    void DrainResponses();
+    void CloseClient(int32_t connection_id);
+};
+} // namespace InterProcessCommunication
@@ -0,0 +1,142 @@
+#include "worker_pool.h"
+
+namespace InterProcessCommunication
+{
+namespace
+{
+thread_local Strand* t_current_strand = nullptr;
+}
+
+WorkerPool::WorkerPool(size_t worker_count)
+{
+    if(worker_count == 0)
+    {
+        worker_count = 1;
+    }
+
+    m_workers.reserve(worker_count);
+
+    for(size_t index = 0; index < worker_count; ++index)
+    {
+        m_workers.emplace_back(&WorkerPool::WorkerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_is_stopping = true;
+    }
+
+    m_condition.notify_all();
+
+    for(std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void WorkerPool::Post(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.emplace_back(std::move(task));
+    }
+
+    m_condition.notify_one();
+}
+
+size_t WorkerPool::GetWorkerCount() const
+{
+    return m_workers.size();
+}
+
+void WorkerPool::WorkerLoop()
+{
+    while(true)
+    {
+        Task task;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this](){ return m_is_stopping || not m_tasks.empty(); });
+
+            // finish the remaining tasks before stopping, so that nothing posted is silently dropped
+            if(m_tasks.empty())
+            {
+                return;
+            }
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+Strand::Strand(WorkerPool& worker_pool)
+: m_worker_pool(worker_pool)
+{
+}
+
+void Strand::Post(WorkerPool::Task task)
+{
+    bool should_schedule = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.emplace_back(std::move(task));
+
+        // only one turn is ever queued or running, which is what keeps the tasks of a strand serialized
+        if(not m_is_scheduled)
+        {
+            m_is_scheduled = true;
+            should_schedule = true;
+        }
+    }
+
+    if(should_schedule)
+    {
+        m_worker_pool.Post([self = shared_from_this()](){ self->RunTurn(); });
+    }
+}
+
+Strand* Strand::GetCurrent()
+{
+    return t_current_strand;
+}
+
+void Strand::RunTurn()
+{
+    t_current_strand = this;
+
+    for(size_t task_count = 0; task_count < MAXIMUM_TASKS_PER_TURN; ++task_count)
+    {
+        WorkerPool::Task task;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if(m_tasks.empty())
+            {
+                m_is_scheduled = false;
+                t_current_strand = nullptr;
+                return;
+            }
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        task();
+    }
+
+    t_current_strand = nullptr;
+
+    // there is more work left, so queue another turn behind the other strands instead of continuing here
+    m_worker_pool.Post([self = shared_from_this()](){ self->RunTurn(); });
+}
+
+} // namespace InterProcessCommunication
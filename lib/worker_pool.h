@@ -0,0 +1,71 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace InterProcessCommunication
+{
+/*
+    A fixed set of threads that run posted tasks in no particular order.
+*/
+class WorkerPool
+{
+public:
+
+    using Task = std::function<void()>;
+
+    explicit WorkerPool(size_t worker_count);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void Post(Task task);
+    size_t GetWorkerCount() const;
+
+private:
+
+    std::vector<std::thread> m_workers;
+    std::deque<Task> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_is_stopping = false;
+
+    void WorkerLoop();
+};
+
+/*
+    Runs the tasks posted to it on a WorkerPool one at a time and in the order they were posted.
+    Different strands run concurrently, which is how per-client ordering is kept without serializing every client.
+*/
+class Strand : public std::enable_shared_from_this<Strand>
+{
+public:
+
+    explicit Strand(WorkerPool& worker_pool);
+
+    void Post(WorkerPool::Task task);
+
+    /*
+        Get the strand whose task is running on the calling thread, or null when called outside of a strand.
+    */
+    static Strand* GetCurrent();
+
+private:
+
+    // a strand gives its worker back after this many tasks, so one busy client cannot hold a worker forever
+    static constexpr size_t MAXIMUM_TASKS_PER_TURN = 16;
+
+    WorkerPool& m_worker_pool;
+    std::deque<WorkerPool::Task> m_tasks;
+    std::mutex m_mutex;
+    bool m_is_scheduled = false;
+
+    void RunTurn();
+};
+} // namespace InterProcessCommunication
@@ -0,0 +1,153 @@
+#include "non_blocking_socket_server.h"
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+using namespace InterProcessCommunication;
+
+namespace
+{
+/*
+    Send "message_count" messages one at a time and wait for each echo, so that every message is one round trip through the reactor.
+*/
+void RunClient(const std::string& unix_socket_path, size_t message_count, size_t message_size, std::atomic<size_t>& finished_client_count)
+{
+    const int client_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un server_address{};
+    server_address.sun_family = AF_UNIX;
+    strncpy(server_address.sun_path, unix_socket_path.c_str(), sizeof(server_address.sun_path) - 1);
+
+    if(client_fd == -1 || connect(client_fd, reinterpret_cast<sockaddr*>(&server_address), sizeof(server_address)) == -1)
+    {
+        perror("reactor_benchmark -> Failed to connect to the server");
+    }
+    else
+    {
+        std::vector<char> message(message_size, 'm');
+        std::vector<char> echo(message_size);
+
+        for(size_t index = 0; index < message_count; ++index)
+        {
+            if(send(client_fd, message.data(), message.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(message.size()))
+            {
+                break;
+            }
+
+            size_t received_bytes = 0;
+            ssize_t read_bytes = 0;
+
+            while(received_bytes < echo.size() && (read_bytes = read(client_fd, echo.data() + received_bytes, echo.size() - received_bytes)) > 0)
+            {
+                received_bytes += read_bytes;
+            }
+
+            if(read_bytes <= 0)
+            {
+                break;
+            }
+        }
+    }
+
+    if(client_fd != -1)
+    {
+        close(client_fd);
+    }
+
+    ++finished_client_count;
+}
+
+void PrintPerMessage(const std::string& label, double count, size_t message_count)
+{
+    std::cout << std::left << std::setw(24) << label << std::fixed << std::setprecision(3) << count / message_count << "\n";
+}
+}
+
+/*
+    Measures what one echoed message costs the reactor: system calls and, where the kernel allows perf_event_open(), cycles, instructions and cache misses.
+    Compare runs before and after a change to judge it by the work the loop does rather than by wall time alone.
+
+    usage: reactor_benchmark [client count] [messages per client] [message size]
+*/
+int main(int argc, char** argv)
+{
+    const size_t client_count = argc > 1 ? std::stoul(argv[1]) : 4;
+    const size_t messages_per_client = argc > 2 ? std::stoul(argv[2]) : 10000;
+    const size_t message_size = argc > 3 ? std::stoul(argv[3]) : 64;
+    const std::string unix_socket_path = "reactor_benchmark.sock";
+
+    if(client_count == 0 || messages_per_client == 0 || message_size == 0)
+    {
+        std::cerr << "usage: " << argv[0] << " [client count] [messages per client] [message size]\n";
+        return 1;
+    }
+
+    NonBlockingSocketServer server(unix_socket_path, client_count);
+    server.EnablePerfCounters();
+
+    server.SetRxCallback([&](int client_fd, const std::span<char>& rx_payload)
+    {
+        server.EnqueueSend(client_fd, rx_payload);
+    });
+
+    if(not server.Start())
+    {
+        std::cerr << "failed to start the server\n";
+        return 1;
+    }
+
+    std::atomic<size_t> finished_client_count = 0;
+    std::vector<std::thread> clients;
+
+    for(size_t index = 0; index < client_count; ++index)
+    {
+        clients.emplace_back(RunClient, unix_socket_path, messages_per_client, message_size, std::ref(finished_client_count));
+    }
+
+    NonBlockingSocketServer::RunStats run_stats;
+    const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+    while(finished_client_count < client_count)
+    {
+        run_stats += server.RunOnce(std::chrono::milliseconds(10));
+    }
+
+    const std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start_time;
+
+    for(std::thread& client : clients)
+    {
+        client.join();
+    }
+
+    server.RequestStop();
+
+    while(server.GetServerState() != NonBlockingSocketServer::ServerState::CLOSED)
+    {
+        server.Run();
+    }
+
+    const size_t message_count = client_count * messages_per_client;
+    const NonBlockingSocketServer::SyscallCounts& syscall_counts = run_stats.syscall_counts;
+
+    std::cout << "messages: " << message_count << " in " << elapsed_time.count() << " s, " << static_cast<size_t>(message_count / elapsed_time.count()) << " per second\n";
+    std::cout << "per message:\n";
+    PrintPerMessage("  syscalls", syscall_counts.GetTotal(), message_count);
+    PrintPerMessage("    epoll_wait", syscall_counts.epoll_wait_count, message_count);
+    PrintPerMessage("    read", syscall_counts.read_count, message_count);
+    PrintPerMessage("    send", syscall_counts.send_count, message_count);
+    PrintPerMessage("    accept", syscall_counts.accept_count, message_count);
+    PrintPerMessage("    epoll_ctl", syscall_counts.epoll_ctl_count, message_count);
+
+    if(server.HasPerfCounters())
+    {
+        PrintPerMessage("  cycles", run_stats.perf_counts.cycles, message_count);
+        PrintPerMessage("  instructions", run_stats.perf_counts.instructions, message_count);
+        PrintPerMessage("  cache misses", run_stats.perf_counts.cache_misses, message_count);
+    }
+    else
+    {
+        std::cout << "  perf counters unavailable\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include "traffic_replayer.h"
+#include <iostream>
+
+using namespace InterProcessCommunication;
+
+/*
+    Replays a capture file recorded with NonBlockingSocketServer::StartCapture() against a running server.
+
+    usage: traffic_replay <capture file> tcp <ip address> <port> [speed]
+           traffic_replay <capture file> unix <socket path> [speed]
+           traffic_replay <capture file> abstract <socket name> [speed]
+*/
+int main(int argc, char** argv)
+{
+    if(argc < 4)
+    {
+        std::cerr << "usage: " << argv[0] << " <capture file> (tcp <ip address> <port> | unix <socket path> | abstract <socket name>) [speed]\n";
+        return 1;
+    }
+
+    const std::string capture_file_path = argv[1];
+    const std::string transport = argv[2];
+    NonBlockingSocketServer::ListenerEndpoint target_endpoint;
+    int speed_argument_index = 4;
+
+    if(transport == "tcp")
+    {
+        if(argc < 5)
+        {
+            std::cerr << "tcp needs an ip address and a port\n";
+            return 1;
+        }
+
+        target_endpoint = NonBlockingSocketServer::TcpEndpoint{ .ip_address = argv[3], .port = static_cast<uint16_t>(std::stoul(argv[4])) };
+        speed_argument_index = 5;
+    }
+    else if(transport == "unix" || transport == "abstract")
+    {
+        target_endpoint = NonBlockingSocketServer::UnixEndpoint{ .path = argv[3], .is_abstract = transport == "abstract" };
+    }
+    else
+    {
+        std::cerr << "unknown transport: " << transport << "\n";
+        return 1;
+    }
+
+    const double speed = argc > speed_argument_index ? std::stod(argv[speed_argument_index]) : 1.0;
+
+    TrafficReplayer replayer(target_endpoint, speed);
+
+    if(not replayer.Replay(capture_file_path))
+    {
+        std::cerr << "failed to replay " << capture_file_path << "\n";
+        return 1;
+    }
+
+    std::cout << "connections: " << replayer.GetConnectionCount()
+              << ", sent bytes: " << replayer.GetSentByteCount()
+              << ", received bytes: " << replayer.GetReceivedByteCount() << "\n";
+
+    return 0;
+}